@@ -0,0 +1,46 @@
+#!/bin/sh
+# Compare query scratch memory between two revisions.
+#
+# Usage: benchmarks/memory.sh <query.tql> <file>...
+#
+# Builds `zig build bench-memory` in a worktree for each revision and runs it
+# on the same inputs. BEFORE defaults to the revision before the benchmark was
+# added (the last one with the old runtime.Value), AFTER to HEAD. A revision
+# without the benchmark gets it from the commit that added it.
+set -eu
+
+here=$(cd "$(dirname "$0")/.." && pwd)
+repo=$(git -C "$here" rev-parse --show-toplevel)
+pkg=${here#"$repo"/}
+bench_commit=$(git -C "$repo" log --diff-filter=A --format=%H -1 -- "$pkg/src/bench/memory.zig")
+before=${BEFORE:-$bench_commit~1}
+after=${AFTER:-HEAD}
+
+# The benchmark runs from another directory.
+n=$#
+while [ "$n" -gt 0 ]; do
+  set -- "$@" "$(realpath "$1")"
+  shift
+  n=$((n - 1))
+done
+
+work=$(mktemp -d)
+cleanup() {
+  for side in before after; do
+    [ -d "$work/$side" ] && git -C "$repo" worktree remove --force "$work/$side"
+  done
+  rm -rf "$work"
+}
+trap cleanup EXIT
+
+for side in before after; do
+  if [ "$side" = before ]; then rev=$before; else rev=$after; fi
+  git -C "$repo" worktree add --detach -q "$work/$side" "$rev"
+  dir=$work/$side/$pkg
+  if [ ! -f "$dir/src/bench/memory.zig" ]; then
+    git -C "$repo" show "$bench_commit:$pkg/src/bench/memory.zig" >"$dir/src/bench/memory.zig"
+    git -C "$repo" diff "$bench_commit~1" "$bench_commit" -- "$pkg/build.zig" | git -C "$work/$side" apply
+  fi
+  echo "== $side: $(git -C "$repo" rev-parse --short "$rev")"
+  (cd "$dir" && zig build bench-memory -Doptimize=ReleaseFast -- "$@")
+done
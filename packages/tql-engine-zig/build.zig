@@ -5,6 +5,8 @@ const VERSION = "0.1.4";
 
 const TreeSitterGrammar = struct {
     dep_name: []const u8,
+    /// Must match the tag in `Language`.
+    language: []const u8,
     root: []const u8 = ".",
     files: []const []const u8 = &.{
         "src/parser.c",
@@ -18,38 +20,47 @@ const TreeSitterGrammar = struct {
 const grammars: []const TreeSitterGrammar = &.{
     .{
         .dep_name = "tree-sitter-cpp",
+        .language = "cpp",
         .files = &.{ "src/parser.c", "src/scanner.c" },
     },
     .{
         .dep_name = "tree-sitter-c",
+        .language = "c",
     },
     .{
         .dep_name = "tree-sitter-go",
+        .language = "go",
     },
     .{
         .dep_name = "tree-sitter-javascript",
+        .language = "javascript",
         .files = &.{ "src/parser.c", "src/scanner.c" },
     },
     .{
         .dep_name = "tree-sitter-python",
+        .language = "python",
         .files = &.{ "src/parser.c", "src/scanner.c" },
     },
     .{
         .dep_name = "tree-sitter-rust",
+        .language = "rust",
         .files = &.{ "src/parser.c", "src/scanner.c" },
     },
     .{
         .dep_name = "tree-sitter-typescript",
+        .language = "typescript",
         .root = "typescript",
         .files = &.{ "src/parser.c", "src/scanner.c" },
     },
     .{
         .dep_name = "tree-sitter-typescript",
+        .language = "tsx",
         .root = "tsx",
         .files = &.{ "src/parser.c", "src/scanner.c" },
     },
     .{
         .dep_name = "tree-sitter-zig",
+        .language = "zig",
     },
 };
 
@@ -59,6 +70,7 @@ fn addGrammar(
     grammar: TreeSitterGrammar,
     target: std.Build.ResolvedTarget,
     optimize: std.builtin.OptimizeMode,
+    keywords_tool: *std.Build.Step.Compile,
 ) !void {
     var buf: [std.posix.PATH_MAX]u8 = undefined;
     const include = try std.fmt.bufPrint(&buf, "{s}/{s}", .{ grammar.root, "src" });
@@ -73,6 +85,18 @@ fn addGrammar(
         .files = grammar.files,
         .flags = grammar.flags,
     });
+
+    // Exposed to `Language.nodeTypes` for grammar-aware optimizations.
+    mod.addAnonymousImport(b.fmt("node-types/{s}", .{grammar.language}), .{
+        .root_source_file = tree_sitter_grammar.path(b.pathJoin(&.{ grammar.root, "src/node-types.json" })),
+    });
+
+    // Exposed to `Language.keywords` for skipping files before parsing.
+    const keywords = b.addRunArtifact(keywords_tool);
+    keywords.addFileArg(tree_sitter_grammar.path(b.pathJoin(&.{ grammar.root, "src/grammar.json" })));
+    mod.addAnonymousImport(b.fmt("keywords/{s}", .{grammar.language}), .{
+        .root_source_file = keywords.addOutputFileArg(b.fmt("{s}-keywords.txt", .{grammar.language})),
+    });
 }
 
 fn addEngineDeps(
@@ -80,6 +104,8 @@ fn addEngineDeps(
     mod: *std.Build.Module,
     target: std.Build.ResolvedTarget,
     optimize: std.builtin.OptimizeMode,
+    regex_jit: bool,
+    keywords_tool: *std.Build.Step.Compile,
 ) !void {
     const tree_sitter = b.dependency("tree_sitter", .{
         .target = target,
@@ -88,10 +114,17 @@ fn addEngineDeps(
     mod.addImport("tree-sitter", tree_sitter.module("tree_sitter"));
 
     for (grammars) |grammar| {
-        try addGrammar(b, mod, grammar, target, optimize);
+        try addGrammar(b, mod, grammar, target, optimize, keywords_tool);
     }
 
-    const pcre2 = b.dependency("pcre2", .{
+    // Regexes are JIT compiled when pcre2 supports it and interpreted
+    // otherwise.
+    const pcre2 = if (regex_jit) b.dependency("pcre2", .{
+        .target = target,
+        .optimize = optimize,
+        .linkage = .static,
+        .support_jit = true,
+    }) else b.dependency("pcre2", .{
         .target = target,
         .optimize = optimize,
         .linkage = .static,
@@ -210,7 +243,26 @@ pub fn build(b: *std.Build) !void {
     });
     exe.root_module.addImport("clap", clap.module("clap"));
 
-    try addEngineDeps(b, mod, target, optimize);
+    // Runs at build time to derive per-kind keywords from each grammar.
+    const host_clap = b.dependency("clap", .{
+        .target = b.graph.host,
+        .optimize = .Debug,
+    });
+    const keywords_tool = b.addExecutable(.{
+        .name = "grammar-keywords",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/tools/grammar_keywords.zig"),
+            .target = b.graph.host,
+            .imports = &.{
+                .{ .name = "clap", .module = host_clap.module("clap") },
+            },
+        }),
+    });
+
+    // pcre2 has no JIT for wasm; everywhere else it is on unless turned off.
+    const regex_jit = b.option(bool, "regex-jit", "Build pcre2 with JIT support (default: on for native targets)") orelse
+        !target.result.cpu.arch.isWasm();
+    try addEngineDeps(b, mod, target, optimize, regex_jit, keywords_tool);
 
     const build_wasm = b.option(bool, "wasm", "Build the wasm artifact") orelse false;
     if (build_wasm) {
@@ -224,7 +276,7 @@ pub fn build(b: *std.Build) !void {
             .target = wasm_target,
             .optimize = wasm_optimize,
         });
-        try addEngineDeps(b, wasm_mod, wasm_target, wasm_optimize);
+        try addEngineDeps(b, wasm_mod, wasm_target, wasm_optimize, false, keywords_tool);
 
         const wasm_exe = b.addExecutable(.{
             .name = "tql",
@@ -268,6 +320,46 @@ pub fn build(b: *std.Build) !void {
         run_cmd.addArgs(args);
     }
 
+    // Microbenchmarks, e.g. `zig build bench -Doptimize=ReleaseFast -- file.c`.
+    const bench_exe = b.addExecutable(.{
+        .name = "bench-descendants",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/bench/descendants.zig"),
+            .target = target,
+            .optimize = optimize,
+            .imports = &.{
+                .{ .name = "tql_engine_zig", .module = mod },
+                .{ .name = "clap", .module = clap.module("clap") },
+            },
+        }),
+    });
+    const bench_step = b.step("bench", "Run descendant traversal microbenchmark");
+    const bench_cmd = b.addRunArtifact(bench_exe);
+    bench_step.dependOn(&bench_cmd.step);
+    if (b.args) |args| {
+        bench_cmd.addArgs(args);
+    }
+
+    // e.g. `zig build bench-memory -Doptimize=ReleaseFast -- query.tql file.c`.
+    const bench_memory_exe = b.addExecutable(.{
+        .name = "bench-memory",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/bench/memory.zig"),
+            .target = target,
+            .optimize = optimize,
+            .imports = &.{
+                .{ .name = "tql_engine_zig", .module = mod },
+                .{ .name = "clap", .module = clap.module("clap") },
+            },
+        }),
+    });
+    const bench_memory_step = b.step("bench-memory", "Run query memory benchmark");
+    const bench_memory_cmd = b.addRunArtifact(bench_memory_exe);
+    bench_memory_step.dependOn(&bench_memory_cmd.step);
+    if (b.args) |args| {
+        bench_memory_cmd.addArgs(args);
+    }
+
     // Creates an executable that will run `test` blocks from the provided module.
     // Here `mod` needs to define a target, which is why earlier we made sure to
     // set the releative field.
@@ -293,12 +385,18 @@ pub fn build(b: *std.Build) !void {
     // A run step that will run the second test executable.
     const run_exe_tests = b.addRunArtifact(exe_tests);
 
+    const keywords_tool_tests = b.addTest(.{
+        .root_module = keywords_tool.root_module,
+    });
+    const run_keywords_tool_tests = b.addRunArtifact(keywords_tool_tests);
+
     // A top level step for running all tests. dependOn can be called multiple
     // times and since the two run steps do not depend on one another, this will
     // make the two of them run in parallel.
     const test_step = b.step("test", "Run tests");
     test_step.dependOn(&run_mod_tests.step);
     test_step.dependOn(&run_exe_tests.step);
+    test_step.dependOn(&run_keywords_tool_tests.step);
 
     // Just like flags, top level steps are also listed in the `--help` menu.
     //
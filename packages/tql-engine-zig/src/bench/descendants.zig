@@ -0,0 +1,180 @@
+//! Microbenchmark for descendant traversal.
+//!
+//! Compares the streaming `PreorderWalker` against seeking with
+//! `gotoDescendant` for every step, over every file given on the command
+//! line. Run with `zig build bench -Doptimize=ReleaseFast -- <file>...`.
+const std = @import("std");
+const tql = @import("tql_engine_zig");
+const clap = @import("clap");
+const ts = tql.ts;
+const PreorderWalker = tql.runtime.PreorderWalker;
+const Reachability = tql.Reachability;
+const Language = tql.Language;
+const NodeKindId = tql.runtime.NodeKindId;
+
+/// The iterator `PreorderWalker` replaced, kept here as the baseline.
+const SeekingIterator = struct {
+    cursor: ts.TreeCursor,
+    kind_id: ?NodeKindId,
+    current_index: u32,
+    descendant_count: u32,
+
+    fn init(parent: ts.Node, kind_id: ?NodeKindId) SeekingIterator {
+        return .{
+            .cursor = parent.walk(),
+            .kind_id = kind_id,
+            .current_index = 0,
+            .descendant_count = parent.descendantCount(),
+        };
+    }
+
+    fn deinit(self: *SeekingIterator) void {
+        self.cursor.destroy();
+    }
+
+    fn next(self: *SeekingIterator) bool {
+        while (self.current_index + 1 < self.descendant_count) {
+            self.current_index += 1;
+            self.cursor.gotoDescendant(self.current_index);
+            const n = self.cursor.node();
+            if (!n.isNamed()) continue;
+            if (self.kind_id) |k| if (n.kindId() != k) continue;
+            return true;
+        }
+        return false;
+    }
+};
+
+const Variant = enum {
+    seek_all,
+    walk_all,
+    seek_kind,
+    walk_kind,
+    walk_kind_pruned,
+};
+
+const Totals = struct {
+    ns: [std.enums.values(Variant).len]i96 = @splat(0),
+    matches: [std.enums.values(Variant).len]u64 = @splat(0),
+};
+
+fn runVariant(variant: Variant, root: ts.Node, kind_id: NodeKindId, reachability: *const Reachability) u64 {
+    var count: u64 = 0;
+    switch (variant) {
+        .seek_all, .seek_kind => {
+            var it = SeekingIterator.init(root, if (variant == .seek_kind) kind_id else null);
+            defer it.deinit();
+            while (it.next()) count += 1;
+        },
+        .walk_all, .walk_kind, .walk_kind_pruned => {
+            var walker = PreorderWalker.init(root);
+            defer walker.deinit();
+            while (walker.nextNamed()) {
+                const n = walker.node();
+                if (variant == .walk_all or n.kindId() == kind_id) {
+                    count += 1;
+                } else if (variant == .walk_kind_pruned and reachability.canPrune(n, kind_id)) {
+                    walker.skipSubtree();
+                }
+            }
+        },
+    }
+    return count;
+}
+
+pub fn main(init: std.process.Init) !u8 {
+    const allocator = init.gpa;
+    const io = init.io;
+
+    var stdout_buffer: [1024]u8 = undefined;
+    var stderr_buffer: [1024]u8 = undefined;
+    var stdout_writer = std.Io.File.stdout().writer(io, &stdout_buffer);
+    var stderr_writer = std.Io.File.stderr().writer(io, &stderr_buffer);
+    const stdout = &stdout_writer.interface;
+    const stderr = &stderr_writer.interface;
+    defer stdout.flush() catch {};
+    defer stderr.flush() catch {};
+
+    const params = comptime clap.parseParamsComptime(
+        \\-h, --help                  Display this help and exit
+        \\-i, --iterations <usize>    Traversals per file and variant (default 10)
+        \\-k, --kind <str>            Node kind to search for (default call_expression)
+        \\<file>...
+    );
+    const parsers = comptime .{
+        .str = clap.parsers.string,
+        .usize = clap.parsers.int(usize, 10),
+        .file = clap.parsers.string,
+    };
+
+    var diag = clap.Diagnostic{};
+    var res = clap.parse(clap.Help, &params, parsers, init.minimal.args, .{
+        .diagnostic = &diag,
+        .allocator = allocator,
+    }) catch |err| {
+        try diag.report(stderr, err);
+        return 1;
+    };
+    defer res.deinit();
+
+    if (res.args.help != 0 or res.positionals[0].len == 0) {
+        try clap.helpToFile(io, .stderr(), clap.Help, &params, .{});
+        return if (res.args.help != 0) 0 else 1;
+    }
+
+    const iterations = res.args.iterations orelse 10;
+    const kind = res.args.kind orelse "call_expression";
+
+    const language = Language.c.getTreeSitterLanguage();
+    defer language.destroy();
+    const kind_id = language.idForNodeKind(kind, true);
+    if (kind_id == 0) {
+        try stderr.print("unknown node kind: {s}\n", .{kind});
+        return 1;
+    }
+
+    var reachability = try Reachability.init(allocator, language, Language.c.nodeTypes());
+    defer reachability.deinit();
+
+    const parser = ts.Parser.create();
+    defer parser.destroy();
+    try parser.setLanguage(language);
+
+    var totals: Totals = .{};
+    var nodes: u64 = 0;
+    for (res.positionals[0]) |path| {
+        const file = try std.Io.Dir.cwd().openFile(io, path, .{});
+        defer file.close(io);
+        var file_reader = file.reader(io, &.{});
+        const source = try file_reader.interface.allocRemaining(allocator, .unlimited);
+        defer allocator.free(source);
+
+        const tree = parser.parseString(source, null) orelse return error.ParseFailed;
+        defer tree.destroy();
+        const root = tree.rootNode();
+        nodes += @as(u64, root.descendantCount()) * iterations;
+
+        for (std.enums.values(Variant), 0..) |variant, i| {
+            const start = std.Io.Timestamp.now(io, .awake);
+            for (0..iterations) |_| {
+                const matches = runVariant(variant, root, kind_id, &reachability);
+                std.mem.doNotOptimizeAway(matches);
+                totals.matches[i] += matches;
+            }
+            totals.ns[i] += start.untilNow(io, .awake).nanoseconds;
+        }
+    }
+
+    try stdout.print("{d} nodes visited per variant, searching for {s}\n", .{ nodes, kind });
+    try stdout.print("{s:<18} {s:>14} {s:>10} {s:>12}\n", .{ "variant", "total ms", "ns/node", "matches" });
+    for (std.enums.values(Variant), 0..) |variant, i| {
+        const ns: f64 = @floatFromInt(totals.ns[i]);
+        try stdout.print("{s:<18} {d:>14.2} {d:>10.2} {d:>12}\n", .{
+            @tagName(variant),
+            ns / std.time.ns_per_ms,
+            ns / @as(f64, @floatFromInt(@max(nodes, 1))),
+            totals.matches[i],
+        });
+    }
+    return 0;
+}
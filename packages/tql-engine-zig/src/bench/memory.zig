@@ -0,0 +1,166 @@
+//! Memory benchmark for query execution.
+//!
+//! Runs a query over every file given on the command line and reports how
+//! much scratch memory the runtime needed: the peak number of live bytes for
+//! any one file, and the total bytes and allocations over all files. Run with
+//! `zig build bench-memory -Doptimize=ReleaseFast -- <query.tql> <file>...`.
+const std = @import("std");
+const tql = @import("tql_engine_zig");
+const clap = @import("clap");
+const Allocator = std.mem.Allocator;
+const Alignment = std.mem.Alignment;
+const Language = tql.Language;
+
+/// Forwards to a child allocator, keeping track of live and peak bytes.
+const CountingAllocator = struct {
+    const Self = @This();
+
+    child: Allocator,
+    live: usize = 0,
+    peak: usize = 0,
+    total: usize = 0,
+    count: usize = 0,
+
+    fn allocator(self: *Self) Allocator {
+        return .{
+            .ptr = self,
+            .vtable = &.{
+                .alloc = alloc,
+                .resize = resize,
+                .remap = remap,
+                .free = free,
+            },
+        };
+    }
+
+    /// Start a new peak measurement.
+    fn resetPeak(self: *Self) void {
+        self.peak = self.live;
+    }
+
+    fn grow(self: *Self, old_len: usize, new_len: usize) void {
+        self.live = self.live - old_len + new_len;
+        self.peak = @max(self.peak, self.live);
+        if (new_len > old_len) self.total += new_len - old_len;
+    }
+
+    fn alloc(ctx: *anyopaque, len: usize, alignment: Alignment, ret_addr: usize) ?[*]u8 {
+        const self: *Self = @ptrCast(@alignCast(ctx));
+        const ptr = self.child.rawAlloc(len, alignment, ret_addr) orelse return null;
+        self.count += 1;
+        self.grow(0, len);
+        return ptr;
+    }
+
+    fn resize(ctx: *anyopaque, memory: []u8, alignment: Alignment, new_len: usize, ret_addr: usize) bool {
+        const self: *Self = @ptrCast(@alignCast(ctx));
+        if (!self.child.rawResize(memory, alignment, new_len, ret_addr)) return false;
+        self.grow(memory.len, new_len);
+        return true;
+    }
+
+    fn remap(ctx: *anyopaque, memory: []u8, alignment: Alignment, new_len: usize, ret_addr: usize) ?[*]u8 {
+        const self: *Self = @ptrCast(@alignCast(ctx));
+        const ptr = self.child.rawRemap(memory, alignment, new_len, ret_addr) orelse return null;
+        self.grow(memory.len, new_len);
+        return ptr;
+    }
+
+    fn free(ctx: *anyopaque, memory: []u8, alignment: Alignment, ret_addr: usize) void {
+        const self: *Self = @ptrCast(@alignCast(ctx));
+        self.child.rawFree(memory, alignment, ret_addr);
+        self.live -= memory.len;
+    }
+};
+
+fn readFile(io: std.Io, allocator: Allocator, path: []const u8) ![]u8 {
+    const file = try std.Io.Dir.cwd().openFile(io, path, .{});
+    defer file.close(io);
+    var file_reader = file.reader(io, &.{});
+    return file_reader.interface.allocRemaining(allocator, .unlimited);
+}
+
+pub fn main(init: std.process.Init) !u8 {
+    const allocator = init.gpa;
+    const io = init.io;
+
+    var stdout_buffer: [1024]u8 = undefined;
+    var stderr_buffer: [1024]u8 = undefined;
+    var stdout_writer = std.Io.File.stdout().writer(io, &stdout_buffer);
+    var stderr_writer = std.Io.File.stderr().writer(io, &stderr_buffer);
+    const stdout = &stdout_writer.interface;
+    const stderr = &stderr_writer.interface;
+    defer stdout.flush() catch {};
+    defer stderr.flush() catch {};
+
+    const params = comptime clap.parseParamsComptime(
+        \\-h, --help                  Display this help and exit
+        \\-l, --language <str>        Language of the files (default c)
+        \\<file>...
+    );
+    const parsers = comptime .{
+        .str = clap.parsers.string,
+        .file = clap.parsers.string,
+    };
+
+    var diag = clap.Diagnostic{};
+    var res = clap.parse(clap.Help, &params, parsers, init.minimal.args, .{
+        .diagnostic = &diag,
+        .allocator = allocator,
+    }) catch |err| {
+        try diag.report(stderr, err);
+        return 1;
+    };
+    defer res.deinit();
+
+    if (res.args.help != 0 or res.positionals[0].len < 2) {
+        try clap.helpToFile(io, .stderr(), clap.Help, &params, .{});
+        return if (res.args.help != 0) 0 else 1;
+    }
+
+    const language_name = res.args.language orelse "c";
+    const language = std.meta.stringToEnum(Language, language_name) orelse {
+        try stderr.print("unknown language: {s}\n", .{language_name});
+        return 1;
+    };
+
+    const query_path = res.positionals[0][0];
+    const paths = res.positionals[0][1..];
+
+    const query_source = try readFile(io, allocator, query_path);
+    defer allocator.free(query_source);
+
+    var engine = try tql.Engine.init(.{ .allocator = allocator, .io = io });
+    defer engine.deinit();
+    var query = try engine.compile(query_source, language);
+    defer query.deinit();
+
+    var counting: CountingAllocator = .{ .child = allocator };
+    const scratch = counting.allocator();
+
+    var peak: usize = 0;
+    var peak_path: []const u8 = "";
+    var values: usize = 0;
+    for (paths) |path| {
+        const source = try readFile(io, allocator, path);
+        defer allocator.free(source);
+
+        counting.resetPeak();
+        var result = try query.run(source, allocator, scratch);
+        defer result.deinit();
+        values += result.values.items.len;
+
+        if (counting.peak > peak) {
+            peak = counting.peak;
+            peak_path = path;
+        }
+    }
+
+    try stdout.print("runtime.Value size    {d} bytes\n", .{@sizeOf(tql.runtime.Value)});
+    try stdout.print("files                 {d}\n", .{paths.len});
+    try stdout.print("values                {d}\n", .{values});
+    try stdout.print("peak scratch          {d} bytes ({s})\n", .{ peak, peak_path });
+    try stdout.print("total scratch         {d} bytes\n", .{counting.total});
+    try stdout.print("scratch allocations   {d}\n", .{counting.count});
+    return 0;
+}
@@ -14,8 +14,12 @@ const ProgramImage = runtime.ProgramImage;
 
 const ast = @import("ast.zig");
 const pcre2 = @import("regex.zig");
+const Reachability = @import("reachability.zig").Reachability;
 
 const ScopeStack = @import("compiler/scope_stack.zig").ScopeStack;
+const regex_literals = @import("compiler/regex_literals.zig");
+const necessary_literals = @import("compiler/necessary_literals.zig");
+const RegexGroups = @import("compiler/regex_groups.zig").RegexGroups;
 pub const InstructionBuilder = @import("compiler/instruction_builder.zig").InstructionBuilder;
 const CompilerError = @import("compiler/types.zig").CompilerError;
 
@@ -52,7 +56,17 @@ pub const Compiler = struct {
     binding_metadata: std.ArrayList(BindingMetadata),
 
     regexes: std.ArrayList(pcre2.Regex),
+    regex_sources: std.ArrayList([]const u8),
+    /// Regex set of each regex, or `RegexSets.none`.
+    regex_set_of: std.ArrayList(u32),
+    /// Regex sets of the source being compiled.
+    regex_groups: ?RegexGroups,
     strings: std.ArrayList([]const u8),
+    /// Grammar reachability, if loaded with `loadNodeTypes`. Moved into the
+    /// compiled `ProgramImage`.
+    reachability: ?Reachability,
+    /// Grammar keywords per node kind, if loaded with `loadKeywords`.
+    keywords: []const u8,
 
     // FIXME: we're supposed to detect the language
     pub fn init(allocator: Allocator, language: *ts.Language) Compiler {
@@ -67,7 +81,12 @@ pub const Compiler = struct {
             .language = language,
             .binding_metadata = bindings,
             .regexes = regexes,
+            .regex_sources = .empty,
+            .regex_set_of = .empty,
+            .regex_groups = null,
             .strings = strings,
+            .reachability = null,
+            .keywords = "",
             .instruction_builder = instruction_builder,
         };
     }
@@ -84,16 +103,62 @@ pub const Compiler = struct {
         }
         self.regexes.deinit(self.allocator);
 
+        for (self.regex_sources.items) |src| {
+            self.allocator.free(src);
+        }
+        self.regex_sources.deinit(self.allocator);
+        self.regex_set_of.deinit(self.allocator);
+        if (self.regex_groups) |*groups| groups.deinit();
+
         for (self.strings.items) |str| {
             self.allocator.free(str);
         }
         self.strings.deinit(self.allocator);
+
+        if (self.reachability) |*r| r.deinit();
+    }
+
+    /// Load the grammar's node-types.json so that navigations the grammar
+    /// rules out are compiled away and descendant searches can be pruned.
+    pub fn loadNodeTypes(self: *Compiler, node_types_json: []const u8) !void {
+        if (self.reachability) |*r| r.deinit();
+        self.reachability = null;
+        self.reachability = try Reachability.init(self.allocator, self.language, node_types_json);
+    }
+
+    /// Load the grammar's keywords per node kind, from `Language.keywords`,
+    /// so that files lacking keywords the query needs are skipped unparsed.
+    /// `keywords` must outlive the compiler.
+    pub fn loadKeywords(self: *Compiler, keywords: []const u8) void {
+        self.keywords = keywords;
+    }
+
+    /// Compile `pattern` and add it to the regex pool, returning its index
+    /// for `Value.regex`.
+    pub fn addRegex(self: *Compiler, pattern: []const u8) CompilerError!runtime.RegexId {
+        return self.addRegexToSet(pattern, runtime.RegexSets.none);
     }
 
-    pub fn addRegex(self: *Compiler, regex: pcre2.Regex) CompilerError!usize {
+    /// Like `addRegex`, but as a member of regex set `set`. Members are
+    /// interned, since the set decides them together anyway.
+    fn addRegexToSet(self: *Compiler, pattern: []const u8, set: u32) CompilerError!runtime.RegexId {
+        if (set != runtime.RegexSets.none) {
+            for (self.regex_set_of.items, self.regex_sources.items, 0..) |member_set, source, index| {
+                if (member_set == set and std.mem.eql(u8, source, pattern)) return @intCast(index);
+            }
+        }
+
         const index = self.regexes.items.len;
+        const source = try self.allocator.dupe(u8, pattern);
+        errdefer self.allocator.free(source);
+        try self.regex_sources.ensureUnusedCapacity(self.allocator, 1);
+        try self.regex_set_of.ensureUnusedCapacity(self.allocator, 1);
+        var regex = try pcre2.Regex.compile(pattern);
+        errdefer regex.deinit();
         try self.regexes.append(self.allocator, regex);
-        return index;
+        self.regex_sources.appendAssumeCapacity(source);
+        self.regex_set_of.appendAssumeCapacity(set);
+        return @intCast(index);
     }
 
     pub fn addString(self: *Compiler, str: []const u8) CompilerError![]const u8 {
@@ -103,6 +168,14 @@ pub const Compiler = struct {
         return owned;
     }
 
+    /// Add a string to the constant pool, returning its index for
+    /// `Value.string`.
+    pub fn addStringConstant(self: *Compiler, str: []const u8) CompilerError!runtime.StringId {
+        const index = self.strings.items.len;
+        _ = try self.addString(str);
+        return @intCast(index);
+    }
+
     // START environment manipulation primitives
 
     fn bindCursorTo(self: *Compiler, var_id: VariableId) CompilerError!void {
@@ -139,6 +212,7 @@ pub const Compiler = struct {
             },
             .node_selector => |node_selector| {
                 const kind_id = self.language.idForNodeKind(node_selector.node_type, true);
+                if (self.instruction_builder.fuseKindFilter(kind_id)) return;
                 try self.instruction_builder.emit(.{ .rel = .{
                     .relation = .equals,
                     .a = .{ .node = .kind },
@@ -152,6 +226,12 @@ pub const Compiler = struct {
                 try self.instruction_builder.emit(.{ .trv = .{ .field = field_id } });
             },
             .child_navigation => |child_nav| {
+                if (self.isChildUnreachable(child_nav)) {
+                    // The grammar says this never matches; don't bother
+                    // navigating to the parent either.
+                    try self.instruction_builder.emit(.{ .halt = .{ .condition = .always } });
+                    return;
+                }
                 try self.navigateTo(child_nav.parent);
                 try self.instruction_builder.emit(.{ .trv = .{ .child = {} } });
                 try self.navigateTo(child_nav.child);
@@ -170,7 +250,59 @@ pub const Compiler = struct {
 
     // END cursor manipulation primitives
 
+    // START static analysis
+
+    fn isChildUnreachable(self: *Compiler, child_nav: *const ast.ChildNavigation) bool {
+        const reachability = if (self.reachability) |*r| r else return false;
+        const parent_kind = self.staticKindOf(child_nav.parent, 0) orelse return false;
+        const child_kind = self.headKindOf(child_nav.child) orelse return false;
+        return !reachability.mayHaveChild(parent_kind, child_kind);
+    }
+
+    /// The node kind `expr` always navigates to, if it can be known statically.
+    fn staticKindOf(self: *Compiler, expr: ast.Expression, depth: u8) ?NodeKindId {
+        // Bindings can refer to each other; don't chase them forever.
+        if (depth > 16) return null;
+        return switch (expr) {
+            .node_selector => |node_selector| self.language.idForNodeKind(node_selector.node_type, true),
+            .child_navigation => |child_nav| self.staticKindOf(child_nav.child, depth + 1),
+            .descendant_navigation => |desc_nav| self.staticKindOf(desc_nav.descendant, depth + 1),
+            .parenthesized => |parenthesized| self.staticKindOf(parenthesized.*, depth + 1),
+            .variable => |variable| {
+                const var_id = self.scope_stack.get(variable.name) orelse return null;
+                for (self.binding_metadata.items) |binding| {
+                    if (binding.variable_id != var_id) continue;
+                    return switch (binding.navigation) {
+                        .expression => |expression| self.staticKindOf(expression, depth + 1),
+                        else => null,
+                    };
+                }
+                return null;
+            },
+            else => null,
+        };
+    }
+
+    /// The node kind of the first node `expr` tests when navigated to from
+    /// the current node, if it can be known statically.
+    fn headKindOf(self: *Compiler, expr: ast.Expression) ?NodeKindId {
+        return switch (expr) {
+            .node_selector => |node_selector| self.language.idForNodeKind(node_selector.node_type, true),
+            .child_navigation => |child_nav| self.headKindOf(child_nav.parent),
+            .descendant_navigation => |desc_nav| self.headKindOf(desc_nav.parent),
+            .field_access => |field_access| self.headKindOf(field_access.base),
+            .parenthesized => |parenthesized| self.headKindOf(parenthesized.*),
+            else => null,
+        };
+    }
+
+    // END static analysis
+
     pub fn compile(self: *Compiler, allocator: std.mem.Allocator, source: ast.SourceFile) CompilerError!ProgramImage {
+        if (self.regex_groups) |*groups| groups.deinit();
+        self.regex_groups = null;
+        self.regex_groups = try RegexGroups.init(self.allocator, source);
+
         try self.scope_stack.enterScope();
         const root_id = try self.scope_stack.getOrPut(ROOT_NAME);
         try self.binding_metadata.append(self.allocator, .{
@@ -207,20 +339,80 @@ pub const Compiler = struct {
             try variable_map.put(entry.value_ptr.*, slice);
         }
 
-        const instructions = try self.instruction_builder.patch(allocator);
+        const prefilter = try self.derivePrefilter(allocator, source);
+        errdefer {
+            allocator.free(prefilter.clause_ends);
+            allocator.free(prefilter.literals);
+        }
+
+        const ir = try self.instruction_builder.patch(self.allocator);
+        defer self.allocator.free(ir);
+        var bytecode = try runtime.bytecode.assemble(allocator, ir);
+        errdefer bytecode.deinit(allocator);
+        const regex_set_of = try self.regexSetOf(allocator);
+        errdefer allocator.free(regex_set_of);
+        var regex_sets = runtime.RegexSets.init(allocator, regex_set_of, self.regex_sources.items) catch |err| switch (err) {
+            error.InvalidRegexSets => unreachable,
+            error.OutOfMemory => |e| return e,
+        };
+        errdefer regex_sets.deinit(allocator);
         const regexes = try self.regexes.toOwnedSlice(allocator);
+        const regex_sources = try self.regex_sources.toOwnedSlice(allocator);
+        self.regex_set_of.clearRetainingCapacity();
         const strings = try self.strings.toOwnedSlice(allocator);
+        const reachability = self.reachability;
+        self.reachability = null;
 
         self.scope_stack.exitScope();
         return .{
-            .instructions = instructions,
+            .code = bytecode.code,
+            .constants = bytecode.constants,
             .regexes = regexes,
+            .regex_sources = regex_sources,
             .strings = strings,
             .variable_map = variable_map,
+            .variable_count = self.scope_stack.next_id,
+            .reachability = reachability,
+            .prefilter = prefilter,
+            .regex_sets = regex_sets,
             .allocator = allocator,
         };
     }
 
+    /// The set of each regex, or nothing when the program has no sets.
+    fn regexSetOf(self: *Compiler, allocator: Allocator) Allocator.Error![]const u32 {
+        for (self.regex_set_of.items) |set| {
+            if (set != runtime.RegexSets.none) break;
+        } else return &.{};
+        return allocator.dupe(u32, self.regex_set_of.items);
+    }
+
+    /// Add the literals every file the program yields for contains to the
+    /// string pool, as a `Prefilter`.
+    fn derivePrefilter(self: *Compiler, allocator: Allocator, source: ast.SourceFile) CompilerError!runtime.Prefilter {
+        var arena = std.heap.ArenaAllocator.init(self.allocator);
+        defer arena.deinit();
+        const clauses = try necessary_literals.derive(arena.allocator(), source, self.keywords);
+        if (clauses.len == 0) return .{};
+
+        var literal_count: usize = 0;
+        for (clauses) |clause| literal_count += clause.len;
+        const clause_ends = try allocator.alloc(u32, clauses.len);
+        errdefer allocator.free(clause_ends);
+        const literals = try allocator.alloc(runtime.StringId, literal_count);
+        errdefer allocator.free(literals);
+
+        var end: u32 = 0;
+        for (clauses, clause_ends) |clause, *clause_end| {
+            for (clause) |literal| {
+                literals[end] = try self.addStringConstant(literal);
+                end += 1;
+            }
+            clause_end.* = end;
+        }
+        return .{ .clause_ends = clause_ends, .literals = literals };
+    }
+
     /// Compilation of the with clause simply attaches binding metadata to each variable.
     fn compileWithClause(self: *Compiler, with_clause: ast.WithClause) CompilerError!void {
         for (with_clause.bindings) |binding| {
@@ -511,13 +703,13 @@ pub const Compiler = struct {
     ) CompilerError!void {
         if (comparison.right == .string_literal) {
             const var_id = try self.materializeAsVariable(comparison.left);
-            const owned_str = try self.addString(comparison.right.string_literal);
+            const string_id = try self.addStringConstant(comparison.right.string_literal);
 
             try self.navigateToVariable(var_id);
             try self.instruction_builder.emit(.{ .rel = .{
                 .relation = .equals,
                 .a = .{ .node = .text },
-                .b = .{ .literal = .{ .string = owned_str } },
+                .b = .{ .literal = .{ .string = string_id } },
             } });
 
             try self.instruction_builder.emitJump(success_label, .relates);
@@ -526,28 +718,21 @@ pub const Compiler = struct {
         }
 
         if (comparison.right == .regex_literal) {
+            const pattern = comparison.right.regex_literal;
+            const set = try self.regex_groups.?.setOf(comparison.left, pattern);
             const var_id = try self.materializeAsVariable(comparison.left);
             try self.navigateToVariable(var_id);
 
-            const regex = try pcre2.Regex.compile(comparison.right.regex_literal);
-            const regex_index = try self.addRegex(regex);
-
-            try self.instruction_builder.emit(.{ .rel = .{
-                .relation = .like,
-                .a = .{ .node = .text },
-                .b = .{ .literal = .{ .regex = self.regexes.items[regex_index] } },
-            } });
-
-            switch (comparison.operator) {
-                .regex_match => {
-                    try self.instruction_builder.emitJump(success_label, .relates);
-                    try self.instruction_builder.emitJump(failure_label, .always);
-                },
-                .regex_not_match => {
-                    try self.instruction_builder.emitJump(failure_label, .relates);
-                    try self.instruction_builder.emitJump(success_label, .always);
-                },
+            const matches_label, const misses_label = switch (comparison.operator) {
+                .regex_match => .{ success_label, failure_label },
+                .regex_not_match => .{ failure_label, success_label },
                 else => unreachable,
+            };
+            if (set) |set_id| {
+                // The set's scan does the literal checks.
+                try self.emitLike(try self.addRegexToSet(pattern, set_id), matches_label, misses_label);
+            } else {
+                try self.compileRegexMatch(pattern, matches_label, misses_label);
             }
             return;
         }
@@ -593,6 +778,69 @@ pub const Compiler = struct {
         try self.instruction_builder.emitJump(failure_label, .always);
     }
 
+    /// Test the current node's text against `pattern`. Patterns that reduce
+    /// to literal checks skip pcre2 entirely; others are guarded by a check
+    /// for a literal every match contains.
+    fn compileRegexMatch(
+        self: *Compiler,
+        pattern: []const u8,
+        matches_label: LabelId,
+        misses_label: LabelId,
+    ) CompilerError!void {
+        const reduction = try regex_literals.reduce(self.allocator, pattern);
+        defer reduction.deinit(self.allocator);
+
+        switch (reduction) {
+            .none => {},
+            .exact => |checks| {
+                // Still reject patterns pcre2 would.
+                var regex = try pcre2.Regex.compile(pattern);
+                regex.deinit();
+
+                try self.emitLiteralChecks(checks, matches_label);
+                try self.instruction_builder.emitJump(misses_label, .always);
+                return;
+            },
+            .prefilter => |checks| {
+                const regex_label = self.instruction_builder.createLabel();
+                try self.emitLiteralChecks(checks[0 .. checks.len - 1], regex_label);
+                const last = checks[checks.len - 1];
+                try self.emitLiteralCheck(last);
+                try self.instruction_builder.emitJump(misses_label, .not_relates);
+                try self.instruction_builder.markLabel(regex_label);
+            },
+        }
+
+        try self.emitLike(try self.addRegex(pattern), matches_label, misses_label);
+    }
+
+    fn emitLike(self: *Compiler, regex_index: runtime.RegexId, matches_label: LabelId, misses_label: LabelId) CompilerError!void {
+        try self.instruction_builder.emit(.{ .rel = .{
+            .relation = .like,
+            .a = .{ .node = .text },
+            .b = .{ .literal = .{ .regex = regex_index } },
+        } });
+        try self.instruction_builder.emitJump(matches_label, .relates);
+        try self.instruction_builder.emitJump(misses_label, .always);
+    }
+
+    /// Jump to `label` if any of `checks` relates, otherwise fall through.
+    fn emitLiteralChecks(self: *Compiler, checks: []const regex_literals.Check, label: LabelId) CompilerError!void {
+        for (checks) |check| {
+            try self.emitLiteralCheck(check);
+            try self.instruction_builder.emitJump(label, .relates);
+        }
+    }
+
+    fn emitLiteralCheck(self: *Compiler, check: regex_literals.Check) CompilerError!void {
+        const string_id = try self.addStringConstant(check.literal);
+        try self.instruction_builder.emit(.{ .rel = .{
+            .relation = check.relation,
+            .a = .{ .node = .text },
+            .b = .{ .literal = .{ .string = string_id } },
+        } });
+    }
+
     /// Return a `VariableId` whose binding plan has been emitted such that the
     /// variable holds the node(s) denoted by `expr`. If `expr` is already a
     /// `.variable`, the existing id is reused; otherwise an anonymous variable
@@ -634,9 +882,9 @@ pub const Compiler = struct {
                 }
             },
             .string_literal => |str| {
-                const owned_str = try self.addString(str);
+                const string_id = try self.addStringConstant(str);
                 return runtime.ValueSource{
-                    .literal = .{ .string = owned_str },
+                    .literal = .{ .string = string_id },
                 };
             },
             .number_literal => |number| runtime.ValueSource{
@@ -646,10 +894,9 @@ pub const Compiler = struct {
                 .literal = .{ .nothing = {} },
             },
             .regex_literal => |pattern| {
-                const regex = try pcre2.Regex.compile(pattern);
-                const regex_index = try self.addRegex(regex);
+                const regex_index = try self.addRegex(pattern);
                 return runtime.ValueSource{
-                    .literal = .{ .regex = self.regexes.items[regex_index] },
+                    .literal = .{ .regex = regex_index },
                 };
             },
             .field_access,
@@ -662,7 +909,15 @@ pub const Compiler = struct {
             },
             .parenthesized => |p| try self.valueOf(p.*),
             .object_literal => |obj| {
-                const FieldSource = struct { key: []const u8, source: runtime.ValueSource };
+                const FieldSource = struct {
+                    name: []const u8,
+                    key: runtime.StringId,
+                    source: runtime.ValueSource,
+
+                    fn lessThan(_: void, x: @This(), y: @This()) bool {
+                        return std.mem.order(u8, x.name, y.name) == .lt;
+                    }
+                };
                 var sources = try self.allocator.alloc(FieldSource, obj.fields.len);
                 defer self.allocator.free(sources);
 
@@ -673,22 +928,29 @@ pub const Compiler = struct {
                                 return error.InvalidVariableReference;
                             try self.forceBoundEvaluation(var_id);
                             sources[i] = .{
-                                .key = try self.addString(variable.name),
+                                .name = variable.name,
+                                .key = try self.addStringConstant(variable.name),
                                 .source = .{ .variable_id = var_id },
                             };
                         },
                         .key_value => |kv| {
                             const source = try self.valueOf(kv.value);
                             sources[i] = .{
-                                .key = try self.addString(kv.key),
+                                .name = kv.key,
+                                .key = try self.addStringConstant(kv.key),
                                 .source = source,
                             };
                         },
                     }
                 }
 
+                // Push fields in key order, so that records come out ready to
+                // serialize. The sort is stable; of repeated keys, the last
+                // one wins.
+                std.mem.sort(FieldSource, sources, {}, FieldSource.lessThan);
                 try self.instruction_builder.emit(.{ .begin_build = .record });
-                for (sources) |fs| {
+                for (sources, 0..) |fs, i| {
+                    if (i + 1 < sources.len and std.mem.eql(u8, fs.name, sources[i + 1].name)) continue;
                     try self.instruction_builder.emit(.{ .push_build = .{ .source = fs.source, .name = fs.key } });
                 }
                 const tmp = try self.scope_stack.allocateAnonymous();
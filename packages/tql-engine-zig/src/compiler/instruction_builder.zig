@@ -60,6 +60,35 @@ pub const InstructionBuilder = struct {
         try self.instructions.append(self.allocator, instruction);
     }
 
+    /// Fold a node kind check into the immediately preceding traversal, so
+    /// the runtime filters by kind inside the iterator. Returns false (and
+    /// emits nothing) if there is no such traversal or a label already
+    /// resolves to the current address, in which case the caller has to emit
+    /// the check itself.
+    pub fn fuseKindFilter(self: *InstructionBuilder, kind_id: NodeKindId) bool {
+        const items = self.instructions.items;
+        if (items.len == 0) return false;
+
+        const address = @as(Address, @intCast(items.len));
+        var resolved_iter = self.resolved_labels.valueIterator();
+        while (resolved_iter.next()) |resolved| {
+            if (resolved.* == address) return false;
+        }
+
+        const last = &items[items.len - 1];
+        const axis: runtime.Axis = switch (last.*) {
+            .trv => |trv_axis| switch (trv_axis) {
+                .child => .{ .child_of_kind = kind_id },
+                .descendant => .{ .descendant_of_kind = kind_id },
+                .field => |field_id| .{ .field_of_kind = .{ .field_id = field_id, .kind_id = kind_id } },
+                else => return false,
+            },
+            else => return false,
+        };
+        last.* = .{ .trv = axis };
+        return true;
+    }
+
     pub fn emitJump(self: *InstructionBuilder, label_id: u32, mode: Condition) Allocator.Error!void {
         const inst_index = self.instructions.items.len;
 
@@ -246,6 +275,43 @@ test "InstructionBuilder: multiple jumps to same label" {
     try testing.expectEqual(@as(runtime.Address, 4), instructions[2].jmp.address);
 }
 
+test "InstructionBuilder: fuseKindFilter folds into preceding traversal" {
+    var builder = InstructionBuilder.init(testing.allocator);
+    defer builder.deinit();
+
+    try builder.emit(.{ .trv = .{ .child = {} } });
+    try testing.expect(builder.fuseKindFilter(7));
+    try builder.emit(.{ .trv = .{ .field = 3 } });
+    try testing.expect(builder.fuseKindFilter(8));
+    // Already filtered; a second kind check can't be folded.
+    try testing.expect(!builder.fuseKindFilter(9));
+
+    const instructions = try builder.patch(testing.allocator);
+    defer testing.allocator.free(instructions);
+
+    try testing.expectEqual(@as(usize, 2), instructions.len);
+    try testing.expectEqual(@as(runtime.NodeKindId, 7), instructions[0].trv.child_of_kind);
+    try testing.expectEqual(@as(runtime.FieldId, 3), instructions[1].trv.field_of_kind.field_id);
+    try testing.expectEqual(@as(runtime.NodeKindId, 8), instructions[1].trv.field_of_kind.kind_id);
+}
+
+test "InstructionBuilder: fuseKindFilter respects labels" {
+    var builder = InstructionBuilder.init(testing.allocator);
+    defer builder.deinit();
+
+    const label = builder.createLabel();
+    try builder.emit(.{ .trv = .{ .descendant = {} } });
+    try builder.markLabel(label);
+
+    // Something may jump between the traversal and the check.
+    try testing.expect(!builder.fuseKindFilter(7));
+
+    const instructions = try builder.patch(testing.allocator);
+    defer testing.allocator.free(instructions);
+
+    try testing.expect(instructions[0].trv == .descendant);
+}
+
 test "InstructionBuilder: unresolved label returns error" {
     var builder = InstructionBuilder.init(testing.allocator);
     defer builder.deinit();
@@ -0,0 +1,427 @@
+//! Literals a file must contain for a query to yield anything from it.
+//!
+//! Follows the query the way the compiler lays it out and collects clauses
+//! of literals, each of which the file must contain at least one of:
+//! keywords of node kinds a result cannot do without, strings compared for
+//! equality, and literals every match of a regex contains. Parts of a query
+//! that can succeed without the file containing anything in particular,
+//! such as `not`, `all`, `is null` and subqueries, contribute nothing.
+//!
+//! Kind keywords come from the grammar, so they hold for trees as parsed.
+//! The exception is tree-sitter's error recovery, which can insert a
+//! missing keyword token into a node without it being in the text; results
+//! over such nodes are lost when the file is skipped. Callers that need them
+//! leave out the keywords (`Engine.Config.keyword_prefilter`).
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+const ast = @import("../ast.zig");
+const Prefilter = @import("../runtime.zig").Prefilter;
+const regex_literals = @import("regex_literals.zig");
+
+/// Literals of which a file must contain at least one.
+pub const Clause = []const []const u8;
+
+/// Clauses with more alternatives than this are unlikely to rule much out.
+const max_clause_len = 8;
+
+/// Clauses every file `source` yields anything for satisfies, at most
+/// `Prefilter.max_clauses` of them with `Prefilter.max_literals` literals
+/// among them. Empty when nothing is known. Allocated in `arena`; literals
+/// may point into `source` and `keywords`.
+pub fn derive(arena: Allocator, source: ast.SourceFile, keywords: []const u8) Allocator.Error![]const Clause {
+    var per_query: std.ArrayList([]const Clause) = .empty;
+    for (source.items) |item| {
+        const body = switch (item) {
+            .query => |query| query.body,
+            .query_body => |query_body| query_body,
+            .directive => continue,
+        };
+        var analysis: Analysis = .{ .arena = arena, .keywords = keywords };
+        try analysis.queryBody(body);
+        // This query alone can yield for any file.
+        if (analysis.clauses.items.len == 0) return &.{};
+        try per_query.append(arena, analysis.clauses.items);
+    }
+
+    if (per_query.items.len == 0) return &.{};
+    if (per_query.items.len == 1) return select(arena, per_query.items[0]);
+
+    // Every query yields on its own, so a file needs what any one of them
+    // needs.
+    var merged: std.ArrayList([]const u8) = .empty;
+    for (per_query.items) |clauses| try merged.appendSlice(arena, best(clauses));
+    return select(arena, &.{merged.items});
+}
+
+/// The longest keyword of `kind` in a table from `Language.keywords`.
+pub fn kindKeyword(keywords: []const u8, kind: []const u8) ?[]const u8 {
+    var lines = std.mem.splitScalar(u8, keywords, '\n');
+    while (lines.next()) |line| {
+        var words = std.mem.tokenizeScalar(u8, line, ' ');
+        const line_kind = words.next() orelse continue;
+        if (std.mem.eql(u8, line_kind, kind)) return words.next();
+    }
+    return null;
+}
+
+const Binding = struct {
+    name: []const u8,
+    /// Navigation to the bound nodes, if binding them requires any.
+    expression: ?ast.Expression,
+    /// Whether the compiler has already emitted the binding at this point,
+    /// so later references to it add nothing.
+    forced: bool = false,
+};
+
+const Analysis = struct {
+    arena: Allocator,
+    keywords: []const u8,
+    bindings: std.ArrayList(Binding) = .empty,
+    clauses: std.ArrayList(Clause) = .empty,
+
+    fn queryBody(self: *Analysis, body: ast.QueryBody) Allocator.Error!void {
+        if (body.with_clause) |with_clause| {
+            for (with_clause.bindings) |binding| {
+                try self.bindings.append(self.arena, .{
+                    .name = binding.variable.name,
+                    .expression = if (binding.optional) null else binding.expression,
+                });
+            }
+        }
+        if (body.where_clause) |where_clause| try self.predicate(where_clause.predicate);
+        try self.value(body.select_clause.projection);
+    }
+
+    fn predicate(self: *Analysis, pred: ast.Predicate) Allocator.Error!void {
+        switch (pred) {
+            .comparison => |comparison| {
+                switch (comparison.right) {
+                    .string_literal => |str| {
+                        try self.value(comparison.left);
+                        if (comparison.operator == .eq and str.len > 0) {
+                            try self.addClause(try self.arena.dupe([]const u8, &.{str}));
+                        }
+                    },
+                    .regex_literal => |pattern| {
+                        try self.value(comparison.left);
+                        if (comparison.operator == .regex_match) try self.regexMatch(pattern);
+                    },
+                    else => {
+                        try self.value(comparison.left);
+                        try self.value(comparison.right);
+                    },
+                }
+            },
+            .is_null => |is_null| {
+                try self.dependencies(is_null.expression);
+                if (is_null.negated) try self.navigation(is_null.expression);
+            },
+            .logical_and => |logical_and| {
+                try self.predicate(logical_and.left);
+                try self.predicate(logical_and.right);
+            },
+            .logical_or => |logical_or| {
+                const left = try self.alternative(logical_or.left);
+                const right = try self.alternative(logical_or.right);
+                if (left.len == 0 or right.len == 0) return;
+                try self.addClause(try std.mem.concat(self.arena, []const u8, &.{ best(left), best(right) }));
+            },
+            .logical_not => |logical_not| {
+                if (logical_not.predicate == .quantified) {
+                    try self.dependencies(logical_not.predicate.quantified.source);
+                }
+            },
+            .quantified => |quantified| {
+                try self.dependencies(quantified.source);
+                if (quantified.quantifier == .all) return;
+
+                // The probe only succeeds if some source node satisfies the
+                // body.
+                try self.navigation(quantified.source);
+                try self.bindings.append(self.arena, .{
+                    .name = quantified.variable.name,
+                    .expression = quantified.source,
+                    .forced = true,
+                });
+                defer _ = self.bindings.pop();
+                try self.predicate(quantified.predicate.*);
+            },
+            .parenthesized => |parenthesized| try self.predicate(parenthesized.*),
+        }
+    }
+
+    /// Clauses of one side of an `or`, leaving the analysis as it was.
+    fn alternative(self: *Analysis, pred: ast.Predicate) Allocator.Error![]const Clause {
+        const forced = try self.arena.alloc(bool, self.bindings.items.len);
+        for (forced, self.bindings.items) |*f, binding| f.* = binding.forced;
+        defer {
+            for (forced, self.bindings.items[0..forced.len]) |f, *binding| binding.forced = f;
+        }
+
+        const outer = self.clauses;
+        defer self.clauses = outer;
+        self.clauses = .empty;
+        try self.predicate(pred);
+        return self.clauses.items;
+    }
+
+    /// Like `Compiler.valueOf`: everything `expr` navigates to must exist.
+    fn value(self: *Analysis, expr: ast.Expression) Allocator.Error!void {
+        switch (expr) {
+            .variable, .node_selector, .field_access, .child_navigation, .descendant_navigation => {
+                try self.navigation(expr);
+            },
+            .parenthesized => |parenthesized| try self.value(parenthesized.*),
+            .object_literal => |object| for (object.fields) |field| switch (field) {
+                .variable => |variable| try self.force(variable.name),
+                .key_value => |kv| try self.value(kv.value),
+            },
+            .array_literal => |array| for (array.elements) |element| try self.value(element),
+            .tuple_literal => |tuple| for (tuple.elements) |element| try self.value(element),
+            .string_literal, .regex_literal, .number_literal, .null_literal => {},
+            // Aggregates, which yield even when empty.
+            .subquery, .function_call => {},
+        }
+    }
+
+    /// Like `Compiler.navigateTo`.
+    fn navigation(self: *Analysis, expr: ast.Expression) Allocator.Error!void {
+        switch (expr) {
+            .variable => |variable| try self.force(variable.name),
+            .node_selector => |node_selector| {
+                const keyword = kindKeyword(self.keywords, node_selector.node_type) orelse return;
+                try self.addClause(try self.arena.dupe([]const u8, &.{keyword}));
+            },
+            .field_access => |field_access| try self.navigation(field_access.base),
+            .child_navigation => |child_nav| {
+                try self.navigation(child_nav.parent);
+                try self.navigation(child_nav.child);
+            },
+            .descendant_navigation => |desc_nav| {
+                try self.navigation(desc_nav.parent);
+                try self.navigation(desc_nav.descendant);
+            },
+            .parenthesized => |parenthesized| try self.navigation(parenthesized.*),
+            else => {},
+        }
+    }
+
+    /// Like `Compiler.forceEvaluation`.
+    fn dependencies(self: *Analysis, expr: ast.Expression) Allocator.Error!void {
+        switch (expr) {
+            .variable => |variable| try self.force(variable.name),
+            .field_access => |field_access| try self.dependencies(field_access.base),
+            .child_navigation => |child_nav| try self.dependencies(child_nav.parent),
+            .descendant_navigation => |desc_nav| try self.dependencies(desc_nav.parent),
+            .parenthesized => |parenthesized| try self.dependencies(parenthesized.*),
+            else => {},
+        }
+    }
+
+    /// Like `Compiler.forceBoundEvaluation`.
+    fn force(self: *Analysis, name: []const u8) Allocator.Error!void {
+        var i = self.bindings.items.len;
+        while (i > 0) {
+            i -= 1;
+            const binding = &self.bindings.items[i];
+            if (!std.mem.eql(u8, binding.name, name)) continue;
+            if (binding.forced) return;
+            binding.forced = true;
+            const expression = binding.expression orelse return;
+            switch (expression) {
+                .variable,
+                .node_selector,
+                .field_access,
+                .child_navigation,
+                .descendant_navigation,
+                .parenthesized,
+                => try self.navigation(expression),
+                else => {},
+            }
+            return;
+        }
+    }
+
+    fn regexMatch(self: *Analysis, pattern: []const u8) Allocator.Error!void {
+        const checks = switch (try regex_literals.reduce(self.arena, pattern)) {
+            .none => return,
+            .exact, .prefilter => |checks| checks,
+        };
+        const literals = try self.arena.alloc([]const u8, checks.len);
+        for (literals, checks) |*literal, check| {
+            // Matches anything, e.g. /^$/ as a file-wide requirement.
+            if (check.literal.len == 0) return;
+            literal.* = check.literal;
+        }
+        try self.addClause(literals);
+    }
+
+    fn addClause(self: *Analysis, clause: Clause) Allocator.Error!void {
+        try self.clauses.append(self.arena, clause);
+    }
+};
+
+/// How selective a clause is likely to be: longer literals occur less.
+fn score(clause: Clause) usize {
+    var shortest: usize = std.math.maxInt(usize);
+    for (clause) |literal| shortest = @min(shortest, literal.len);
+    return shortest;
+}
+
+fn moreSelective(_: void, a: Clause, b: Clause) bool {
+    const score_a = score(a);
+    const score_b = score(b);
+    if (score_a != score_b) return score_a > score_b;
+    return a.len < b.len;
+}
+
+fn best(clauses: []const Clause) Clause {
+    var result = clauses[0];
+    for (clauses[1..]) |clause| {
+        if (moreSelective({}, clause, result)) result = clause;
+    }
+    return result;
+}
+
+/// Drop literals that contain another literal of the clause, since the
+/// shorter one is found wherever the longer one is.
+fn simplify(arena: Allocator, clause: Clause) Allocator.Error!Clause {
+    var kept: std.ArrayList([]const u8) = .empty;
+    for (clause, 0..) |literal, i| {
+        const implied = for (clause, 0..) |other, j| {
+            if (i == j) continue;
+            if (std.mem.indexOf(u8, literal, other) == null) continue;
+            // Of equal literals, keep the first.
+            if (other.len < literal.len or j < i) break true;
+        } else false;
+        if (!implied) try kept.append(arena, literal);
+    }
+    return kept.items;
+}
+
+fn clausesEqual(a: Clause, b: Clause) bool {
+    if (a.len != b.len) return false;
+    for (a, b) |literal_a, literal_b| {
+        if (!std.mem.eql(u8, literal_a, literal_b)) return false;
+    }
+    return true;
+}
+
+/// The most selective clauses within the `Prefilter` limits.
+fn select(arena: Allocator, clauses: []const Clause) Allocator.Error![]const Clause {
+    var candidates: std.ArrayList(Clause) = .empty;
+    for (clauses) |clause| {
+        const simplified = try simplify(arena, clause);
+        if (simplified.len > max_clause_len) continue;
+        const duplicate = for (candidates.items) |candidate| {
+            if (clausesEqual(candidate, simplified)) break true;
+        } else false;
+        if (!duplicate) try candidates.append(arena, simplified);
+    }
+    std.mem.sort(Clause, candidates.items, {}, moreSelective);
+
+    var literal_count: usize = 0;
+    var selected: std.ArrayList(Clause) = .empty;
+    for (candidates.items) |clause| {
+        if (selected.items.len == Prefilter.max_clauses) break;
+        if (literal_count + clause.len > Prefilter.max_literals) continue;
+        literal_count += clause.len;
+        try selected.append(arena, clause);
+    }
+    return selected.items;
+}
+
+const testing = std.testing;
+
+const test_keywords =
+    \\class_definition class
+    \\function_definition def
+    \\import_statement import
+    \\
+;
+
+fn expectClauses(query: []const u8, expected: []const []const []const u8) !void {
+    const Parser = @import("../parser.zig").Parser;
+
+    var parser = try Parser.init(testing.allocator);
+    defer parser.deinit();
+    const source = try parser.parse(query);
+    defer source.deinit(testing.allocator);
+
+    var arena = std.heap.ArenaAllocator.init(testing.allocator);
+    defer arena.deinit();
+    const clauses = try derive(arena.allocator(), source, test_keywords);
+
+    try testing.expectEqual(expected.len, clauses.len);
+    for (expected, clauses) |expected_clause, clause| {
+        try testing.expectEqual(expected_clause.len, clause.len);
+        for (expected_clause, clause) |expected_literal, literal| {
+            try testing.expectEqualStrings(expected_literal, literal);
+        }
+    }
+}
+
+test "kind keywords" {
+    try testing.expectEqualStrings("def", kindKeyword(test_keywords, "function_definition").?);
+    try testing.expectEqual(null, kindKeyword(test_keywords, "function"));
+    try testing.expectEqual(null, kindKeyword(test_keywords, "identifier"));
+}
+
+test "selected kinds and compared literals are required" {
+    try expectClauses("with @root > function_definition as @fn select @fn", &.{&.{"def"}});
+    try expectClauses(
+        \\with @root > class_definition as @c, @c.name as @n
+        \\where @n = 'Service'
+        \\select @c
+    , &.{ &.{"Service"}, &.{"class"} });
+    try expectClauses(
+        \\with @root > function_definition as @fn, @fn.name as @n
+        \\where @n ~ /^get_/
+        \\select @n
+    , &.{ &.{"get_"}, &.{"def"} });
+}
+
+test "unused bindings are not required" {
+    try expectClauses(
+        \\with @root > class_definition as @c, @root > function_definition as @fn
+        \\select @fn
+    , &.{&.{"def"}});
+}
+
+test "either side of an or will do" {
+    try expectClauses(
+        \\with @root > function_definition as @fn, @fn.name as @n
+        \\where @n = 'main' or @n ~ /^test/
+        \\select @fn
+    , &.{ &.{ "main", "test" }, &.{"def"} });
+    try expectClauses(
+        \\with @root > function_definition as @fn, @fn.name as @n
+        \\where @n = 'main' or @n != 'other'
+        \\select @n
+    , &.{&.{"def"}});
+}
+
+test "negations and unknown kinds require nothing" {
+    try expectClauses(
+        \\with @root > identifier as @id
+        \\where not @id = 'self'
+        \\select @id
+    , &.{});
+    try expectClauses(
+        \\with @root > identifier as @id
+        \\where @id !~ /self/
+        \\select @id
+    , &.{});
+}
+
+test "every query must agree" {
+    try expectClauses(
+        \\with @root > class_definition as @c select @c
+        \\with @root > import_statement as @i select @i
+    , &.{&.{ "class", "import" }});
+    try expectClauses(
+        \\with @root > class_definition as @c select @c
+        \\with @root > identifier as @i select @i
+    , &.{});
+}
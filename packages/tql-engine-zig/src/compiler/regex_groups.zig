@@ -0,0 +1,171 @@
+//! Grouping of the regexes a query matches against the same expression.
+//!
+//! `@n ~ /^get_/ or @n ~ /^set_/ or @n ~ /_impl$/` tests one node's text
+//! against three patterns. Grouped into a regex set, the runtime decides
+//! them together from a single scan of the text (see
+//! runtime/regex_set.zig). Expressions are compared by their s-expression,
+//! so the same variable name in different scopes shares a group; that only
+//! costs a scan that goes unused, never a wrong answer.
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+const ast = @import("../ast.zig");
+const RegexSet = @import("../runtime/regex_set.zig").RegexSet;
+
+pub const RegexGroups = struct {
+    arena: std.heap.ArenaAllocator,
+    /// Set of each expression matched against at least two patterns.
+    set_of: std.StringHashMapUnmanaged(u32) = .empty,
+    /// Distinct patterns of each set, at most `RegexSet.max_members`.
+    members: std.ArrayList([]const []const u8) = .empty,
+
+    /// Find the groups in `source`.
+    pub fn init(allocator: Allocator, source: ast.SourceFile) Allocator.Error!RegexGroups {
+        var self: RegexGroups = .{ .arena = std.heap.ArenaAllocator.init(allocator) };
+        errdefer self.arena.deinit();
+
+        var collector: Collector = .{ .arena = self.arena.allocator() };
+        for (source.items) |item| switch (item) {
+            .query => |query| try collector.queryBody(query.body),
+            .query_body => |body| try collector.queryBody(body),
+            .directive => {},
+        };
+
+        var it = collector.patterns.iterator();
+        while (it.next()) |entry| {
+            const patterns = entry.value_ptr.items;
+            if (patterns.len < 2) continue;
+            try self.set_of.put(self.arena.allocator(), entry.key_ptr.*, @intCast(self.members.items.len));
+            try self.members.append(self.arena.allocator(), patterns[0..@min(patterns.len, RegexSet.max_members)]);
+        }
+        return self;
+    }
+
+    pub fn deinit(self: *RegexGroups) void {
+        self.arena.deinit();
+    }
+
+    /// The set `left ~ pattern` is evaluated in, if any.
+    pub fn setOf(self: *RegexGroups, left: ast.Expression, pattern: []const u8) Allocator.Error!?u32 {
+        if (self.members.items.len == 0) return null;
+        const key = try keyOf(self.arena.allocator(), left);
+        const set = self.set_of.get(key) orelse return null;
+        for (self.members.items[set]) |member| {
+            if (std.mem.eql(u8, member, pattern)) return set;
+        }
+        return null;
+    }
+};
+
+fn keyOf(arena: Allocator, expr: ast.Expression) Allocator.Error![]const u8 {
+    const unwrapped = switch (expr) {
+        .parenthesized => |parenthesized| return keyOf(arena, parenthesized.*),
+        else => expr,
+    };
+    var writer: std.Io.Writer.Allocating = .init(arena);
+    unwrapped.sexpr(&writer.writer) catch return error.OutOfMemory;
+    return writer.written();
+}
+
+const Collector = struct {
+    arena: Allocator,
+    /// Distinct patterns matched against each expression, in order of
+    /// appearance.
+    patterns: std.StringArrayHashMapUnmanaged(std.ArrayList([]const u8)) = .empty,
+
+    fn queryBody(self: *Collector, body: ast.QueryBody) Allocator.Error!void {
+        if (body.with_clause) |with_clause| {
+            for (with_clause.bindings) |binding| try self.expression(binding.expression);
+        }
+        if (body.where_clause) |where_clause| try self.predicate(where_clause.predicate);
+        try self.expression(body.select_clause.projection);
+    }
+
+    fn predicate(self: *Collector, pred: ast.Predicate) Allocator.Error!void {
+        switch (pred) {
+            .comparison => |comparison| {
+                try self.expression(comparison.left);
+                switch (comparison.right) {
+                    .regex_literal => |pattern| try self.add(comparison.left, pattern),
+                    else => try self.expression(comparison.right),
+                }
+            },
+            .is_null => |is_null| try self.expression(is_null.expression),
+            .logical_and => |logical_and| {
+                try self.predicate(logical_and.left);
+                try self.predicate(logical_and.right);
+            },
+            .logical_or => |logical_or| {
+                try self.predicate(logical_or.left);
+                try self.predicate(logical_or.right);
+            },
+            .logical_not => |logical_not| try self.predicate(logical_not.predicate),
+            .quantified => |quantified| {
+                try self.expression(quantified.source);
+                try self.predicate(quantified.predicate.*);
+            },
+            .parenthesized => |parenthesized| try self.predicate(parenthesized.*),
+        }
+    }
+
+    /// Look for predicates in subqueries.
+    fn expression(self: *Collector, expr: ast.Expression) Allocator.Error!void {
+        switch (expr) {
+            .subquery => |subquery| try self.queryBody(subquery.*),
+            .parenthesized => |parenthesized| try self.expression(parenthesized.*),
+            .field_access => |field_access| try self.expression(field_access.base),
+            .child_navigation => |child_nav| {
+                try self.expression(child_nav.parent);
+                try self.expression(child_nav.child);
+            },
+            .descendant_navigation => |desc_nav| {
+                try self.expression(desc_nav.parent);
+                try self.expression(desc_nav.descendant);
+            },
+            .function_call => |call| for (call.arguments) |argument| try self.expression(argument),
+            .object_literal => |object| for (object.fields) |field| switch (field) {
+                .variable => {},
+                .key_value => |kv| try self.expression(kv.value),
+            },
+            .array_literal => |array| for (array.elements) |element| try self.expression(element),
+            .tuple_literal => |tuple| for (tuple.elements) |element| try self.expression(element),
+            .node_selector, .variable, .string_literal, .regex_literal, .number_literal, .null_literal => {},
+        }
+    }
+
+    fn add(self: *Collector, left: ast.Expression, pattern: []const u8) Allocator.Error!void {
+        const entry = try self.patterns.getOrPut(self.arena, try keyOf(self.arena, left));
+        if (!entry.found_existing) entry.value_ptr.* = .empty;
+        for (entry.value_ptr.items) |existing| {
+            if (std.mem.eql(u8, existing, pattern)) return;
+        }
+        try entry.value_ptr.append(self.arena, pattern);
+    }
+};
+
+const testing = std.testing;
+const Parser = @import("../parser.zig").Parser;
+
+test "regexes on the same expression are grouped" {
+    const query =
+        \\with @root > function_definition as @f, @f.name as @n
+        \\where (@n ~ /^get_/ or @n ~ /^set_/ or @n !~ /^get_/)
+        \\  and @f.body ~ /return/
+        \\  and any @c in @f >> call: @c.function ~ /^print$/ or @c.function ~ /^log/
+        \\select @f
+    ;
+    var parser = try Parser.init(testing.allocator);
+    defer parser.deinit();
+    const source = try parser.parse(query);
+    defer source.deinit(testing.allocator);
+
+    var groups = try RegexGroups.init(testing.allocator, source);
+    defer groups.deinit();
+
+    try testing.expectEqual(2, groups.members.items.len);
+    const n: ast.Expression = .{ .variable = .{ .name = "n" } };
+    const set = (try groups.setOf(n, "^set_")).?;
+    try testing.expectEqual(set, (try groups.setOf(n, "^get_")).?);
+    try testing.expectEqual(2, groups.members.items[set].len);
+    try testing.expectEqual(null, try groups.setOf(n, "return"));
+}
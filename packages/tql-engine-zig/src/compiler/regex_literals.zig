@@ -0,0 +1,458 @@
+//! Literal analysis of regex patterns.
+//!
+//! Many patterns in queries are anchored literals or small alternations of
+//! them, which a byte comparison decides without pcre2. `reduce` recognises
+//! those and returns the equivalent literal checks. For other patterns it
+//! looks for literals that every match must contain, so that `like` can
+//! reject most subjects before reaching the regex engine.
+//!
+//! Only a conservative subset of pcre2 syntax is understood. Anything else,
+//! such as inline options or lookarounds, gives up on the whole pattern.
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+const runtime = @import("../runtime.zig");
+const Relation = runtime.Relation;
+
+/// Upper bound on the checks a pattern is reduced to. Past this, pcre2's own
+/// start-of-match optimizations are likely to do as well.
+const max_checks = 8;
+/// Required literals shorter than this are left to pcre2, which already
+/// searches for a first and last code unit.
+const min_required_len = 2;
+
+/// A literal relation against the subject: `subject <relation> literal`.
+pub const Check = struct {
+    relation: Relation,
+    literal: []const u8,
+};
+
+pub const Reduction = union(enum) {
+    /// Nothing is known; run the regex.
+    none,
+    /// The pattern matches exactly when one of the checks relates.
+    exact: []const Check,
+    /// The pattern can only match when one of the checks relates.
+    prefilter: []const Check,
+
+    pub fn deinit(self: Reduction, allocator: Allocator) void {
+        switch (self) {
+            .none => {},
+            .exact, .prefilter => |checks| {
+                for (checks) |check| allocator.free(check.literal);
+                allocator.free(checks);
+            },
+        }
+    }
+};
+
+const Quantifier = enum {
+    one,
+    /// `?`, `*`: the atom may be absent.
+    optional,
+    /// `+`: the atom occurs at least once.
+    plus,
+};
+
+const Atom = union(enum) {
+    literal: u8,
+    /// `.`
+    dot,
+    /// `^`
+    start,
+    /// `$`
+    end,
+    /// `|`
+    bar,
+    /// `(` or `(?:`
+    open,
+    /// `)`
+    close,
+    /// Anything else: classes, escapes, zero-width assertions.
+    other,
+};
+
+const Token = struct {
+    atom: Atom,
+    quantifier: Quantifier = .one,
+};
+
+const Unsupported = error{Unsupported};
+
+/// Reduce `pattern` to literal checks. Caller owns the result.
+pub fn reduce(allocator: Allocator, pattern: []const u8) Allocator.Error!Reduction {
+    var tokens: std.ArrayList(Token) = .empty;
+    defer tokens.deinit(allocator);
+    tokenize(allocator, pattern, &tokens) catch |err| switch (err) {
+        error.Unsupported => return .none,
+        error.OutOfMemory => |e| return e,
+    };
+    return analyze(allocator, tokens.items);
+}
+
+fn tokenize(allocator: Allocator, pattern: []const u8, tokens: *std.ArrayList(Token)) (Allocator.Error || Unsupported)!void {
+    var i: usize = 0;
+    while (i < pattern.len) {
+        const c = pattern[i];
+        i += 1;
+        const atom: Atom = switch (c) {
+            '^' => .start,
+            '$' => .end,
+            '|' => .bar,
+            '.' => .dot,
+            ')' => .close,
+            '(' => blk: {
+                if (i < pattern.len and (pattern[i] == '?' or pattern[i] == '*')) {
+                    // Only plain non-capturing groups; options, lookarounds
+                    // and verbs change what the rest of the pattern means.
+                    if (!std.mem.startsWith(u8, pattern[i..], "?:")) return error.Unsupported;
+                    i += 2;
+                }
+                break :blk .open;
+            },
+            '[' => blk: {
+                i = try skipClass(pattern, i);
+                break :blk .other;
+            },
+            '\\' => blk: {
+                if (i == pattern.len) return error.Unsupported;
+                const e = pattern[i];
+                i += 1;
+                break :blk switch (e) {
+                    'n' => .{ .literal = '\n' },
+                    't' => .{ .literal = '\t' },
+                    'r' => .{ .literal = '\r' },
+                    'f' => .{ .literal = 0x0c },
+                    'e' => .{ .literal = 0x1b },
+                    'a' => .{ .literal = 0x07 },
+                    'd', 'D', 'w', 'W', 's', 'S', 'h', 'H', 'v', 'V', 'R', 'X' => .other,
+                    'b', 'B', 'A', 'z', 'Z', 'G', 'K' => .other,
+                    'N' => if (i < pattern.len and pattern[i] == '{') return error.Unsupported else .other,
+                    else => if (std.ascii.isAlphanumeric(e)) return error.Unsupported else .{ .literal = e },
+                };
+            },
+            // A quantifier with nothing to apply to, or a counted one.
+            '?', '*', '+', '{' => return error.Unsupported,
+            else => .{ .literal = c },
+        };
+
+        var token: Token = .{ .atom = atom };
+        if (i < pattern.len) {
+            switch (pattern[i]) {
+                '?', '*' => token.quantifier = .optional,
+                '+' => token.quantifier = .plus,
+                '{' => return error.Unsupported,
+                else => {},
+            }
+            if (token.quantifier != .one) {
+                i += 1;
+                // Lazy forms match the same subjects. Possessive ones don't:
+                // `.*+foo` never matches, as `.*+` gives nothing back.
+                if (i < pattern.len and pattern[i] == '+') return error.Unsupported;
+                if (i < pattern.len and pattern[i] == '?') i += 1;
+                if (i < pattern.len and (pattern[i] == '?' or pattern[i] == '*' or pattern[i] == '+' or pattern[i] == '{'))
+                    return error.Unsupported;
+            }
+        }
+        try tokens.append(allocator, token);
+    }
+}
+
+/// Return the index just past the class that starts before `start`.
+fn skipClass(pattern: []const u8, start: usize) Unsupported!usize {
+    var i = start;
+    if (i < pattern.len and pattern[i] == '^') i += 1;
+    // A leading `]` is a literal member.
+    if (i < pattern.len and pattern[i] == ']') i += 1;
+    while (i < pattern.len) {
+        switch (pattern[i]) {
+            ']' => return i + 1,
+            '\\' => i += 2,
+            '[' => if (i + 1 < pattern.len and pattern[i + 1] == ':') {
+                const close = std.mem.indexOfPos(u8, pattern, i + 2, ":]") orelse return error.Unsupported;
+                i = close + 2;
+            } else {
+                i += 1;
+            },
+            else => i += 1,
+        }
+    }
+    return error.Unsupported;
+}
+
+fn analyze(allocator: Allocator, all_tokens: []const Token) Allocator.Error!Reduction {
+    var tokens = all_tokens;
+    var depth: usize = 0;
+    for (tokens) |token| switch (token.atom) {
+        .open => depth += 1,
+        .close => depth = std.math.sub(usize, depth, 1) catch return .none,
+        // Top-level alternation: no literal is common to every branch.
+        .bar => if (depth == 0) return .none,
+        else => {},
+    };
+    if (depth != 0) return .none;
+
+    const anchored = tokens.len > 0 and isBare(tokens[0], .start);
+    if (anchored) tokens = tokens[1..];
+    const ends = tokens.len > 0 and isBare(tokens[tokens.len - 1], .end);
+    if (ends) tokens = tokens[0 .. tokens.len - 1];
+
+    // `.*` at an unanchored end can match nothing, so it never decides.
+    if (!anchored) {
+        while (tokens.len > 0 and isDotStar(tokens[0])) tokens = tokens[1..];
+    }
+    if (!ends) {
+        while (tokens.len > 0 and isDotStar(tokens[tokens.len - 1])) tokens = tokens[0 .. tokens.len - 1];
+    }
+
+    var head = try Head.parse(allocator, tokens);
+    defer head.deinit(allocator);
+
+    // `x+` matches whatever starts with or contains `x`, but not whatever
+    // ends with it.
+    if (head.len == tokens.len and !(head.repeats and ends)) {
+        const relations: []const Relation = if (anchored and ends)
+            &.{ .equals, .equals }
+        else if (anchored)
+            &.{.starts_with}
+        else if (ends)
+            &.{ .ends_with, .ends_with }
+        else
+            &.{.contains};
+        if (head.alternatives.items.len * relations.len <= max_checks) {
+            return .{ .exact = try head.checks(allocator, relations) };
+        }
+    }
+
+    if (anchored and head.alternatives.items.len > 0 and
+        head.alternatives.items.len <= max_checks and head.minLen() > 0)
+    {
+        return .{ .prefilter = try head.checks(allocator, &.{.starts_with}) };
+    }
+
+    const run = try requiredLiteral(allocator, tokens);
+    if (run.len < min_required_len) {
+        allocator.free(run);
+        return .none;
+    }
+    errdefer allocator.free(run);
+    const checks = try allocator.alloc(Check, 1);
+    checks[0] = .{ .relation = .contains, .literal = run };
+    return .{ .prefilter = checks };
+}
+
+fn isBare(token: Token, atom: std.meta.Tag(Atom)) bool {
+    return token.atom == atom and token.quantifier == .one;
+}
+
+fn isDotStar(token: Token) bool {
+    return token.atom == .dot and token.quantifier == .optional;
+}
+
+/// The literal alternatives a pattern begins with: a run of literals, or a
+/// group of literal alternatives followed by a run of literals.
+const Head = struct {
+    alternatives: std.ArrayList(std.ArrayList(u8)) = .empty,
+    /// Number of tokens consumed.
+    len: usize = 0,
+    /// Whether the last literal or group consumed is repeated with `+`, so
+    /// the alternatives are only a prefix of what it matches.
+    repeats: bool = false,
+
+    fn parse(allocator: Allocator, tokens: []const Token) Allocator.Error!Head {
+        var head: Head = .{};
+        errdefer head.deinit(allocator);
+        try head.alternatives.append(allocator, .empty);
+
+        var i: usize = 0;
+        if (tokens.len > 0 and tokens[0].atom == .open) {
+            const group = groupAlternatives(tokens) orelse return head;
+
+            head.alternatives.clearRetainingCapacity();
+            var current: std.ArrayList(u8) = .empty;
+            errdefer current.deinit(allocator);
+            for (tokens[1..group]) |token| switch (token.atom) {
+                .literal => |byte| try current.append(allocator, byte),
+                .bar => {
+                    try head.alternatives.append(allocator, current);
+                    current = .empty;
+                },
+                else => unreachable,
+            };
+            try head.alternatives.append(allocator, current);
+            current = .empty;
+
+            i = group + 1;
+            head.len = i;
+            if (tokens[group].quantifier == .plus) {
+                head.repeats = true;
+                return head;
+            }
+        }
+
+        while (i < tokens.len) : (i += 1) {
+            const token = tokens[i];
+            const byte = switch (token.atom) {
+                .literal => |byte| byte,
+                else => break,
+            };
+            if (token.quantifier == .optional) break;
+            for (head.alternatives.items) |*alternative| try alternative.append(allocator, byte);
+            head.len = i + 1;
+            if (token.quantifier == .plus) {
+                head.repeats = true;
+                break;
+            }
+        }
+        return head;
+    }
+
+    fn deinit(self: *Head, allocator: Allocator) void {
+        for (self.alternatives.items) |*alternative| alternative.deinit(allocator);
+        self.alternatives.deinit(allocator);
+    }
+
+    fn minLen(self: Head) usize {
+        var min: usize = std.math.maxInt(usize);
+        for (self.alternatives.items) |alternative| min = @min(min, alternative.items.len);
+        return min;
+    }
+
+    /// One check per alternative and relation. A second relation of the same
+    /// kind checks the alternative followed by a newline, which `$` also
+    /// accepts.
+    fn checks(self: Head, allocator: Allocator, relations: []const Relation) Allocator.Error![]const Check {
+        var list: std.ArrayList(Check) = .empty;
+        errdefer {
+            for (list.items) |check| allocator.free(check.literal);
+            list.deinit(allocator);
+        }
+        for (self.alternatives.items) |alternative| {
+            for (relations, 0..) |relation, i| {
+                const literal = if (i == 0)
+                    try allocator.dupe(u8, alternative.items)
+                else
+                    try std.mem.concat(allocator, u8, &.{ alternative.items, "\n" });
+                errdefer allocator.free(literal);
+                try list.append(allocator, .{ .relation = relation, .literal = literal });
+            }
+        }
+        return list.toOwnedSlice(allocator);
+    }
+};
+
+/// If `tokens` begins with a group of bare literal alternatives that must
+/// occur, return the index of its closing token.
+fn groupAlternatives(tokens: []const Token) ?usize {
+    for (tokens[1..], 1..) |token, i| switch (token.atom) {
+        .literal => if (token.quantifier != .one) return null,
+        .bar => {},
+        .close => return if (token.quantifier == .optional) null else i,
+        else => return null,
+    };
+    return null;
+}
+
+/// The longest run of literals outside groups that every match contains.
+/// Caller owns the result.
+fn requiredLiteral(allocator: Allocator, tokens: []const Token) Allocator.Error![]u8 {
+    var best: []const Token = &.{};
+    var start: usize = 0;
+    var depth: usize = 0;
+    for (tokens, 0..) |token, i| {
+        const extends = depth == 0 and token.atom == .literal and token.quantifier != .optional;
+        switch (token.atom) {
+            .open => depth += 1,
+            .close => depth -= 1,
+            else => {},
+        }
+        if (!extends) {
+            start = i + 1;
+            continue;
+        }
+        if (i + 1 - start > best.len) best = tokens[start .. i + 1];
+        // The repetition of `x+` is not part of the run that follows.
+        if (token.quantifier == .plus) start = i + 1;
+    }
+
+    const run = try allocator.alloc(u8, best.len);
+    for (run, best) |*byte, token| byte.* = token.atom.literal;
+    return run;
+}
+
+const testing = std.testing;
+
+fn expectReduction(pattern: []const u8, expected: Reduction) !void {
+    const reduction = try reduce(testing.allocator, pattern);
+    defer reduction.deinit(testing.allocator);
+
+    try testing.expectEqual(std.meta.activeTag(expected), std.meta.activeTag(reduction));
+    const expected_checks, const checks = switch (expected) {
+        .none => return,
+        .exact => |e| .{ e, reduction.exact },
+        .prefilter => |e| .{ e, reduction.prefilter },
+    };
+    try testing.expectEqual(expected_checks.len, checks.len);
+    for (expected_checks, checks) |e, check| {
+        try testing.expectEqual(e.relation, check.relation);
+        try testing.expectEqualStrings(e.literal, check.literal);
+    }
+}
+
+test "pure literals reduce exactly" {
+    try expectReduction("Service", .{ .exact = &.{.{ .relation = .contains, .literal = "Service" }} });
+    try expectReduction("^kmalloc", .{ .exact = &.{.{ .relation = .starts_with, .literal = "kmalloc" }} });
+    try expectReduction("^foo.*", .{ .exact = &.{.{ .relation = .starts_with, .literal = "foo" }} });
+    try expectReduction("fo+", .{ .exact = &.{.{ .relation = .contains, .literal = "fo" }} });
+    try expectReduction("_t$", .{ .exact = &.{
+        .{ .relation = .ends_with, .literal = "_t" },
+        .{ .relation = .ends_with, .literal = "_t\n" },
+    } });
+    try expectReduction("^a\\.b$", .{ .exact = &.{
+        .{ .relation = .equals, .literal = "a.b" },
+        .{ .relation = .equals, .literal = "a.b\n" },
+    } });
+}
+
+test "literal alternations reduce exactly" {
+    try expectReduction("^(err|out)_", .{ .exact = &.{
+        .{ .relation = .starts_with, .literal = "err_" },
+        .{ .relation = .starts_with, .literal = "out_" },
+    } });
+    try expectReduction("^(?:get|set)$", .{ .exact = &.{
+        .{ .relation = .equals, .literal = "get" },
+        .{ .relation = .equals, .literal = "get\n" },
+        .{ .relation = .equals, .literal = "set" },
+        .{ .relation = .equals, .literal = "set\n" },
+    } });
+}
+
+test "anchored prefixes prefilter" {
+    try expectReduction("^(err|out)(_\\w+)?$", .{ .prefilter = &.{
+        .{ .relation = .starts_with, .literal = "err" },
+        .{ .relation = .starts_with, .literal = "out" },
+    } });
+    try expectReduction("^ma(in)?$", .{ .prefilter = &.{.{ .relation = .starts_with, .literal = "ma" }} });
+    try expectReduction("^fo+bar", .{ .prefilter = &.{.{ .relation = .starts_with, .literal = "fo" }} });
+}
+
+test "required literals prefilter" {
+    try expectReduction("[a-z]+_alloc\\d", .{ .prefilter = &.{.{ .relation = .contains, .literal = "_alloc" }} });
+    try expectReduction("x(ab|cd)yz", .{ .prefilter = &.{.{ .relation = .contains, .literal = "yz" }} });
+    try expectReduction("abc?de", .{ .prefilter = &.{.{ .relation = .contains, .literal = "ab" }} });
+    // Not exact, since `o+` runs past what `$` would anchor.
+    try expectReduction("fo+$", .{ .prefilter = &.{.{ .relation = .contains, .literal = "fo" }} });
+}
+
+test "unsupported patterns are left to pcre2" {
+    try expectReduction("[A-Z][a-z]+", .none);
+    try expectReduction("foo|bar", .none);
+    try expectReduction("(?i)foo", .none);
+    try expectReduction("foo(?=bar)", .none);
+    try expectReduction("a{2}bc", .none);
+    try expectReduction("^(err|out)?x", .none);
+    try expectReduction("\\x41bc", .none);
+    try expectReduction(".*+foo", .none);
+    try expectReduction("a?+a", .none);
+    try expectReduction("a++a", .none);
+}
@@ -1,20 +1,35 @@
 const overlay_map = @import("ds/overlay_map.zig");
+const slot_map = @import("ds/slot_map.zig");
 const rc = @import("ds/rc.zig");
+const slab_allocator = @import("ds/slab_allocator.zig");
 const ring_buffer = @import("ds/ring_buffer.zig");
 const thread_safe = @import("ds/thread_safe.zig");
 const blocking_queue = @import("ds/blocking_queue.zig");
+const aho_corasick = @import("ds/aho_corasick.zig");
+const work_stealing_queue = @import("ds/work_stealing_queue.zig");
+const priority_buffer = @import("ds/priority_buffer.zig");
 
 pub const OverlayMap = overlay_map.OverlayMap;
+pub const SlotMap = slot_map.SlotMap;
 pub const Rc = rc.Rc;
+pub const SlabAllocator = slab_allocator.SlabAllocator;
 pub const RingBuffer = ring_buffer.RingBuffer;
 pub const ThreadSafe = thread_safe.ThreadSafe;
 pub const BlockingQueue = blocking_queue.BlockingQueue;
+pub const AhoCorasick = aho_corasick.AhoCorasick;
+pub const WorkStealingQueue = work_stealing_queue.WorkStealingQueue;
+pub const PriorityBuffer = priority_buffer.PriorityBuffer;
 
 test {
     const refAllDecls = @import("std").testing.refAllDecls;
     refAllDecls(overlay_map);
+    refAllDecls(slot_map);
     refAllDecls(rc);
+    refAllDecls(slab_allocator);
     refAllDecls(ring_buffer);
     refAllDecls(thread_safe);
     refAllDecls(blocking_queue);
+    refAllDecls(aho_corasick);
+    refAllDecls(work_stealing_queue);
+    refAllDecls(priority_buffer);
 }
@@ -0,0 +1,237 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+/// Finds every occurrence of a set of byte strings in one pass over a
+/// haystack. The automaton is a full DFA over byte classes: bytes that occur
+/// in no pattern share a class, which keeps the transition table small for
+/// the short literal sets it is built from.
+pub const AhoCorasick = struct {
+    const Self = @This();
+
+    pub const State = u16;
+    /// Patterns longer than the states allow in total are rejected.
+    pub const max_states = std.math.maxInt(State);
+
+    pub const Match = struct {
+        pattern: u32,
+        /// One past the last byte of the occurrence.
+        end: usize,
+    };
+
+    allocator: Allocator,
+    /// Class of each byte value. Class 0 is every byte no pattern contains.
+    classes: [256]u16,
+    class_count: usize,
+    /// `transitions[state * class_count + class]` is the next state.
+    transitions: []State,
+    /// Patterns ending at each state, including those of its suffix states,
+    /// as ranges of `outputs`: `outputs[output_ends[s]..output_ends[s + 1]]`.
+    output_ends: []u32,
+    outputs: []u32,
+
+    /// Build the automaton for `patterns`, which must be non-empty. Pattern
+    /// ids are their indices; identical patterns each report their own.
+    pub fn init(allocator: Allocator, patterns: []const []const u8) !Self {
+        var classes: [256]u16 = @splat(0);
+        var class_count: usize = 1;
+        var state_count: usize = 1;
+        for (patterns) |pattern| {
+            std.debug.assert(pattern.len > 0);
+            state_count += pattern.len;
+            for (pattern) |byte| {
+                if (classes[byte] != 0) continue;
+                classes[byte] = @intCast(class_count);
+                class_count += 1;
+            }
+        }
+        if (state_count > max_states) return error.TooManyStates;
+
+        var transitions: std.ArrayList(State) = .empty;
+        defer transitions.deinit(allocator);
+        try transitions.appendNTimes(allocator, 0, class_count);
+        // Pattern ending at each trie state, or null.
+        var terminal: std.ArrayList(?u32) = .empty;
+        defer terminal.deinit(allocator);
+        try terminal.append(allocator, null);
+        // The next pattern identical to each, or null.
+        const duplicate = try allocator.alloc(?u32, patterns.len);
+        defer allocator.free(duplicate);
+        @memset(duplicate, null);
+
+        // The trie. 0 doubles as "no edge" since nothing leads back to the
+        // root.
+        for (patterns, 0..) |pattern, id| {
+            var state: usize = 0;
+            for (pattern) |byte| {
+                const slot = state * class_count + classes[byte];
+                if (transitions.items[slot] == 0) {
+                    transitions.items[slot] = @intCast(terminal.items.len);
+                    try transitions.appendNTimes(allocator, 0, class_count);
+                    try terminal.append(allocator, null);
+                }
+                state = transitions.items[slot];
+            }
+            if (terminal.items[state]) |first| {
+                var last = first;
+                while (duplicate[last]) |next| last = next;
+                duplicate[last] = @intCast(id);
+            } else terminal.items[state] = @intCast(id);
+        }
+        const states = terminal.items.len;
+
+        // Breadth first, so a state's failure state is complete before it
+        // is needed: fill in missing edges from the failure state and
+        // inherit its outputs.
+        const fail = try allocator.alloc(State, states);
+        defer allocator.free(fail);
+        const order = try allocator.alloc(State, states);
+        defer allocator.free(order);
+        fail[0] = 0;
+        order[0] = 0;
+        var queued: usize = 1;
+        for (0..states) |i| {
+            const state = order[i];
+            const row = transitions.items[@as(usize, state) * class_count ..][0..class_count];
+            const fail_row = transitions.items[@as(usize, fail[state]) * class_count ..][0..class_count];
+            for (row, fail_row) |*next, fail_next| {
+                if (next.* == 0) {
+                    if (state != 0) next.* = fail_next;
+                    continue;
+                }
+                fail[next.*] = if (state == 0) 0 else fail_next;
+                order[queued] = next.*;
+                queued += 1;
+            }
+        }
+
+        const output_ends = try allocator.alloc(u32, states + 1);
+        errdefer allocator.free(output_ends);
+        var outputs: std.ArrayList(u32) = .empty;
+        errdefer outputs.deinit(allocator);
+        // Outputs are laid out in state order, so walk the failure chain
+        // rather than copying from the failure state.
+        output_ends[0] = 0;
+        for (0..states) |state| {
+            var s: State = @intCast(state);
+            while (s != 0) : (s = fail[s]) {
+                var id = terminal.items[s];
+                while (id) |i| : (id = duplicate[i]) try outputs.append(allocator, i);
+            }
+            output_ends[state + 1] = @intCast(outputs.items.len);
+        }
+
+        const owned_transitions = try transitions.toOwnedSlice(allocator);
+        errdefer allocator.free(owned_transitions);
+        return .{
+            .allocator = allocator,
+            .classes = classes,
+            .class_count = class_count,
+            .transitions = owned_transitions,
+            .output_ends = output_ends,
+            .outputs = try outputs.toOwnedSlice(allocator),
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.allocator.free(self.transitions);
+        self.allocator.free(self.output_ends);
+        self.allocator.free(self.outputs);
+    }
+
+    /// Every occurrence, overlapping ones included, in order of their end.
+    pub fn iterator(self: *const Self, haystack: []const u8) Iterator {
+        return .{ .automaton = self, .haystack = haystack };
+    }
+
+    pub const Iterator = struct {
+        automaton: *const Self,
+        haystack: []const u8,
+        pos: usize = 0,
+        state: State = 0,
+        /// Outputs of `state` not yet returned.
+        output: u32 = 0,
+        output_end: u32 = 0,
+
+        pub fn next(self: *Iterator) ?Match {
+            const ac = self.automaton;
+            while (self.output == self.output_end) {
+                if (self.pos == self.haystack.len) return null;
+                const class = ac.classes[self.haystack[self.pos]];
+                self.state = ac.transitions[@as(usize, self.state) * ac.class_count + class];
+                self.pos += 1;
+                self.output = ac.output_ends[self.state];
+                self.output_end = ac.output_ends[@as(usize, self.state) + 1];
+            }
+            defer self.output += 1;
+            return .{ .pattern = ac.outputs[self.output], .end = self.pos };
+        }
+    };
+};
+
+const testing = std.testing;
+
+fn expectMatches(patterns: []const []const u8, haystack: []const u8, expected: []const AhoCorasick.Match) !void {
+    var ac = try AhoCorasick.init(testing.allocator, patterns);
+    defer ac.deinit();
+
+    var actual: std.ArrayList(AhoCorasick.Match) = .empty;
+    defer actual.deinit(testing.allocator);
+    var it = ac.iterator(haystack);
+    while (it.next()) |match| try actual.append(testing.allocator, match);
+
+    try testing.expectEqualSlices(AhoCorasick.Match, expected, actual.items);
+}
+
+test "aho-corasick finds overlapping occurrences" {
+    try expectMatches(&.{ "he", "she", "his", "hers" }, "ushers", &.{
+        .{ .pattern = 1, .end = 4 },
+        .{ .pattern = 0, .end = 4 },
+        .{ .pattern = 3, .end = 6 },
+    });
+}
+
+test "aho-corasick repeated and adjacent occurrences" {
+    try expectMatches(&.{ "aa", "a" }, "aaa", &.{
+        .{ .pattern = 1, .end = 1 },
+        .{ .pattern = 0, .end = 2 },
+        .{ .pattern = 1, .end = 2 },
+        .{ .pattern = 0, .end = 3 },
+        .{ .pattern = 1, .end = 3 },
+    });
+    try expectMatches(&.{"get_"}, "get_get", &.{.{ .pattern = 0, .end = 4 }});
+    try expectMatches(&.{"x"}, "", &.{});
+}
+
+test "aho-corasick reports every copy of a pattern" {
+    try expectMatches(&.{ "ab", "b", "ab", "ab" }, "ab", &.{
+        .{ .pattern = 0, .end = 2 },
+        .{ .pattern = 2, .end = 2 },
+        .{ .pattern = 3, .end = 2 },
+        .{ .pattern = 1, .end = 2 },
+    });
+}
+
+test "aho-corasick agrees with a naive search" {
+    const patterns = [_][]const u8{ "ab", "bab", "abba", "b", "bb", "aab" };
+    var ac = try AhoCorasick.init(testing.allocator, &patterns);
+    defer ac.deinit();
+
+    var prng = std.Random.DefaultPrng.init(0);
+    const random = prng.random();
+    var haystack: [64]u8 = undefined;
+    for (0..100) |_| {
+        for (&haystack) |*byte| byte.* = "abc"[random.uintLessThan(u8, 3)];
+
+        var found: [patterns.len][haystack.len + 1]bool = @splat(@splat(false));
+        var it = ac.iterator(&haystack);
+        while (it.next()) |match| found[match.pattern][match.end] = true;
+
+        for (patterns, 0..) |pattern, id| {
+            for (0..haystack.len + 1) |end| {
+                const expected = end >= pattern.len and
+                    std.mem.eql(u8, haystack[end - pattern.len .. end], pattern);
+                try testing.expectEqual(expected, found[id][end]);
+            }
+        }
+    }
+}
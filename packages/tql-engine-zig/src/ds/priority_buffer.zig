@@ -0,0 +1,118 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+/// Holds up to a fixed number of items and lets them go in priority order:
+/// the item that `before` ranks first leaves first. Pushing to a full buffer
+/// releases its first item (or the new one, if that ranks first), so a
+/// stream passed through the buffer comes out sorted as far as the
+/// buffer's window allows. A binary heap in a fixed array.
+pub fn PriorityBuffer(comptime T: type, comptime before: fn (a: T, b: T) bool) type {
+    return struct {
+        const Self = @This();
+
+        items: []T,
+        len: usize = 0,
+
+        pub fn init(allocator: Allocator, capacity: usize) !Self {
+            std.debug.assert(capacity > 0);
+            return .{ .items = try allocator.alloc(T, capacity) };
+        }
+
+        pub fn deinit(self: *Self, allocator: Allocator) void {
+            allocator.free(self.items);
+        }
+
+        /// Add `item`. When the buffer is full, returns the item that has to
+        /// make room.
+        pub fn push(self: *Self, item: T) ?T {
+            if (self.len < self.items.len) {
+                self.items[self.len] = item;
+                self.len += 1;
+                self.siftUp(self.len - 1);
+                return null;
+            }
+            if (!before(self.items[0], item)) return item;
+            const released = self.items[0];
+            self.items[0] = item;
+            self.siftDown(0);
+            return released;
+        }
+
+        /// The first item, if any, left in place.
+        pub fn peek(self: *const Self) ?T {
+            return if (self.len == 0) null else self.items[0];
+        }
+
+        /// Remove the first item, if any.
+        pub fn pop(self: *Self) ?T {
+            if (self.len == 0) return null;
+            const first = self.items[0];
+            self.len -= 1;
+            if (self.len > 0) {
+                self.items[0] = self.items[self.len];
+                self.siftDown(0);
+            }
+            return first;
+        }
+
+        fn siftUp(self: *Self, start: usize) void {
+            var i = start;
+            while (i > 0) {
+                const parent = (i - 1) / 2;
+                if (!before(self.items[i], self.items[parent])) break;
+                std.mem.swap(T, &self.items[i], &self.items[parent]);
+                i = parent;
+            }
+        }
+
+        fn siftDown(self: *Self, start: usize) void {
+            var i = start;
+            while (true) {
+                var first = i;
+                for ([_]usize{ 2 * i + 1, 2 * i + 2 }) |child| {
+                    if (child < self.len and before(self.items[child], self.items[first])) first = child;
+                }
+                if (first == i) break;
+                std.mem.swap(T, &self.items[i], &self.items[first]);
+                i = first;
+            }
+        }
+    };
+}
+
+const testing = std.testing;
+
+fn greater(a: u32, b: u32) bool {
+    return a > b;
+}
+
+test "priority buffer releases the first item when full" {
+    var buffer = try PriorityBuffer(u32, greater).init(testing.allocator, 3);
+    defer buffer.deinit(testing.allocator);
+
+    try testing.expectEqual(null, buffer.push(5));
+    try testing.expectEqual(null, buffer.push(1));
+    try testing.expectEqual(null, buffer.push(9));
+    try testing.expectEqual(9, buffer.push(3).?);
+    // A new item that ranks first passes straight through.
+    try testing.expectEqual(7, buffer.push(7).?);
+
+    try testing.expectEqual(5, buffer.peek().?);
+    try testing.expectEqual(5, buffer.pop().?);
+    try testing.expectEqual(3, buffer.pop().?);
+    try testing.expectEqual(1, buffer.pop().?);
+    try testing.expectEqual(null, buffer.pop());
+}
+
+test "priority buffer drains in order" {
+    var buffer = try PriorityBuffer(u32, greater).init(testing.allocator, 64);
+    defer buffer.deinit(testing.allocator);
+
+    var prng = std.Random.DefaultPrng.init(0);
+    for (0..64) |_| try testing.expectEqual(null, buffer.push(prng.random().int(u32)));
+    var last: u32 = std.math.maxInt(u32);
+    while (buffer.pop()) |v| {
+        try testing.expect(v <= last);
+        last = v;
+    }
+}
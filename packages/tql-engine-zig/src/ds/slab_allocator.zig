@@ -0,0 +1,156 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const Alignment = std.mem.Alignment;
+
+/// Region allocator for short-lived runtime objects. Small allocations are
+/// served from size-classed free lists carved out of an arena, so freeing a
+/// refcounted node or environment array recycles it for the next one of the
+/// same class instead of going back to the arena, where only the most recent
+/// allocation can be reclaimed. Larger or over-aligned allocations go to the
+/// arena directly.
+///
+/// Everything is released at once with `reset`, e.g. after each file. Not
+/// thread safe; use one per worker.
+pub const SlabAllocator = struct {
+    const Self = @This();
+
+    /// Block sizes of the classes, smallest first. Each is a multiple of
+    /// `block_alignment`.
+    const class_sizes = [_]usize{ 16, 32, 64, 128, 256 };
+    const block_alignment: Alignment = .@"16";
+
+    const FreeBlock = struct {
+        next: ?*FreeBlock,
+    };
+
+    arena: std.heap.ArenaAllocator,
+    free_lists: [class_sizes.len]?*FreeBlock,
+
+    pub fn init(child_allocator: Allocator) Self {
+        return .{
+            .arena = std.heap.ArenaAllocator.init(child_allocator),
+            .free_lists = @splat(null),
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.arena.deinit();
+    }
+
+    /// Release every allocation, keeping the arena's capacity for reuse.
+    pub fn reset(self: *Self) void {
+        self.free_lists = @splat(null);
+        _ = self.arena.reset(.retain_capacity);
+    }
+
+    pub fn allocator(self: *Self) Allocator {
+        return .{
+            .ptr = self,
+            .vtable = &.{
+                .alloc = alloc,
+                .resize = resize,
+                .remap = remap,
+                .free = free,
+            },
+        };
+    }
+
+    fn classOf(len: usize, alignment: Alignment) ?usize {
+        if (alignment.compare(.gt, block_alignment)) return null;
+        for (class_sizes, 0..) |size, class| {
+            if (len <= size) return class;
+        }
+        return null;
+    }
+
+    fn alloc(ctx: *anyopaque, len: usize, alignment: Alignment, ret_addr: usize) ?[*]u8 {
+        const self: *Self = @ptrCast(@alignCast(ctx));
+        const arena = self.arena.allocator();
+        const class = classOf(len, alignment) orelse
+            return arena.rawAlloc(len, alignment, ret_addr);
+
+        if (self.free_lists[class]) |block| {
+            self.free_lists[class] = block.next;
+            return @ptrCast(block);
+        }
+        return arena.rawAlloc(class_sizes[class], block_alignment, ret_addr);
+    }
+
+    fn resize(ctx: *anyopaque, memory: []u8, alignment: Alignment, new_len: usize, ret_addr: usize) bool {
+        const self: *Self = @ptrCast(@alignCast(ctx));
+        const class = classOf(memory.len, alignment) orelse
+            return classOf(new_len, alignment) == null and
+                self.arena.allocator().rawResize(memory, alignment, new_len, ret_addr);
+        // Blocks can grow or shrink within their class.
+        return classOf(new_len, alignment) == class;
+    }
+
+    fn remap(ctx: *anyopaque, memory: []u8, alignment: Alignment, new_len: usize, ret_addr: usize) ?[*]u8 {
+        return if (resize(ctx, memory, alignment, new_len, ret_addr)) memory.ptr else null;
+    }
+
+    fn free(ctx: *anyopaque, memory: []u8, alignment: Alignment, ret_addr: usize) void {
+        const self: *Self = @ptrCast(@alignCast(ctx));
+        const class = classOf(memory.len, alignment) orelse
+            return self.arena.allocator().rawFree(memory, alignment, ret_addr);
+
+        const block: *FreeBlock = @ptrCast(@alignCast(memory.ptr));
+        block.next = self.free_lists[class];
+        self.free_lists[class] = block;
+    }
+};
+
+const testing = std.testing;
+
+test "freed blocks are recycled within their class" {
+    var slab = SlabAllocator.init(testing.allocator);
+    defer slab.deinit();
+    const gpa = slab.allocator();
+
+    const a = try gpa.create(u64);
+    gpa.destroy(a);
+    const b = try gpa.create(u64);
+    try testing.expectEqual(a, b);
+
+    // Different class, different block.
+    const c = try gpa.create([40]u8);
+    try testing.expect(@intFromPtr(c) != @intFromPtr(b));
+    gpa.destroy(c);
+    const d = try gpa.create([33]u8);
+    try testing.expectEqual(@intFromPtr(c), @intFromPtr(d));
+}
+
+test "large allocations bypass the free lists" {
+    var slab = SlabAllocator.init(testing.allocator);
+    defer slab.deinit();
+    const gpa = slab.allocator();
+
+    const big = try gpa.alloc(u8, 4096);
+    gpa.free(big);
+    for (slab.free_lists) |list| try testing.expect(list == null);
+}
+
+test "array lists grow across classes" {
+    var slab = SlabAllocator.init(testing.allocator);
+    defer slab.deinit();
+    const gpa = slab.allocator();
+
+    var list: std.ArrayList(u32) = .empty;
+    defer list.deinit(gpa);
+    for (0..1000) |i| try list.append(gpa, @intCast(i));
+    for (list.items, 0..) |item, i| try testing.expectEqual(@as(u32, @intCast(i)), item);
+}
+
+test "reset drops everything" {
+    var slab = SlabAllocator.init(testing.allocator);
+    defer slab.deinit();
+    const gpa = slab.allocator();
+
+    for (0..3) |_| {
+        const a = try gpa.create(u64);
+        gpa.destroy(a);
+        _ = try gpa.alloc(u8, 1024);
+        slab.reset();
+        for (slab.free_lists) |list| try testing.expect(list == null);
+    }
+}
@@ -0,0 +1,223 @@
+const std = @import("std");
+const Rc = @import("rc.zig").Rc;
+
+const Allocator = std.mem.Allocator;
+
+/// Implements a map from dense integer keys in `[0, len)` to values, with
+/// O(1) lookup. The slots live in a fixed-size array owned by an `Rc`.
+/// `Cell` is a thin by-value handle; multiple handles to the same array each
+/// own one refcount. Writes through `put` are copy-on-write: in place when
+/// the handle is the only owner, otherwise on a fresh copy of the array.
+///
+/// If `V` declares `clone`, it is called whenever a value is copied into a
+/// new array. If `V` declares `deinit`, stored values are deinitialized when
+/// they are overwritten or their array drops to zero references.
+pub fn SlotMap(comptime V: type) type {
+    return struct {
+        pub const Node = struct {
+            slots: []?V,
+
+            pub fn deinit(self: *Node, gpa: Allocator) void {
+                for (self.slots) |*slot| {
+                    if (slot.*) |*v| deinitValue(v, gpa);
+                }
+                gpa.free(self.slots);
+            }
+        };
+
+        pub const Cell = struct {
+            inner: *Rc(Node),
+
+            pub fn create(gpa: Allocator, len: usize) !Cell {
+                const slots = try gpa.alloc(?V, len);
+                errdefer gpa.free(slots);
+                @memset(slots, null);
+                const inner = try Rc(Node).create(gpa, .{ .slots = slots });
+                return .{ .inner = inner };
+            }
+
+            pub fn reference(self: Cell) Cell {
+                _ = self.inner.reference();
+                return self;
+            }
+
+            pub fn dereference(self: Cell, gpa: Allocator) void {
+                self.inner.dereference(gpa);
+            }
+
+            pub fn rc(self: Cell) u32 {
+                return self.inner.rc;
+            }
+
+            pub fn len(self: Cell) usize {
+                return self.inner.value.slots.len;
+            }
+
+            /// A new, unshared array with the same contents.
+            pub fn copy(self: Cell, gpa: Allocator) !Cell {
+                const src = self.inner.value.slots;
+                const slots = try gpa.alloc(?V, src.len);
+                errdefer gpa.free(slots);
+                for (slots, src) |*dst, s| {
+                    dst.* = if (s) |v| cloneValue(v) else null;
+                }
+                const inner = try Rc(Node).create(gpa, .{ .slots = slots });
+                return .{ .inner = inner };
+            }
+
+            /// Make `self` the only owner of its array, copying it if shared.
+            pub fn makeUnique(self: *Cell, gpa: Allocator) !void {
+                if (self.rc() == 1) return;
+                const unique = try self.copy(gpa);
+                self.dereference(gpa);
+                self.* = unique;
+            }
+
+            /// Set `key` to `value`, taking ownership of `value`.
+            pub fn put(self: *Cell, gpa: Allocator, key: usize, value: V) !void {
+                try self.makeUnique(gpa);
+                const slot = &self.inner.value.slots[key];
+                if (slot.*) |*old| deinitValue(old, gpa);
+                slot.* = value;
+            }
+
+            pub fn remove(self: *Cell, gpa: Allocator, key: usize) !void {
+                if (self.get(key) == null) return;
+                try self.makeUnique(gpa);
+                const slot = &self.inner.value.slots[key];
+                if (slot.*) |*old| deinitValue(old, gpa);
+                slot.* = null;
+            }
+
+            /// Keys outside `[0, len)` are never set.
+            pub fn get(self: Cell, key: usize) ?V {
+                const slots = self.inner.value.slots;
+                if (key >= slots.len) return null;
+                return slots[key];
+            }
+        };
+    };
+}
+
+fn cloneValue(value: anytype) @TypeOf(value) {
+    const T = @TypeOf(value);
+    return switch (@typeInfo(T)) {
+        .@"struct", .@"enum", .@"union" => if (comptime @hasDecl(T, "clone")) value.clone() else value,
+        else => value,
+    };
+}
+
+fn deinitValue(value: anytype, gpa: Allocator) void {
+    const T = @TypeOf(value.*);
+    switch (@typeInfo(T)) {
+        .@"struct", .@"enum", .@"union", .@"opaque" => if (comptime @hasDecl(T, "deinit")) {
+            const params = @typeInfo(@TypeOf(T.deinit)).@"fn".params;
+            if (comptime params.len == 2) {
+                value.deinit(gpa);
+            } else {
+                value.deinit();
+            }
+        },
+        else => {},
+    }
+}
+
+const expect = std.testing.expect;
+const testing = std.testing;
+
+test "basic" {
+    const gpa = testing.allocator;
+    const M = SlotMap(u32);
+
+    var sm = try M.Cell.create(gpa, 8);
+    defer sm.dereference(gpa);
+    try sm.put(gpa, 6, 9);
+    try sm.put(gpa, 4, 20);
+
+    try expect(sm.get(6) == 9);
+    try expect(sm.get(4) == 20);
+    try expect(sm.get(1) == null);
+    try expect(sm.get(100) == null);
+}
+
+test "remove" {
+    const gpa = testing.allocator;
+    const M = SlotMap(u32);
+
+    var sm = try M.Cell.create(gpa, 8);
+    defer sm.dereference(gpa);
+    try sm.put(gpa, 6, 9);
+    try sm.remove(gpa, 6);
+    try sm.put(gpa, 4, 20);
+
+    try expect(sm.get(6) == null);
+    try expect(sm.get(4) == 20);
+}
+
+test "put writes in place when unshared" {
+    const gpa = testing.allocator;
+    const M = SlotMap(u32);
+
+    var sm = try M.Cell.create(gpa, 4);
+    defer sm.dereference(gpa);
+    const inner = sm.inner;
+    try sm.put(gpa, 1, 1);
+    try sm.put(gpa, 1, 2);
+    try expect(sm.inner == inner);
+    try expect(sm.get(1) == 2);
+}
+
+test "fork: put on a shared array copies it" {
+    const gpa = testing.allocator;
+    const M = SlotMap(u32);
+
+    var sm_0 = try M.Cell.create(gpa, 4);
+    try sm_0.put(gpa, 0, 10);
+
+    var sm_1 = sm_0.reference();
+    try expect(sm_0.rc() == 2);
+
+    try sm_1.put(gpa, 1, 11);
+    try expect(sm_1.inner != sm_0.inner);
+    try expect(sm_0.rc() == 1);
+    try expect(sm_1.rc() == 1);
+
+    try expect(sm_0.get(0) == 10);
+    try expect(sm_0.get(1) == null);
+    try expect(sm_1.get(0) == 10);
+    try expect(sm_1.get(1) == 11);
+
+    sm_1.dereference(gpa);
+    sm_0.dereference(gpa);
+}
+
+test "V with clone and deinit is refcounted across copies" {
+    const gpa = testing.allocator;
+    const Counted = struct {
+        refs: *u32,
+        pub fn clone(self: @This()) @This() {
+            self.refs.* += 1;
+            return self;
+        }
+        pub fn deinit(self: *@This()) void {
+            self.refs.* -= 1;
+        }
+    };
+    const M = SlotMap(Counted);
+
+    var refs: u32 = 1;
+    var sm_0 = try M.Cell.create(gpa, 2);
+    try sm_0.put(gpa, 0, .{ .refs = &refs });
+
+    var sm_1 = try sm_0.copy(gpa);
+    try expect(refs == 2);
+
+    // Overwriting drops the overwritten value.
+    try sm_1.put(gpa, 0, (Counted{ .refs = &refs }).clone());
+    try expect(refs == 2);
+
+    sm_0.dereference(gpa);
+    try expect(refs == 1);
+    sm_1.dereference(gpa);
+    try expect(refs == 0);
+}
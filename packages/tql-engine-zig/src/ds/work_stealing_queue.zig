@@ -0,0 +1,344 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+/// Multi-producer queue for a fixed set of workers, each of which pops from
+/// its own deque and steals from the others' when it runs dry. Producers
+/// push in chunks, spread round-robin over the deques, so workers contend
+/// only when stealing or when there is nothing left to do. Once `close()` is
+/// called and every deque drains, `pop` returns null.
+///
+/// With a capacity, `push` blocks while that many items are pending, so a
+/// producer that outruns the workers doesn't hold everything it found in
+/// memory. Workers that push must use an unbounded queue: if they all block,
+/// nothing is left to pop.
+pub fn WorkStealingQueue(comptime T: type) type {
+    return struct {
+        const Self = @This();
+
+        /// Most items taken from another worker's deque at once.
+        pub const steal_batch = 16;
+
+        /// Which end of its own deque a worker pops from. Newest first keeps
+        /// a worker on what it was just given; oldest first keeps the order
+        /// items were pushed in, for producers that push in priority order.
+        pub const Order = enum { newest_first, oldest_first };
+
+        const Deque = struct {
+            mu: std.Io.Mutex = .init,
+            /// Live items are `items[head..]`. The owner pops from the back,
+            /// thieves take from the front.
+            items: std.ArrayList(T) = .empty,
+            head: usize = 0,
+
+            fn len(self: *const Deque) usize {
+                return self.items.items.len - self.head;
+            }
+
+            fn compact(self: *Deque) void {
+                if (self.head == 0 or self.head < self.items.items.len / 2) return;
+                const live = self.len();
+                std.mem.copyForwards(T, self.items.items[0..live], self.items.items[self.head..]);
+                self.items.shrinkRetainingCapacity(live);
+                self.head = 0;
+            }
+        };
+
+        io: std.Io,
+        allocator: Allocator,
+        deques: []Deque,
+        order: Order,
+        /// Pending items past which `push` blocks. A chunk may overshoot
+        /// it; it only has to start below.
+        capacity: ?usize,
+        /// Deque the next chunk goes to.
+        next_deque: std.atomic.Value(usize) = .init(0),
+        /// Items pushed and not yet popped.
+        pending: std.atomic.Value(usize) = .init(0),
+        closed_flag: std.atomic.Value(bool) = .init(false),
+        /// Workers with nothing to steal, and producers waiting for room,
+        /// wait here. Only touched when a worker runs out of work, a
+        /// producer runs out of room, or to wake either.
+        idle_mu: std.Io.Mutex = .init,
+        idle_cv: std.Io.Condition = .init,
+        sleepers: std.atomic.Value(usize) = .init(0),
+        blocked_producers: std.atomic.Value(usize) = .init(0),
+
+        pub fn init(allocator: Allocator, io: std.Io, workers: usize, order: Order, capacity: ?usize) !Self {
+            std.debug.assert(workers > 0);
+            std.debug.assert(capacity != 0);
+            const deques = try allocator.alloc(Deque, workers);
+            @memset(deques, .{});
+            return .{ .io = io, .allocator = allocator, .deques = deques, .order = order, .capacity = capacity };
+        }
+
+        pub fn deinit(self: *Self) void {
+            for (self.deques) |*deque| deque.items.deinit(self.allocator);
+            self.allocator.free(self.deques);
+        }
+
+        /// Hand `chunk` to one worker; the others may steal from it. Blocks
+        /// while the queue is at capacity.
+        pub fn push(self: *Self, chunk: []const T) !void {
+            if (chunk.len == 0) return;
+            try self.waitForRoom();
+            const deque = &self.deques[self.next_deque.fetchAdd(1, .monotonic) % self.deques.len];
+            // Counted before they can be popped, so the count never drops
+            // below what is queued.
+            _ = self.pending.fetchAdd(chunk.len, .seq_cst);
+            {
+                errdefer {
+                    _ = self.pending.fetchSub(chunk.len, .seq_cst);
+                    self.wakeProducers();
+                }
+                try deque.mu.lock(self.io);
+                defer deque.mu.unlock(self.io);
+                deque.compact();
+                try deque.items.appendSlice(self.allocator, chunk);
+            }
+            try self.wake();
+        }
+
+        /// Block until worker `worker` has an item, or the queue is closed
+        /// and drained.
+        pub fn pop(self: *Self, worker: usize) !?T {
+            while (true) {
+                const taken = (try self.popOwn(worker)) orelse try self.steal(worker);
+                if (taken) |v| {
+                    self.wakeProducers();
+                    return v;
+                }
+
+                try self.idle_mu.lock(self.io);
+                defer self.idle_mu.unlock(self.io);
+                _ = self.sleepers.fetchAdd(1, .seq_cst);
+                defer _ = self.sleepers.fetchSub(1, .seq_cst);
+                // Items may be in flight between deques; look again.
+                if (self.pending.load(.seq_cst) > 0) continue;
+                if (self.closed_flag.load(.seq_cst)) return null;
+                try self.idle_cv.wait(self.io, &self.idle_mu);
+            }
+        }
+
+        /// No more pushes. Workers finish what is queued and then stop.
+        pub fn close(self: *Self) !void {
+            self.closed_flag.store(true, .seq_cst);
+            try self.idle_mu.lock(self.io);
+            defer self.idle_mu.unlock(self.io);
+            self.idle_cv.broadcast(self.io);
+        }
+
+        fn wake(self: *Self) !void {
+            if (self.sleepers.load(.seq_cst) == 0 and self.blocked_producers.load(.seq_cst) == 0) return;
+            try self.idle_mu.lock(self.io);
+            defer self.idle_mu.unlock(self.io);
+            self.idle_cv.broadcast(self.io);
+        }
+
+        fn waitForRoom(self: *Self) !void {
+            const capacity = self.capacity orelse return;
+            if (self.pending.load(.seq_cst) < capacity) return;
+            try self.idle_mu.lock(self.io);
+            defer self.idle_mu.unlock(self.io);
+            _ = self.blocked_producers.fetchAdd(1, .seq_cst);
+            defer _ = self.blocked_producers.fetchSub(1, .seq_cst);
+            while (self.pending.load(.seq_cst) >= capacity) {
+                try self.idle_cv.wait(self.io, &self.idle_mu);
+            }
+        }
+
+        /// Uncancelable, as the caller already holds a popped item.
+        fn wakeProducers(self: *Self) void {
+            if (self.blocked_producers.load(.seq_cst) == 0) return;
+            self.idle_mu.lockUncancelable(self.io);
+            defer self.idle_mu.unlock(self.io);
+            self.idle_cv.broadcast(self.io);
+        }
+
+        fn popOwn(self: *Self, worker: usize) !?T {
+            const deque = &self.deques[worker];
+            try deque.mu.lock(self.io);
+            defer deque.mu.unlock(self.io);
+            if (deque.len() == 0) return null;
+            const v = switch (self.order) {
+                .newest_first => deque.items.pop().?,
+                .oldest_first => blk: {
+                    deque.head += 1;
+                    break :blk deque.items.items[deque.head - 1];
+                },
+            };
+            if (deque.len() == 0) {
+                deque.items.clearRetainingCapacity();
+                deque.head = 0;
+            }
+            _ = self.pending.fetchSub(1, .seq_cst);
+            return v;
+        }
+
+        /// Take up to half of another deque, keeping the rest of the batch
+        /// for later pops.
+        fn steal(self: *Self, worker: usize) !?T {
+            var batch: [steal_batch]T = undefined;
+            for (1..self.deques.len) |offset| {
+                const victim = &self.deques[(worker + offset) % self.deques.len];
+                const n = blk: {
+                    try victim.mu.lock(self.io);
+                    defer victim.mu.unlock(self.io);
+                    const n = @min(steal_batch, (victim.len() + 1) / 2);
+                    @memcpy(batch[0..n], victim.items.items[victim.head..][0..n]);
+                    victim.head += n;
+                    break :blk n;
+                };
+                if (n == 0) continue;
+
+                if (n > 1) {
+                    const own = &self.deques[worker];
+                    try own.mu.lock(self.io);
+                    defer own.mu.unlock(self.io);
+                    own.compact();
+                    // On failure the batch's other items are lost to the
+                    // count, so don't strand waiters on them.
+                    own.items.appendSlice(self.allocator, batch[1..n]) catch |err| {
+                        _ = self.pending.fetchSub(n - 1, .seq_cst);
+                        return err;
+                    };
+                }
+                _ = self.pending.fetchSub(1, .seq_cst);
+                return batch[0];
+            }
+            return null;
+        }
+    };
+}
+
+const testing = std.testing;
+
+test "work stealing queue: a worker steals what another was given" {
+    var single_threaded = std.Io.Threaded.init_single_threaded;
+    var queue = try WorkStealingQueue(u32).init(testing.allocator, single_threaded.io(), 2, .newest_first, null);
+    defer queue.deinit();
+
+    // Both chunks go to the first worker's deque and the second's, in turn.
+    try queue.push(&.{ 1, 2, 3, 4 });
+    try queue.push(&.{5});
+    try testing.expectEqual(5, (try queue.pop(1)).?);
+    // Worker 1 steals half of worker 0's items, oldest first.
+    try testing.expectEqual(1, (try queue.pop(1)).?);
+    try testing.expectEqual(2, (try queue.pop(1)).?);
+    // Worker 0 pops its newest.
+    try testing.expectEqual(4, (try queue.pop(0)).?);
+    try testing.expectEqual(3, (try queue.pop(0)).?);
+
+    try queue.close();
+    try testing.expectEqual(null, try queue.pop(0));
+    try testing.expectEqual(null, try queue.pop(1));
+}
+
+test "work stealing queue: oldest first" {
+    var single_threaded = std.Io.Threaded.init_single_threaded;
+    var queue = try WorkStealingQueue(u32).init(testing.allocator, single_threaded.io(), 1, .oldest_first, null);
+    defer queue.deinit();
+
+    try queue.push(&.{ 9, 7 });
+    try queue.push(&.{4});
+    try queue.close();
+    try testing.expectEqual(9, (try queue.pop(0)).?);
+    try testing.expectEqual(7, (try queue.pop(0)).?);
+    try testing.expectEqual(4, (try queue.pop(0)).?);
+    try testing.expectEqual(null, try queue.pop(0));
+}
+
+test "work stealing queue: every item is popped once" {
+    const io = testing.io;
+
+    const workers = 4;
+    const items = 10_000;
+    var queue = try WorkStealingQueue(u32).init(testing.allocator, io, workers, .newest_first, null);
+    defer queue.deinit();
+
+    var seen: [items]std.atomic.Value(u8) = @splat(.init(0));
+    const Worker = struct {
+        fn run(q: *WorkStealingQueue(u32), index: usize, s: *[items]std.atomic.Value(u8)) !void {
+            while (try q.pop(index)) |v| _ = s[v].fetchAdd(1, .monotonic);
+        }
+    };
+    var threads: [workers]std.Thread = undefined;
+    for (&threads, 0..) |*t, i| t.* = try std.Thread.spawn(.{}, Worker.run, .{ &queue, i, &seen });
+
+    var chunk: [64]u32 = undefined;
+    var next: u32 = 0;
+    while (next < items) {
+        const n = @min(chunk.len, items - next);
+        for (chunk[0..n], next..) |*c, v| c.* = @intCast(v);
+        try queue.push(chunk[0..n]);
+        next += @intCast(n);
+    }
+    try queue.close();
+    for (threads) |t| t.join();
+
+    for (&seen) |*s| try testing.expectEqual(1, s.load(.monotonic));
+}
+
+test "work stealing queue: a bounded queue holds producers back" {
+    const io = testing.io;
+
+    const capacity = 4;
+    const items = 1_000;
+    var queue = try WorkStealingQueue(u32).init(testing.allocator, io, 1, .oldest_first, capacity);
+    defer queue.deinit();
+
+    const Producer = struct {
+        fn run(q: *WorkStealingQueue(u32)) !void {
+            for (0..items) |v| try q.push(&.{@intCast(v)});
+            try q.close();
+        }
+    };
+    const producer = try std.Thread.spawn(.{}, Producer.run, .{&queue});
+    defer producer.join();
+
+    var expected: u32 = 0;
+    while (try queue.pop(0)) |v| : (expected += 1) {
+        try testing.expectEqual(expected, v);
+        try testing.expect(queue.pending.load(.seq_cst) <= capacity);
+    }
+    try testing.expectEqual(items, expected);
+}
+
+test "work stealing queue: producers share a bounded queue" {
+    const io = testing.io;
+
+    const workers = 3;
+    const producers = 4;
+    const per_producer = 5_000;
+    const capacity = 16;
+    var queue = try WorkStealingQueue(u32).init(testing.allocator, io, workers, .newest_first, capacity);
+    defer queue.deinit();
+
+    var seen: [producers * per_producer]std.atomic.Value(u8) = @splat(.init(0));
+    const Worker = struct {
+        fn run(q: *WorkStealingQueue(u32), index: usize, s: *[producers * per_producer]std.atomic.Value(u8)) !void {
+            while (try q.pop(index)) |v| _ = s[v].fetchAdd(1, .monotonic);
+        }
+    };
+    const Producer = struct {
+        fn run(q: *WorkStealingQueue(u32), first: u32) !void {
+            var chunk: [3]u32 = undefined;
+            var next = first;
+            while (next < first + per_producer) {
+                const n = @min(chunk.len, first + per_producer - next);
+                for (chunk[0..n], next..) |*c, v| c.* = @intCast(v);
+                try q.push(chunk[0..n]);
+                next += @intCast(n);
+            }
+        }
+    };
+    var worker_threads: [workers]std.Thread = undefined;
+    for (&worker_threads, 0..) |*t, i| t.* = try std.Thread.spawn(.{}, Worker.run, .{ &queue, i, &seen });
+    var producer_threads: [producers]std.Thread = undefined;
+    for (&producer_threads, 0..) |*t, i| t.* = try std.Thread.spawn(.{}, Producer.run, .{ &queue, @as(u32, @intCast(i * per_producer)) });
+
+    for (producer_threads) |t| t.join();
+    try queue.close();
+    for (worker_threads) |t| t.join();
+
+    for (&seen) |*s| try testing.expectEqual(1, s.load(.monotonic));
+}
@@ -6,27 +6,74 @@ const parser = @import("parser.zig");
 const compiler = @import("compiler.zig");
 const runtime = @import("runtime.zig");
 const ast = @import("ast.zig");
+const image = @import("image.zig");
 const Language = @import("language.zig").Language;
 
+/// How much of a node's source text results carry. Output is usually
+/// dominated by the text of large nodes such as function definitions.
+pub const NodeText = union(enum) {
+    full,
+    omit,
+    /// At most this many bytes, cut back to a UTF-8 character boundary.
+    truncate: u32,
+
+    pub fn apply(self: NodeText, text: []const u8) ?[]const u8 {
+        return switch (self) {
+            .full => text,
+            .omit => null,
+            .truncate => |limit| blk: {
+                if (text.len <= limit) break :blk text;
+                var end: usize = limit;
+                while (end > 0 and text[end] & 0xc0 == 0x80) end -= 1;
+                break :blk text[0..end];
+            },
+        };
+    }
+};
+
+pub const ResultOptions = struct {
+    node_text: NodeText = .full,
+    /// Copy node text into the result allocator. When false, nodes refer to
+    /// the target's source, which must then outlive the values.
+    copy_text: bool = true,
+};
+
 // Mirror a ts.Node. We want this to have its own lifetime independent of the tree sitter AST
 // that backs a ts.Node.
 pub const Node = struct {
+    /// The grammar's name for `kind_id`. Grammars are never unloaded, so
+    /// this is never copied.
     kind: []const u8,
-    text: []const u8,
+    kind_id: u16,
+    /// Null when results leave text out.
+    text: ?[]const u8,
+    /// Whether `text` is a copy, freed by `deinit`, or refers to the source.
+    owns_text: bool = false,
     start_byte: u32,
     end_byte: u32,
     start_point: runtime.Point,
     end_point: runtime.Point,
 
-    pub fn fromTsNode(gpa: Allocator, ts_node: ts.Node, source: []const u8) error{OutOfMemory}!Node {
+    pub fn fromTsNode(gpa: Allocator, ts_node: ts.Node, source: []const u8, options: ResultOptions) error{OutOfMemory}!Node {
+        var node = borrowed(ts_node, source);
+        node.text = options.node_text.apply(node.text.?);
+        if (options.copy_text) {
+            if (node.text) |text| {
+                node.text = try gpa.dupe(u8, text);
+                node.owns_text = true;
+            }
+        }
+        return node;
+    }
+
+    /// A view of `ts_node` that shares its text with `source`.
+    pub fn borrowed(ts_node: ts.Node, source: []const u8) Node {
         const start_point = ts_node.startPoint();
         const end_point = ts_node.endPoint();
-        const kind = try gpa.dupe(u8, ts_node.kind());
-        errdefer gpa.free(kind);
-        const text = try gpa.dupe(u8, source[ts_node.startByte()..ts_node.endByte()]);
         return Node{
-            .kind = kind,
-            .text = text,
+            .kind = ts_node.kind(),
+            .kind_id = ts_node.kindId(),
+            .text = source[ts_node.startByte()..ts_node.endByte()],
             .start_byte = ts_node.startByte(),
             .end_byte = ts_node.endByte(),
             .start_point = .{ .row = start_point.row, .column = start_point.column },
@@ -35,8 +82,26 @@ pub const Node = struct {
     }
 
     pub fn deinit(self: *Node, gpa: Allocator) void {
-        gpa.free(self.kind);
-        gpa.free(self.text);
+        if (self.owns_text) gpa.free(self.text.?);
+    }
+
+    pub fn jsonStringify(self: Node, jws: *std.json.Stringify) std.json.Stringify.Error!void {
+        try jws.beginObject();
+        try jws.objectField("kind");
+        try jws.write(self.kind);
+        if (self.text) |text| {
+            try jws.objectField("text");
+            try jws.write(text);
+        }
+        try jws.objectField("start_byte");
+        try jws.write(self.start_byte);
+        try jws.objectField("end_byte");
+        try jws.write(self.end_byte);
+        try jws.objectField("start_point");
+        try jws.write(self.start_point);
+        try jws.objectField("end_point");
+        try jws.write(self.end_point);
+        try jws.endObject();
     }
 };
 
@@ -49,14 +114,17 @@ pub const Value = union(enum) {
     record: Record,
     list: List,
 
-    pub fn fromRuntimeValue(gpa: Allocator, val: runtime.Value, source: []const u8) error{OutOfMemory}!Value {
+    /// Deep-copy a value produced by `rt`, resolving anything it references
+    /// by index (nodes, strings, source text). Node text is copied, trimmed
+    /// or shared with the source as `options` say.
+    pub fn fromRuntimeValue(gpa: Allocator, val: runtime.Value, rt: *const runtime.Runtime, options: ResultOptions) error{OutOfMemory}!Value {
         return switch (val) {
             .nothing => .{ .nothing = {} },
-            .string => |s| .{ .string = try gpa.dupe(u8, s) },
-            .node => |n| .{ .node = try Node.fromTsNode(gpa, n, source) },
-            .range => |r| .{ .range = r },
-            .record => |rc| .{ .record = try Record.fromRuntime(gpa, &rc.value, source) },
-            .list => |rc| .{ .list = try List.fromRuntime(gpa, &rc.value, source) },
+            .string, .text => .{ .string = try gpa.dupe(u8, rt.stringOf(val).?) },
+            .node => |ref| .{ .node = try Node.fromTsNode(gpa, rt.nodeOf(ref), rt.source, options) },
+            .range => |ref| .{ .range = rt.rangeOf(ref) },
+            .record => |rc| .{ .record = try Record.fromRuntime(gpa, &rc.value, rt, options) },
+            .list => |rc| .{ .list = try List.fromRuntime(gpa, &rc.value, rt, options) },
             .uint => |u| .{ .uint = u },
             .kind_id, .field_id, .regex => @panic("TODO"),
         };
@@ -76,7 +144,7 @@ pub const Value = union(enum) {
         switch (self) {
             .nothing => try jws.write(null),
             .string => |s| try jws.write(s),
-            .node => |n| try jws.write(n),
+            .node => |n| try n.jsonStringify(jws),
             .range => |r| try jws.write(r),
             .record => |r| try r.jsonStringify(jws),
             .list => |l| try l.jsonStringify(jws),
@@ -93,19 +161,24 @@ pub const RecordEntry = struct {
 pub const Record = struct {
     entries: []RecordEntry,
 
-    pub fn fromRuntime(gpa: Allocator, src: *const runtime.Record, source: []const u8) error{OutOfMemory}!Record {
-        const entries = try gpa.alloc(RecordEntry, src.map.count());
-        errdefer gpa.free(entries);
+    pub fn fromRuntime(gpa: Allocator, src: *const runtime.Record, rt: *const runtime.Runtime, options: ResultOptions) error{OutOfMemory}!Record {
+        const entries = try gpa.alloc(RecordEntry, src.entries.items.len);
+        var done: usize = 0;
+        errdefer {
+            for (entries[0..done]) |*e| {
+                gpa.free(e.key);
+                e.value.deinit(gpa);
+            }
+            gpa.free(entries);
+        }
 
-        var it = src.map.iterator();
-        var i: usize = 0;
-        while (it.next()) |e| : (i += 1) {
-            entries[i] = .{
-                .key = try gpa.dupe(u8, e.key_ptr.*),
-                .value = try Value.fromRuntimeValue(gpa, e.value_ptr.*, source),
-            };
+        // Already in key order; see `runtime.Record`.
+        for (entries, src.entries.items) |*out, e| {
+            const key = try gpa.dupe(u8, e.key);
+            errdefer gpa.free(key);
+            out.* = .{ .key = key, .value = try Value.fromRuntimeValue(gpa, e.value, rt, options) };
+            done += 1;
         }
-        std.mem.sort(RecordEntry, entries, {}, lessThanEntry);
         return .{ .entries = entries };
     }
 
@@ -125,19 +198,15 @@ pub const Record = struct {
         }
         try jws.endObject();
     }
-
-    fn lessThanEntry(_: void, a: RecordEntry, b: RecordEntry) bool {
-        return std.mem.order(u8, a.key, b.key) == .lt;
-    }
 };
 
 pub const List = struct {
     items: []Value,
 
-    pub fn fromRuntime(gpa: Allocator, src: *const runtime.List, source: []const u8) error{OutOfMemory}!List {
+    pub fn fromRuntime(gpa: Allocator, src: *const runtime.List, rt: *const runtime.Runtime, options: ResultOptions) error{OutOfMemory}!List {
         const items = try gpa.alloc(Value, src.items.items.len);
         errdefer gpa.free(items);
-        for (src.items.items, 0..) |v, i| items[i] = try Value.fromRuntimeValue(gpa, v, source);
+        for (src.items.items, 0..) |v, i| items[i] = try Value.fromRuntimeValue(gpa, v, rt, options);
         return .{ .items = items };
     }
 
@@ -153,15 +222,134 @@ pub const List = struct {
     }
 };
 
+/// A value as the runtime yielded it, still referring to the runtime's
+/// nodes and source. Valid until its stream advances; `toOwned` keeps it
+/// for longer.
+pub const BorrowedValue = struct {
+    value: runtime.Value,
+    runtime: *const runtime.Runtime,
+    /// Applied to nodes when serializing.
+    node_text: NodeText = .full,
+
+    pub fn toOwned(self: BorrowedValue, gpa: Allocator, options: ResultOptions) error{OutOfMemory}!Value {
+        return Value.fromRuntimeValue(gpa, self.value, self.runtime, options);
+    }
+
+    /// Serialize as `toOwned` would, without copying anything.
+    pub fn jsonStringify(self: BorrowedValue, jws: *std.json.Stringify) std.json.Stringify.Error!void {
+        const rt = self.runtime;
+        switch (self.value) {
+            .nothing => try jws.write(null),
+            .string, .text => try jws.write(rt.stringOf(self.value).?),
+            .node => |ref| {
+                var node = Node.borrowed(rt.nodeOf(ref), rt.source);
+                node.text = self.node_text.apply(node.text.?);
+                try node.jsonStringify(jws);
+            },
+            .range => |ref| try jws.write(rt.rangeOf(ref)),
+            .record => |rc| {
+                try jws.beginObject();
+                for (rc.value.entries.items) |e| {
+                    try jws.objectField(e.key);
+                    try jsonStringify(.{ .value = e.value, .runtime = rt, .node_text = self.node_text }, jws);
+                }
+                try jws.endObject();
+            },
+            .list => |rc| {
+                try jws.beginArray();
+                for (rc.value.items.items) |v| try jsonStringify(.{ .value = v, .runtime = rt, .node_text = self.node_text }, jws);
+                try jws.endArray();
+            },
+            .uint => |u| try jws.write(u),
+            .kind_id, .field_id, .regex => @panic("TODO"),
+        }
+    }
+};
+
+/// The values of one run, produced as the consumer asks for them rather
+/// than collected up front. Holds the runtime (and the tree, if it parsed
+/// one) until `deinit`. Must not be moved once `next` has been called.
+pub const Stream = struct {
+    query: *Query,
+    /// Null when the target was skipped.
+    runtime: ?runtime.Runtime,
+    /// The tree the stream parsed, destroyed with it.
+    owned_tree: ?*ts.Tree = null,
+    query_start: std.Io.Timestamp,
+    /// `query_time` is known once the stream is exhausted; it includes the
+    /// time the consumer spent between calls to `next`.
+    stats: RunStats,
+    /// How values are serialized and collected. Set before the first
+    /// `next`.
+    options: ResultOptions = .{},
+    /// Bounds of a `streamTreeSlice` stream, which its runtime's partition
+    /// refers to.
+    slice_bounds: ?*SliceBounds = null,
+
+    pub fn deinit(self: *Stream) void {
+        if (self.runtime) |*rt| {
+            if (self.slice_bounds) |bounds| rt.allocator.destroy(bounds);
+            rt.deinit();
+        }
+        if (self.owned_tree) |tree| tree.destroy();
+        self.* = undefined;
+    }
+
+    pub fn next(self: *Stream) !?BorrowedValue {
+        const rt = if (self.runtime) |*rt| rt else return null;
+        const value = try rt.next() orelse {
+            self.stats.query_time = self.query_start.untilNow(self.query.io, .real);
+            return null;
+        };
+        return .{ .value = value, .runtime = rt, .node_text = self.options.node_text };
+    }
+
+    /// Deep-copy the remaining values into a `RunResult`.
+    pub fn collect(self: *Stream, result_allocator: Allocator) !RunResult {
+        var values: std.ArrayList(Value) = .empty;
+        errdefer {
+            for (values.items) |*v| v.deinit(result_allocator);
+            values.deinit(result_allocator);
+        }
+        while (try self.next()) |borrowed| {
+            const v = try borrowed.toOwned(result_allocator, self.options);
+            try values.append(result_allocator, v);
+        }
+        return .{
+            .values = values,
+            .stats = self.stats,
+            .allocator = result_allocator,
+        };
+    }
+};
+
+/// The bytes of the source whose fan-out branches a slice runs.
+const SliceBounds = struct {
+    start: usize,
+    end: usize,
+
+    fn admit(context: *anyopaque, node: ts.Node) error{OutOfMemory}!bool {
+        const self: *const SliceBounds = @ptrCast(@alignCast(context));
+        const start = node.startByte();
+        return self.start <= start and start < self.end;
+    }
+};
+
 pub const Config = struct {
     allocator: Allocator,
     // Do I really need this?
     io: std.Io,
+    /// Skip files that lack a keyword of a node kind the query needs. Where
+    /// tree-sitter's error recovery inserted that keyword as a MISSING node,
+    /// the file's results are lost; turn this off to parse such files.
+    keyword_prefilter: bool = true,
 };
 
 pub const RunStats = struct {
     parse_time: std.Io.Duration,
     query_time: std.Io.Duration,
+    /// The target lacked literals the query needs, so it was never parsed.
+    skipped: bool = false,
 };
 
 pub const RunResult = struct {
@@ -204,6 +392,8 @@ pub const Engine = struct {
 
         var c = compiler.Compiler.init(self.config.allocator, language.getTreeSitterLanguage());
         defer c.deinit();
+        try c.loadNodeTypes(language.nodeTypes());
+        if (self.config.keyword_prefilter) c.loadKeywords(language.keywords());
 
         const program_image = try c.compile(self.config.allocator, source_file);
         return .{
@@ -213,6 +403,75 @@ pub const Engine = struct {
             .io = self.config.io,
         };
     }
+
+    /// Load a query saved with `Query.writeImage`. The file is mapped, not
+    /// read, and its code and strings are used in place.
+    pub fn loadImage(self: *Engine, path: []const u8) !Query {
+        const io = self.config.io;
+        const bytes = blk: {
+            const file = try std.Io.Dir.cwd().openFile(io, path, .{});
+            defer file.close(io);
+            const stat = try file.stat(io);
+            if (stat.size == 0) return error.InvalidImage;
+            break :blk try std.posix.mmap(
+                null,
+                stat.size,
+                .{ .READ = true },
+                .{ .TYPE = .PRIVATE },
+                file.handle,
+                0,
+            );
+        };
+        errdefer std.posix.munmap(bytes);
+        return self.fromImage(.{ .mapped = bytes });
+    }
+
+    /// Like `loadImage`, for an image already in memory. `bytes` is copied.
+    pub fn loadImageBytes(self: *Engine, bytes: []const u8) !Query {
+        const owned = try self.config.allocator.alignedAlloc(u8, .@"8", bytes.len);
+        errdefer self.config.allocator.free(owned);
+        @memcpy(owned, bytes);
+        return self.fromImage(.{ .owned = owned });
+    }
+
+    fn fromImage(self: *Engine, backing: runtime.ProgramImage.Backing) !Query {
+        const loaded = try image.load(self.config.allocator, backing);
+        return .{
+            .program_image = loaded.image,
+            .language = loaded.language,
+            .allocator = self.config.allocator,
+            .io = self.config.io,
+        };
+    }
+};
+
+/// What a thread keeps from one `Query.runIn` to the next: a tree-sitter
+/// parser per target language, created on first use and reset between
+/// runs rather than rebuilt for every file. Not thread-safe; each worker
+/// owns one.
+pub const RunContext = struct {
+    source_parsers: std.EnumArray(Language, ?*ts.Parser) = .initFill(null),
+
+    pub fn deinit(self: *RunContext) void {
+        for (&self.source_parsers.values) |*source_parser| {
+            if (source_parser.*) |p| p.destroy();
+            source_parser.* = null;
+        }
+    }
+
+    /// The parser for `language`, ready for a new document.
+    pub fn parserFor(self: *RunContext, language: Language) !*ts.Parser {
+        const slot = self.source_parsers.getPtr(language);
+        if (slot.*) |source_parser| {
+            source_parser.reset();
+            return source_parser;
+        }
+        const source_parser = ts.Parser.create();
+        errdefer source_parser.destroy();
+        try source_parser.setLanguage(language.getTreeSitterLanguage());
+        slot.* = source_parser;
+        return source_parser;
+    }
 };
 
 pub const Query = struct {
@@ -226,8 +485,22 @@ pub const Query = struct {
         self.program_image.deinit();
     }
 
-    pub fn instructions(self: *const Query) []const runtime.Instruction {
-        return self.program_image.instructions;
+    /// Serialize the compiled query for `Engine.loadImage`.
+    pub fn writeImage(self: *const Query, writer: *std.Io.Writer) !void {
+        try image.write(writer, &self.program_image, self.language);
+    }
+
+    pub fn code(self: *const Query) []const runtime.Code {
+        return self.program_image.code;
+    }
+
+    /// Print the compiled bytecode, one instruction per line.
+    pub fn disassemble(self: *const Query, writer: *std.Io.Writer) !void {
+        const disassembler: runtime.Disassembler = .{
+            .constants = self.program_image.constants,
+            .strings = self.program_image.strings,
+        };
+        try disassembler.printAll(writer, self.program_image.code);
     }
 
     /// Run against one in-memory query target buffer. Caller owns returned
@@ -239,45 +512,329 @@ pub const Query = struct {
         result_allocator: Allocator,
         scratch_allocator: Allocator,
     ) !RunResult {
-        const source_parser = ts.Parser.create();
-        defer source_parser.destroy();
-        try source_parser.setLanguage(self.language.getTreeSitterLanguage());
+        var context: RunContext = .{};
+        defer context.deinit();
+        return self.runIn(&context, query_target, result_allocator, scratch_allocator);
+    }
+
+    /// Like `run`, reusing the parser `context` holds for the query's
+    /// language. Prefer this when running over many targets.
+    pub fn runIn(
+        self: *Query,
+        context: *RunContext,
+        query_target: []const u8,
+        result_allocator: Allocator,
+        scratch_allocator: Allocator,
+    ) !RunResult {
+        var stream = try self.streamIn(context, query_target, scratch_allocator);
+        defer stream.deinit();
+        return stream.collect(result_allocator);
+    }
+
+    /// Run against a tree the caller already parsed from `source`, so that
+    /// many queries can share one parse. The tree is only borrowed and must
+    /// be of the query's language. The reported parse time is zero.
+    pub fn runTree(
+        self: *Query,
+        tree: *ts.Tree,
+        source: []const u8,
+        result_allocator: Allocator,
+        scratch_allocator: Allocator,
+    ) !RunResult {
+        var stream = try self.streamTree(tree, source, scratch_allocator);
+        defer stream.deinit();
+        return stream.collect(result_allocator);
+    }
+
+    /// Like `runIn`, handing out values one at a time as they are found
+    /// instead of copying them all. `query_target` must outlive the stream.
+    pub fn streamIn(
+        self: *Query,
+        context: *RunContext,
+        query_target: []const u8,
+        scratch_allocator: Allocator,
+    ) !Stream {
+        if (!self.admits(query_target)) {
+            return .{
+                .query = self,
+                .runtime = null,
+                .query_start = std.Io.Timestamp.now(self.io, .real),
+                .stats = .{ .parse_time = .zero, .query_time = .zero, .skipped = true },
+            };
+        }
+
+        const source_parser = try context.parserFor(self.language);
 
         const parse_start = std.Io.Timestamp.now(self.io, .real);
         const tree = source_parser.parseString(query_target, null) orelse return error.SourceParseFailed;
-        defer tree.destroy();
+        errdefer tree.destroy();
         const parse_time = parse_start.untilNow(self.io, .real);
 
-        var rt = runtime.Runtime.init(.{
-            .tree = tree,
-            .source = query_target,
-            .instructions = self.program_image.instructions,
-            .regexes = self.program_image.regexes,
-            .allocator = scratch_allocator,
-        });
+        var stream = try self.streamTree(tree, query_target, scratch_allocator);
+        stream.owned_tree = tree;
+        stream.stats.parse_time = parse_time;
+        return stream;
+    }
+
+    /// Like `runTree`, as a stream. `tree` and `source` must outlive it.
+    pub fn streamTree(
+        self: *Query,
+        tree: *ts.Tree,
+        source: []const u8,
+        scratch_allocator: Allocator,
+    ) !Stream {
+        if (tree.getLanguage() != self.language.getTreeSitterLanguage()) return error.TreeLanguageMismatch;
+
+        const query_start = std.Io.Timestamp.now(self.io, .real);
+        var rt = self.runtimeFor(tree, source, scratch_allocator, null);
+        errdefer rt.deinit();
         try rt.exec();
-        defer rt.deinit();
 
-        var values: std.ArrayList(Value) = .empty;
-        errdefer {
-            for (values.items) |*v| v.deinit(result_allocator);
-            values.deinit(result_allocator);
-        }
+        return .{
+            .query = self,
+            .runtime = rt,
+            .query_start = query_start,
+            .stats = .{ .parse_time = .zero, .query_time = .zero },
+        };
+    }
+
+    /// Like `streamTree`, for slice `index` of `count`. Slices split the
+    /// query's first fan-out (say, the functions of `@root >
+    /// function_definition`) by where each branch's node starts in `source`,
+    /// so they can run on separate threads: concatenating the values of
+    /// slices 0 to `count - 1` gives what `streamTree` yields. Threads must
+    /// each have their own tree, e.g. a `ts.Tree.dupe` of one parse.
+    /// Returns null when later parts of the query read what the fan-out's
+    /// prelude bound, so that its branches can't run apart.
+    pub fn streamTreeSlice(
+        self: *Query,
+        tree: *ts.Tree,
+        source: []const u8,
+        scratch_allocator: Allocator,
+        index: usize,
+        count: usize,
+    ) !?Stream {
+        std.debug.assert(index < count);
+        if (tree.getLanguage() != self.language.getTreeSitterLanguage()) return error.TreeLanguageMismatch;
+        const address = runtime.Partition.find(self.program_image.code) orelse return null;
+
+        const bounds = try scratch_allocator.create(SliceBounds);
+        errdefer scratch_allocator.destroy(bounds);
+        bounds.* = .{
+            .start = if (index == 0) 0 else source.len * index / count,
+            .end = if (index == count - 1) std.math.maxInt(usize) else source.len * (index + 1) / count,
+        };
 
         const query_start = std.Io.Timestamp.now(self.io, .real);
-        while (try rt.next()) |runtime_value| {
-            const v = try Value.fromRuntimeValue(result_allocator, runtime_value, query_target);
-            try values.append(result_allocator, v);
-        }
-        const query_time = query_start.untilNow(self.io, .real);
+        var rt = self.runtimeFor(tree, source, scratch_allocator, .{
+            .address = address,
+            .context = bounds,
+            .admit = SliceBounds.admit,
+        });
+        errdefer rt.deinit();
+        try rt.exec();
 
         return .{
-            .values = values,
-            .stats = .{
-                .parse_time = parse_time,
-                .query_time = query_time,
-            },
-            .allocator = result_allocator,
+            .query = self,
+            .runtime = rt,
+            .query_start = query_start,
+            .stats = .{ .parse_time = .zero, .query_time = .zero },
+            .slice_bounds = bounds,
         };
     }
+
+    /// Whether `query_target` has the literals the query needs; `streamIn`
+    /// skips targets that don't.
+    pub fn admits(self: *const Query, query_target: []const u8) bool {
+        return self.program_image.prefilter.admits(self.program_image.strings, query_target);
+    }
+
+    /// A runtime executing the query over `tree`, for callers that drive
+    /// it themselves. Call `exec` before `next`.
+    pub fn runtimeFor(
+        self: *Query,
+        tree: *ts.Tree,
+        source: []const u8,
+        scratch_allocator: Allocator,
+        partition: ?runtime.Partition,
+    ) runtime.Runtime {
+        return runtime.Runtime.init(.{
+            .tree = tree,
+            .source = source,
+            .code = self.program_image.code,
+            .constants = self.program_image.constants,
+            .regexes = self.program_image.regexes,
+            .regex_sets = &self.program_image.regex_sets,
+            .strings = self.program_image.strings,
+            .reachability = if (self.program_image.reachability) |*r| r else null,
+            .partition = partition,
+            .variable_count = self.program_image.variable_count,
+            .allocator = scratch_allocator,
+        });
+    }
 };
+
+const testing = std.testing;
+
+test "streamed values serialize like collected ones" {
+    var single_threaded = std.Io.Threaded.init_single_threaded;
+    var eng = try Engine.init(.{ .allocator = testing.allocator, .io = single_threaded.io() });
+    defer eng.deinit();
+    var query = try eng.compile(
+        \\with @root > function_definition as @fn
+        \\select { name: @fn.declarator, zeta: [ 'x', @fn.body ], alpha: @fn.body }
+    , .c);
+    defer query.deinit();
+    const source = "int main(void) { return 0; }\nvoid f(int x) {}\n";
+
+    var collected = try query.run(source, testing.allocator, testing.allocator);
+    defer collected.deinit();
+    var expected: std.Io.Writer.Allocating = .init(testing.allocator);
+    defer expected.deinit();
+    try std.json.Stringify.value(collected.values.items, .{}, &expected.writer);
+
+    var context: RunContext = .{};
+    defer context.deinit();
+    var stream = try query.streamIn(&context, source, testing.allocator);
+    defer stream.deinit();
+    var actual: std.Io.Writer.Allocating = .init(testing.allocator);
+    defer actual.deinit();
+    var jws: std.json.Stringify = .{ .writer = &actual.writer };
+    try jws.beginArray();
+    while (try stream.next()) |v| try v.jsonStringify(&jws);
+    try jws.endArray();
+
+    try testing.expectEqual(2, collected.values.items.len);
+    try testing.expectEqualStrings(expected.written(), actual.written());
+}
+
+test "runs over a caller's tree" {
+    var single_threaded = std.Io.Threaded.init_single_threaded;
+    var eng = try Engine.init(.{ .allocator = testing.allocator, .io = single_threaded.io() });
+    defer eng.deinit();
+    var query = try eng.compile("with @root > function_definition as @fn select @fn.declarator", .c);
+    defer query.deinit();
+    const source = "int main(void) { return 0; }\nvoid f(int x) {}\n";
+
+    var parsed = try query.run(source, testing.allocator, testing.allocator);
+    defer parsed.deinit();
+    var expected: std.Io.Writer.Allocating = .init(testing.allocator);
+    defer expected.deinit();
+    try std.json.Stringify.value(parsed.values.items, .{}, &expected.writer);
+
+    var context: RunContext = .{};
+    defer context.deinit();
+    const tree = (try context.parserFor(.c)).parseString(source, null).?;
+    defer tree.destroy();
+    var borrowed = try query.runTree(tree, source, testing.allocator, testing.allocator);
+    defer borrowed.deinit();
+    var actual: std.Io.Writer.Allocating = .init(testing.allocator);
+    defer actual.deinit();
+    try std.json.Stringify.value(borrowed.values.items, .{}, &actual.writer);
+
+    try testing.expectEqual(2, borrowed.values.items.len);
+    try testing.expectEqualStrings(expected.written(), actual.written());
+    try testing.expectEqual(std.Io.Duration.zero, borrowed.stats.parse_time);
+
+    const python_tree = (try context.parserFor(.python)).parseString("def main(): pass\n", null).?;
+    defer python_tree.destroy();
+    try testing.expectError(error.TreeLanguageMismatch, query.runTree(python_tree, "def main(): pass\n", testing.allocator, testing.allocator));
+}
+
+test "keyword prefilter can be turned off" {
+    var single_threaded = std.Io.Threaded.init_single_threaded;
+    const query_source = "with @root >> if_statement as @s select @s";
+    const source = "int x;\n";
+
+    var eng = try Engine.init(.{ .allocator = testing.allocator, .io = single_threaded.io() });
+    defer eng.deinit();
+    var query = try eng.compile(query_source, .c);
+    defer query.deinit();
+    try testing.expect(!query.admits(source));
+
+    var all_files = try Engine.init(.{ .allocator = testing.allocator, .io = single_threaded.io(), .keyword_prefilter = false });
+    defer all_files.deinit();
+    var unfiltered = try all_files.compile(query_source, .c);
+    defer unfiltered.deinit();
+    try testing.expect(unfiltered.admits(source));
+}
+
+test "node text options" {
+    try testing.expectEqualStrings("int", NodeText.apply(.{ .truncate = 3 }, "int x;").?);
+    // Not through the middle of "é".
+    try testing.expectEqualStrings("caf", NodeText.apply(.{ .truncate = 4 }, "café").?);
+    try testing.expectEqual(null, NodeText.apply(.omit, "int x;"));
+
+    var single_threaded = std.Io.Threaded.init_single_threaded;
+    var eng = try Engine.init(.{ .allocator = testing.allocator, .io = single_threaded.io() });
+    defer eng.deinit();
+    var query = try eng.compile("with @root > function_definition as @fn select @fn", .c);
+    defer query.deinit();
+    const source = "int main(void) { return 0; }\n";
+
+    var context: RunContext = .{};
+    defer context.deinit();
+    var stream = try query.streamIn(&context, source, testing.allocator);
+    defer stream.deinit();
+    stream.options = .{ .node_text = .{ .truncate = 8 }, .copy_text = false };
+    var result = try stream.collect(testing.allocator);
+    defer result.deinit();
+
+    const node = result.values.items[0].node;
+    try testing.expectEqualStrings("function_definition", node.kind);
+    try testing.expectEqualStrings("int main", node.text.?);
+    try testing.expect(!node.owns_text);
+    try testing.expectEqual(@intFromPtr(source.ptr), @intFromPtr(node.text.?.ptr));
+}
+
+test "slices of a run add up to the whole" {
+    var single_threaded = std.Io.Threaded.init_single_threaded;
+    var eng = try Engine.init(.{ .allocator = testing.allocator, .io = single_threaded.io() });
+    defer eng.deinit();
+    var query = try eng.compile(
+        \\with @root >> call_expression as @call
+        \\select { call: @call.function, args: @call.arguments }
+    , .c);
+    defer query.deinit();
+    const source =
+        \\int main(void) { f(1); g(h(2)); return 0; }
+        \\void k(void) { f(3); }
+        \\void l(void) {}
+        \\void m(void) { g(4); g(5); }
+        \\
+    ;
+
+    var whole = try query.run(source, testing.allocator, testing.allocator);
+    defer whole.deinit();
+    var expected: std.Io.Writer.Allocating = .init(testing.allocator);
+    defer expected.deinit();
+    try std.json.Stringify.value(whole.values.items, .{}, &expected.writer);
+
+    var context: RunContext = .{};
+    defer context.deinit();
+    const source_parser = try context.parserFor(.c);
+    const tree = source_parser.parseString(source, null).?;
+    defer tree.destroy();
+
+    for ([_]usize{ 1, 2, 3, 7, source.len + 5 }) |count| {
+        var actual: std.Io.Writer.Allocating = .init(testing.allocator);
+        defer actual.deinit();
+        var jws: std.json.Stringify = .{ .writer = &actual.writer };
+        try jws.beginArray();
+        for (0..count) |index| {
+            var stream = (try query.streamTreeSlice(tree, source, testing.allocator, index, count)).?;
+            defer stream.deinit();
+            while (try stream.next()) |v| try v.jsonStringify(&jws);
+        }
+        try jws.endArray();
+        try testing.expectEqualStrings(expected.written(), actual.written());
+    }
+
+    // A second traversal from the root depends on the prelude.
+    var unsliceable = try eng.compile(
+        \\with @root > function_definition as @f, @root > declaration as @d
+        \\select @f
+    , .c);
+    defer unsliceable.deinit();
+    try testing.expectEqual(null, try unsliceable.streamTreeSlice(tree, source, testing.allocator, 0, 2));
+}
@@ -0,0 +1,562 @@
+//! On-disk format for compiled queries.
+//!
+//! An image is a header followed by fixed-size sections, each aligned to 8
+//! bytes, and a blob of string data. Sections refer to each other and to the
+//! blob by byte offset, so an image can be mapped anywhere and its code,
+//! strings, prefilter and regex set membership used in place. Regexes are
+//! stored as pattern source and compiled on load; grammar reachability is
+//! rebuilt from the language.
+//! Code refers to node kinds and fields by the grammar's ids, so the header
+//! records which build of the grammar it was compiled against.
+//!
+//! Integers are in native byte order. An image written on a machine of the
+//! other endianness is rejected rather than converted.
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+const runtime = @import("runtime.zig");
+const Code = runtime.Code;
+const Op = runtime.Op;
+const Operand = runtime.Operand;
+const Value = runtime.Value;
+const ProgramImage = runtime.ProgramImage;
+const Prefilter = runtime.Prefilter;
+const pcre2 = @import("regex.zig");
+const Language = @import("language.zig").Language;
+const Reachability = @import("reachability.zig").Reachability;
+
+pub const magic = "TQLC".*;
+/// Bump whenever the layout or the bytecode changes.
+pub const version: u32 = 5;
+const byte_order_mark: u32 = 0x01020304;
+const section_alignment = 8;
+
+pub const Error = error{
+    InvalidImage,
+    UnsupportedVersion,
+    /// Compiled against another build of the language's grammar.
+    GrammarMismatch,
+};
+
+/// Byte range of a blob string, or offset and element count of a section.
+const Extent = extern struct {
+    offset: u32 = 0,
+    len: u32 = 0,
+};
+
+/// Identifies a build of a grammar. Kind and field ids are only meaningful
+/// for the grammar they came from.
+const Grammar = extern struct {
+    kind_count: u32,
+    field_count: u32,
+    /// Hash of the grammar's node-types.json.
+    node_types_hash: u64,
+
+    fn of(language: Language) Grammar {
+        const ts_language = language.getTreeSitterLanguage();
+        return .{
+            .kind_count = ts_language.nodeKindCount(),
+            .field_count = ts_language.fieldCount(),
+            .node_types_hash = std.hash.Wyhash.hash(0, language.nodeTypes()),
+        };
+    }
+};
+
+const Header = extern struct {
+    magic: [4]u8,
+    version: u32,
+    byte_order: u32,
+    variable_count: u32,
+    /// Name of the language, in the blob.
+    language: Extent,
+    grammar: Grammar,
+    code: Extent,
+    constants: Extent,
+    /// Extents of the string pool's entries.
+    strings: Extent,
+    /// Extents of the regex patterns.
+    regexes: Extent,
+    variables: Extent,
+    /// `Prefilter.clause_ends` and `Prefilter.literals`.
+    prefilter_clause_ends: Extent,
+    prefilter_literals: Extent,
+    /// `RegexSets.set_of`: a set per regex, or empty.
+    regex_sets: Extent,
+};
+
+const Constant = extern struct {
+    tag: u8,
+    padding: [7]u8 = @splat(0),
+    payload: u64,
+};
+
+const Variable = extern struct {
+    id: runtime.VariableId,
+    name: Extent,
+};
+
+/// Serialize `image`, compiled for `language`.
+pub fn write(writer: *std.Io.Writer, image: *const ProgramImage, language: Language) !void {
+    var offset: u32 = @sizeOf(Header);
+    const code = reserve(&offset, Code, image.code.len);
+    const constants = reserve(&offset, Constant, image.constants.len);
+    const strings = reserve(&offset, Extent, image.strings.len);
+    const regexes = reserve(&offset, Extent, image.regex_sources.len);
+    const variables = reserve(&offset, Variable, image.variable_map.count());
+    const prefilter_clause_ends = reserve(&offset, u32, image.prefilter.clause_ends.len);
+    const prefilter_literals = reserve(&offset, runtime.StringId, image.prefilter.literals.len);
+    const regex_sets = reserve(&offset, u32, image.regex_sets.set_of.len);
+
+    // Blob entries are NUL-terminated, for C consumers of the strings.
+    offset = std.mem.alignForward(u32, offset, section_alignment);
+    var blob = Blob{ .offset = offset };
+    const header = Header{
+        .magic = magic,
+        .version = version,
+        .byte_order = byte_order_mark,
+        .variable_count = image.variable_count,
+        .language = blob.add(language.name()),
+        .grammar = .of(language),
+        .code = code,
+        .constants = constants,
+        .strings = strings,
+        .regexes = regexes,
+        .variables = variables,
+        .prefilter_clause_ends = prefilter_clause_ends,
+        .prefilter_literals = prefilter_literals,
+        .regex_sets = regex_sets,
+    };
+
+    var written: u32 = 0;
+    try writeBytes(writer, &written, std.mem.asBytes(&header));
+
+    try pad(writer, &written, code.offset);
+    try writeBytes(writer, &written, std.mem.sliceAsBytes(image.code));
+
+    try pad(writer, &written, constants.offset);
+    for (image.constants) |value| {
+        const constant = try encodeConstant(value);
+        try writeBytes(writer, &written, std.mem.asBytes(&constant));
+    }
+
+    try pad(writer, &written, strings.offset);
+    for (image.strings) |str| {
+        try writeBytes(writer, &written, std.mem.asBytes(&blob.add(str)));
+    }
+
+    try pad(writer, &written, regexes.offset);
+    for (image.regex_sources) |src| {
+        try writeBytes(writer, &written, std.mem.asBytes(&blob.add(src)));
+    }
+
+    try pad(writer, &written, variables.offset);
+    var variable_it = image.variable_map.iterator();
+    while (variable_it.next()) |entry| {
+        const variable = Variable{ .id = entry.key_ptr.*, .name = blob.add(entry.value_ptr.*) };
+        try writeBytes(writer, &written, std.mem.asBytes(&variable));
+    }
+
+    try pad(writer, &written, prefilter_clause_ends.offset);
+    try writeBytes(writer, &written, std.mem.sliceAsBytes(image.prefilter.clause_ends));
+
+    try pad(writer, &written, prefilter_literals.offset);
+    try writeBytes(writer, &written, std.mem.sliceAsBytes(image.prefilter.literals));
+
+    try pad(writer, &written, regex_sets.offset);
+    try writeBytes(writer, &written, std.mem.sliceAsBytes(image.regex_sets.set_of));
+
+    // Same order as the extents were handed out above.
+    try pad(writer, &written, offset);
+    try writeString(writer, &written, language.name());
+    for (image.strings) |str| try writeString(writer, &written, str);
+    for (image.regex_sources) |src| try writeString(writer, &written, src);
+    variable_it = image.variable_map.iterator();
+    while (variable_it.next()) |entry| try writeString(writer, &written, entry.value_ptr.*);
+}
+
+fn reserve(offset: *u32, comptime T: type, len: usize) Extent {
+    const start = std.mem.alignForward(u32, offset.*, section_alignment);
+    offset.* = start + @as(u32, @intCast(len * @sizeOf(T)));
+    return .{ .offset = start, .len = @intCast(len) };
+}
+
+const Blob = struct {
+    offset: u32,
+
+    fn add(self: *Blob, str: []const u8) Extent {
+        const extent = Extent{ .offset = self.offset, .len = @intCast(str.len) };
+        self.offset += extent.len + 1;
+        return extent;
+    }
+};
+
+fn writeBytes(writer: *std.Io.Writer, written: *u32, bytes: []const u8) !void {
+    try writer.writeAll(bytes);
+    written.* += @intCast(bytes.len);
+}
+
+fn writeString(writer: *std.Io.Writer, written: *u32, str: []const u8) !void {
+    try writeBytes(writer, written, str);
+    try writeBytes(writer, written, &[_]u8{0});
+}
+
+fn pad(writer: *std.Io.Writer, written: *u32, offset: u32) !void {
+    const start = std.mem.alignForward(u32, written.*, section_alignment);
+    std.debug.assert(start == std.mem.alignForward(u32, offset, section_alignment));
+    try writer.splatByteAll(0, start - written.*);
+    written.* = start;
+}
+
+fn encodeConstant(value: Value) error{UnsupportedConstant}!Constant {
+    const payload: u64 = switch (value) {
+        .nothing => 0,
+        .uint => |uint| uint,
+        .string => |id| id,
+        .regex => |id| id,
+        .kind_id => |kind| kind,
+        .field_id => |field| field,
+        // Only produced while running.
+        .text, .range, .node, .record, .list => return error.UnsupportedConstant,
+    };
+    return .{ .tag = @intFromEnum(value), .payload = payload };
+}
+
+pub const Loaded = struct {
+    image: ProgramImage,
+    language: Language,
+};
+
+/// Load an image from `backing`, which must not be `.none`. The returned
+/// image points into it and takes ownership of it; on error the caller
+/// still owns it.
+pub fn load(allocator: Allocator, backing: ProgramImage.Backing) !Loaded {
+    const bytes: []align(section_alignment) const u8 = switch (backing) {
+        .none => unreachable,
+        .mapped => |b| b,
+        .owned => |b| b,
+    };
+
+    const header = (try readArray(Header, bytes, .{ .offset = 0, .len = 1 }))[0];
+    if (!std.mem.eql(u8, &header.magic, &magic)) return error.InvalidImage;
+    if (header.byte_order != byte_order_mark) return error.InvalidImage;
+    if (header.version != version) return error.UnsupportedVersion;
+
+    const language = std.meta.stringToEnum(Language, try readString(bytes, header.language)) orelse
+        return error.InvalidImage;
+    const grammar = Grammar.of(language);
+    if (!std.meta.eql(header.grammar, grammar)) return error.GrammarMismatch;
+
+    const string_extents = try readArray(Extent, bytes, header.strings);
+    const strings = try allocator.alloc([]const u8, string_extents.len);
+    errdefer allocator.free(strings);
+    for (strings, string_extents) |*str, extent| str.* = try readString(bytes, extent);
+
+    const regex_extents = try readArray(Extent, bytes, header.regexes);
+    const regex_sources = try allocator.alloc([]const u8, regex_extents.len);
+    errdefer allocator.free(regex_sources);
+    for (regex_sources, regex_extents) |*src, extent| src.* = try readString(bytes, extent);
+
+    const encoded_constants = try readArray(Constant, bytes, header.constants);
+    const constants = try allocator.alloc(Value, encoded_constants.len);
+    errdefer allocator.free(constants);
+    for (constants, encoded_constants) |*value, constant| {
+        value.* = try decodeConstant(constant, .{
+            .strings = strings.len,
+            .regexes = regex_sources.len,
+            .kinds = grammar.kind_count,
+            .fields = grammar.field_count,
+        });
+    }
+
+    const code = try readCode(bytes, header.code);
+    try validateCode(code, .{
+        .constants = constants.len,
+        .strings = strings.len,
+        .variables = header.variable_count,
+        .kinds = grammar.kind_count,
+        .fields = grammar.field_count,
+    });
+
+    var variable_map = std.hash_map.AutoHashMap(runtime.VariableId, []const u8).init(allocator);
+    errdefer variable_map.deinit();
+    for (try readArray(Variable, bytes, header.variables)) |variable| {
+        try variable_map.put(variable.id, try readString(bytes, variable.name));
+    }
+
+    const prefilter = Prefilter{
+        .clause_ends = try readArray(u32, bytes, header.prefilter_clause_ends),
+        .literals = try readArray(runtime.StringId, bytes, header.prefilter_literals),
+    };
+    try validatePrefilter(prefilter, strings);
+
+    const regexes = try allocator.alloc(pcre2.Regex, regex_sources.len);
+    errdefer allocator.free(regexes);
+    var compiled: usize = 0;
+    errdefer for (regexes[0..compiled]) |*regex| regex.deinit();
+    for (regexes, regex_sources) |*regex, src| {
+        regex.* = try pcre2.Regex.compile(src);
+        compiled += 1;
+    }
+
+    const regex_set_of = try readArray(u32, bytes, header.regex_sets);
+    var regex_sets = runtime.RegexSets.init(allocator, regex_set_of, regex_sources) catch |err| switch (err) {
+        error.InvalidRegexSets => return error.InvalidImage,
+        error.OutOfMemory => |e| return e,
+    };
+    errdefer regex_sets.deinit(allocator);
+
+    const reachability = try Reachability.init(allocator, language.getTreeSitterLanguage(), language.nodeTypes());
+
+    return .{
+        .image = .{
+            .code = code,
+            .constants = constants,
+            .regexes = regexes,
+            .regex_sources = regex_sources,
+            .strings = strings,
+            .variable_map = variable_map,
+            .variable_count = header.variable_count,
+            .reachability = reachability,
+            .prefilter = prefilter,
+            .regex_sets = regex_sets,
+            .backing = backing,
+            .allocator = allocator,
+        },
+        .language = language,
+    };
+}
+
+fn readArray(comptime T: type, bytes: []align(section_alignment) const u8, extent: Extent) Error![]const T {
+    const size = std.math.mul(usize, extent.len, @sizeOf(T)) catch return error.InvalidImage;
+    const end = std.math.add(usize, extent.offset, size) catch return error.InvalidImage;
+    if (end > bytes.len or extent.offset % @alignOf(T) != 0) return error.InvalidImage;
+    return @alignCast(std.mem.bytesAsSlice(T, bytes[extent.offset..end]));
+}
+
+fn readString(bytes: []const u8, extent: Extent) Error![]const u8 {
+    const end = @as(usize, extent.offset) + extent.len;
+    if (end >= bytes.len or bytes[end] != 0) return error.InvalidImage;
+    return bytes[extent.offset..end];
+}
+
+/// Like `readArray`, but checks every opcode before the bytes are treated
+/// as `Code`.
+fn readCode(bytes: []align(section_alignment) const u8, extent: Extent) Error![]const Code {
+    const raw = try readArray([@sizeOf(Code)]u8, bytes, extent);
+    for (raw) |code_bytes| {
+        _ = std.meta.intToEnum(Op, code_bytes[@offsetOf(Code, "op")]) catch return error.InvalidImage;
+    }
+    return readArray(Code, bytes, extent);
+}
+
+fn decodeConstant(constant: Constant, limits: struct {
+    strings: usize,
+    regexes: usize,
+    kinds: u32,
+    fields: u32,
+}) Error!Value {
+    const tag = std.meta.intToEnum(std.meta.Tag(Value), constant.tag) catch return error.InvalidImage;
+    const payload = constant.payload;
+    return switch (tag) {
+        .nothing => .nothing,
+        .uint => .{ .uint = payload },
+        .string => if (payload < limits.strings) .{ .string = @intCast(payload) } else error.InvalidImage,
+        .regex => if (payload < limits.regexes) .{ .regex = @intCast(payload) } else error.InvalidImage,
+        .kind_id => if (payload < limits.kinds) .{ .kind_id = @intCast(payload) } else error.InvalidImage,
+        .field_id => if (payload <= limits.fields) .{ .field_id = @intCast(payload) } else error.InvalidImage,
+        .text, .range, .node, .record, .list => error.InvalidImage,
+    };
+}
+
+/// Check the invariants `Prefilter.admits` relies on: non-empty clauses
+/// covering every literal, and non-empty literals.
+fn validatePrefilter(prefilter: Prefilter, strings: []const []const u8) Error!void {
+    if (prefilter.clause_ends.len > Prefilter.max_clauses) return error.InvalidImage;
+    if (prefilter.literals.len > Prefilter.max_literals) return error.InvalidImage;
+    var start: u32 = 0;
+    for (prefilter.clause_ends) |end| {
+        if (end <= start) return error.InvalidImage;
+        start = end;
+    }
+    if (start != prefilter.literals.len) return error.InvalidImage;
+    for (prefilter.literals) |id| {
+        if (id >= strings.len or strings[id].len == 0) return error.InvalidImage;
+    }
+}
+
+const Limits = struct {
+    constants: usize,
+    strings: usize,
+    variables: usize,
+    /// Of the image's grammar. Kind ids are below `kinds`, field ids run
+    /// from 1 to `fields`.
+    kinds: u32,
+    fields: u32,
+};
+
+/// Check everything the runtime indexes with without bounds checks of its
+/// own. Jump targets don't need it, since running off the end of the code
+/// is already an error.
+fn validateCode(code: []const Code, limits: Limits) Error!void {
+    for (code) |c| {
+        switch (c.op) {
+            .halt, .jmp => try checkMode(runtime.Condition, c.mode),
+            .rel => {
+                try checkMode(runtime.Relation, c.mode);
+                try checkOperand(c.a, limits);
+                try checkOperand(c.b, limits);
+            },
+            .begin_build => try checkMode(runtime.Vector, c.mode),
+            .asn => {
+                try checkVariable(c.a, limits);
+                try checkOperand(c.b, limits);
+            },
+            .yield, .push_build => try checkOperand(c.a, limits),
+            .push_build_named => {
+                try checkOperand(c.a, limits);
+                if (c.b >= limits.strings) return error.InvalidImage;
+            },
+            .probe_aggregate => {
+                try checkMode(runtime.AggregatingValue, c.mode);
+                try checkVariable(c.b, limits);
+            },
+            .end_build => try checkVariable(c.a, limits),
+            .trv_field => try checkField(c.a, limits),
+            .trv_child_of_kind, .trv_descendant_of_kind => try checkKind(c.a, limits),
+            .trv_field_of_kind => {
+                try checkField(c.a, limits);
+                try checkKind(c.b, limits);
+            },
+            .noop, .trv_child, .trv_descendant, .trv_variable => {},
+            .probe_exists, .probe_nexists, .call, .ret, .panic => {},
+        }
+    }
+}
+
+fn checkMode(comptime E: type, mode: u8) Error!void {
+    _ = std.meta.intToEnum(E, mode) catch return error.InvalidImage;
+}
+
+fn checkKind(id: u32, limits: Limits) Error!void {
+    if (id >= limits.kinds) return error.InvalidImage;
+}
+
+fn checkField(id: u32, limits: Limits) Error!void {
+    if (id == 0 or id > limits.fields) return error.InvalidImage;
+}
+
+fn checkVariable(id: u32, limits: Limits) Error!void {
+    if (id >= limits.variables) return error.InvalidImage;
+}
+
+fn checkOperand(raw: u32, limits: Limits) Error!void {
+    const kind = std.meta.intToEnum(Operand.Kind, raw >> 30) catch return error.InvalidImage;
+    const index = raw & std.math.maxInt(u30);
+    const ok = switch (kind) {
+        .constant => index < limits.constants,
+        .node => index < std.meta.fields(runtime.NodeValueSource).len,
+        // Reads of unset or out-of-range variables are allowed.
+        .variable => true,
+    };
+    if (!ok) return error.InvalidImage;
+}
+
+const testing = std.testing;
+
+fn compileForTest(query: []const u8) !ProgramImage {
+    const Parser = @import("parser.zig").Parser;
+    const Compiler = @import("compiler.zig").Compiler;
+
+    var parser = try Parser.init(testing.allocator);
+    defer parser.deinit();
+    const ast = try parser.parse(query);
+    defer ast.deinit(testing.allocator);
+
+    var compiler = Compiler.init(testing.allocator, Language.c.getTreeSitterLanguage());
+    defer compiler.deinit();
+    try compiler.loadNodeTypes(Language.c.nodeTypes());
+    compiler.loadKeywords(Language.c.keywords());
+    return compiler.compile(testing.allocator, ast);
+}
+
+fn writeForTest(image: *const ProgramImage) ![]align(section_alignment) u8 {
+    var out: std.Io.Writer.Allocating = .init(testing.allocator);
+    defer out.deinit();
+    try write(&out.writer, image, .c);
+    const bytes = try testing.allocator.alignedAlloc(u8, .fromByteUnits(section_alignment), out.written().len);
+    @memcpy(bytes, out.written());
+    return bytes;
+}
+
+test "images round trip" {
+    var image = try compileForTest(
+        \\with @root > function_definition as @fn,
+        \\     @fn.declarator as @d
+        \\where @d ~ /^ma(in)?$/ or @d ~ /^init_/
+        \\select { name: @d, kind: 'function' }
+    );
+    defer image.deinit();
+
+    const bytes = try writeForTest(&image);
+    var loaded = load(testing.allocator, .{ .owned = bytes }) catch |err| {
+        testing.allocator.free(bytes);
+        return err;
+    };
+    defer loaded.image.deinit();
+
+    try testing.expectEqual(Language.c, loaded.language);
+    try testing.expectEqualSlices(u8, std.mem.sliceAsBytes(image.code), std.mem.sliceAsBytes(loaded.image.code));
+    try testing.expectEqual(image.constants.len, loaded.image.constants.len);
+    for (image.constants, loaded.image.constants) |expected, actual| {
+        try testing.expect(std.meta.eql(expected, actual));
+    }
+    try testing.expectEqual(image.variable_count, loaded.image.variable_count);
+    try testing.expectEqual(image.strings.len, loaded.image.strings.len);
+    for (image.strings, loaded.image.strings) |expected, actual| {
+        try testing.expectEqualStrings(expected, actual);
+    }
+    try testing.expectEqual(image.regex_sources.len, loaded.image.regexes.len);
+    try testing.expectEqualSlices(u32, image.prefilter.clause_ends, loaded.image.prefilter.clause_ends);
+    try testing.expectEqualSlices(runtime.StringId, image.prefilter.literals, loaded.image.prefilter.literals);
+    try testing.expectEqual(1, image.regex_sets.sets.len);
+    try testing.expectEqualSlices(u32, image.regex_sets.set_of, loaded.image.regex_sets.set_of);
+    try testing.expectEqual(image.regex_sets.sets.len, loaded.image.regex_sets.sets.len);
+    try testing.expectEqual(image.variable_map.count(), loaded.image.variable_map.count());
+}
+
+test "corrupt images are rejected" {
+    var image = try compileForTest("with @root > function_definition as @fn select @fn");
+    defer image.deinit();
+
+    const bytes = try writeForTest(&image);
+    defer testing.allocator.free(bytes);
+
+    const original = bytes[0];
+    bytes[0] = 'X';
+    try testing.expectError(error.InvalidImage, load(testing.allocator, .{ .owned = bytes }));
+    bytes[0] = original;
+
+    const header: *Header = @ptrCast(bytes.ptr);
+    header.version += 1;
+    try testing.expectError(error.UnsupportedVersion, load(testing.allocator, .{ .owned = bytes }));
+    header.version -= 1;
+
+    // Compiled against another build of the grammar.
+    header.grammar.node_types_hash +%= 1;
+    try testing.expectError(error.GrammarMismatch, load(testing.allocator, .{ .owned = bytes }));
+    header.grammar.node_types_hash -%= 1;
+
+    // A kind id the grammar doesn't have.
+    const code: []Code = @alignCast(std.mem.bytesAsSlice(Code, bytes[header.code.offset..][0 .. header.code.len * @sizeOf(Code)]));
+    const trv = for (code) |*c| {
+        if (c.op == .trv_child_of_kind) break c;
+    } else return error.TestUnexpectedResult;
+    const kind = trv.a;
+    trv.a = Language.c.getTreeSitterLanguage().nodeKindCount();
+    try testing.expectError(error.InvalidImage, load(testing.allocator, .{ .owned = bytes }));
+    trv.a = kind;
+
+    // An opcode past the end of `Op`.
+    bytes[header.code.offset] = 0xff;
+    try testing.expectError(error.InvalidImage, load(testing.allocator, .{ .owned = bytes }));
+}
@@ -41,28 +41,85 @@ pub const Language = enum {
         };
     }
 
-    pub fn matchesFileName(self: Language, file_name: []const u8) bool {
-        // IMPROVE: this is terribly inefficient. We should define a set of
-        // file extensions per grammar and do a more efficient string matching
-        // algorithm
+    /// The grammar's node-types.json, embedded at build time.
+    pub fn nodeTypes(self: Language) []const u8 {
+        return switch (self) {
+            .cpp => @embedFile("node-types/cpp"),
+            .c => @embedFile("node-types/c"),
+            .go => @embedFile("node-types/go"),
+            .javascript => @embedFile("node-types/javascript"),
+            .python => @embedFile("node-types/python"),
+            .rust => @embedFile("node-types/rust"),
+            .tsx => @embedFile("node-types/tsx"),
+            .typescript => @embedFile("node-types/typescript"),
+            .zig => @embedFile("node-types/zig"),
+        };
+    }
+
+    /// Keywords every node of a kind contains, one kind per line followed
+    /// by its keywords longest first. Derived from grammar.json at build
+    /// time; see src/tools/grammar_keywords.zig.
+    pub fn keywords(self: Language) []const u8 {
+        return switch (self) {
+            .cpp => @embedFile("keywords/cpp"),
+            .c => @embedFile("keywords/c"),
+            .go => @embedFile("keywords/go"),
+            .javascript => @embedFile("keywords/javascript"),
+            .python => @embedFile("keywords/python"),
+            .rust => @embedFile("keywords/rust"),
+            .tsx => @embedFile("keywords/tsx"),
+            .typescript => @embedFile("keywords/typescript"),
+            .zig => @embedFile("keywords/zig"),
+        };
+    }
+
+    /// Extensions of the language's source files, without the dot.
+    pub fn extensions(self: Language) []const []const u8 {
         return switch (self) {
-            .cpp => std.mem.endsWith(u8, file_name, ".cpp") or
-                std.mem.endsWith(u8, file_name, ".cc") or
-                std.mem.endsWith(u8, file_name, ".h") or
-                std.mem.endsWith(u8, file_name, ".hpp"),
-            .c => std.mem.endsWith(u8, file_name, ".c") or
-                std.mem.endsWith(u8, file_name, ".h"),
-            .go => std.mem.endsWith(u8, file_name, ".go"),
-            .javascript => std.mem.endsWith(u8, file_name, ".js"),
-            .python => std.mem.endsWith(u8, file_name, ".py"),
-            .rust => std.mem.endsWith(u8, file_name, ".rs"),
-            .tsx => std.mem.endsWith(u8, file_name, ".tsx") or std.mem.endsWith(u8, file_name, ".ts"),
-            .typescript => std.mem.endsWith(u8, file_name, ".ts"),
-            .zig => std.mem.endsWith(u8, file_name, ".zig"),
+            .cpp => &.{ "cpp", "cc", "h", "hpp" },
+            .c => &.{ "c", "h" },
+            .go => &.{"go"},
+            .javascript => &.{"js"},
+            .python => &.{"py"},
+            .rust => &.{"rs"},
+            .tsx => &.{ "tsx", "ts" },
+            .typescript => &.{"ts"},
+            .zig => &.{"zig"},
         };
     }
+
+    /// Whether `file_name` has one of the language's `extensions`. A lookup
+    /// in a table built at compile time.
+    pub fn matchesFileName(self: Language, file_name: []const u8) bool {
+        const dot = std.mem.lastIndexOfScalar(u8, file_name, '.') orelse return false;
+        return extension_tables.get(self).has(file_name[dot + 1 ..]);
+    }
+};
+
+const ExtensionTable = std.StaticStringMap(void);
+
+const extension_tables: std.EnumArray(Language, ExtensionTable) = blk: {
+    var tables: std.EnumArray(Language, ExtensionTable) = undefined;
+    for (std.enums.values(Language)) |language| {
+        const extensions = language.extensions();
+        var entries: [extensions.len]struct { []const u8 } = undefined;
+        for (&entries, extensions) |*entry, extension| entry.* = .{extension};
+        tables.set(language, ExtensionTable.initComptime(entries));
+    }
+    break :blk tables;
 };
 
+test "file names by extension" {
+    try std.testing.expect(Language.c.matchesFileName("sqlite3.c"));
+    try std.testing.expect(Language.c.matchesFileName("src/parser.h"));
+    try std.testing.expect(!Language.c.matchesFileName("main.cc"));
+    try std.testing.expect(Language.cpp.matchesFileName("main.cc"));
+    try std.testing.expect(!Language.typescript.matchesFileName("index.tsx"));
+    try std.testing.expect(Language.tsx.matchesFileName("index.d.ts"));
+    try std.testing.expect(!Language.zig.matchesFileName("zig"));
+    try std.testing.expect(!Language.python.matchesFileName("script.py.bak"));
+}
+
 extern fn tree_sitter_cpp() *ts.Language;
 extern fn tree_sitter_c() *ts.Language;
 extern fn tree_sitter_go() *ts.Language;
@@ -46,7 +46,16 @@ pub fn main(init: std.process.Init) !u8 {
         \\-w, --workers <usize>       Number of workers
         \\-l, --language <language>   Language
         \\-f, --from-file <file>      Load the query from a file
+        \\-i, --image <file>          Load a query compiled with `tql compile`
+        \\-o, --output <file>         Where `tql compile` writes the image
         \\    --progress              Show progress
+        \\    --node-text <node_text> Node text in results: full, none, or a byte limit
+        \\    --largest-first         Run the largest files first
+        \\    --split <usize>         Split files of at least this many bytes across workers
+        \\    --no-ignore             Search files that .gitignore and .ignore exclude
+        \\    --files-from <file>     Also search the files listed in a file, or stdin for -
+        \\-0, --null                  Paths in --files-from end with NUL, not newline
+        \\    --no-keyword-skip       Parse files that lack a needed keyword
         \\<query>
         \\<file>...
     );
@@ -58,6 +67,7 @@ pub fn main(init: std.process.Init) !u8 {
         .usize = clap.parsers.int(usize, 10),
         .file = clap.parsers.string,
         .query = clap.parsers.string,
+        .node_text = parseNodeText,
     };
 
     var diag = clap.Diagnostic{};
@@ -83,28 +93,39 @@ pub fn main(init: std.process.Init) !u8 {
         try printVersion(stdout);
         return @intFromEnum(ExitCode.success);
     }
-    // If --from-file, then this will be the query file.
-    // Otherwise, this is the first target file.
+    // If --from-file or --image, then this will be the first target file.
+    // Otherwise, this is the query.
     const query_or_first_file = res.positionals[0] orelse {
         try stderr.print("Error: query is required\n", .{});
         try printUsage(stderr);
         return @intFromEnum(ExitCode.invalid_args);
     };
 
+    if (std.mem.eql(u8, query_or_first_file, "compile")) {
+        return compileImage(allocator, init.io, stderr, .{
+            .query_paths = res.positionals[1],
+            .output_path = res.args.output,
+            .language = res.args.language,
+            .keyword_prefilter = res.args.@"no-keyword-skip" == 0,
+        });
+    }
+
+    const query_in_file = res.args.@"from-file" != null or res.args.image != null;
     const query = if (res.args.@"from-file") |query_file| blk: {
         const file = try std.Io.Dir.cwd().openFile(init.io, query_file, .{});
         defer file.close(init.io);
         var file_reader = file.reader(init.io, &.{});
         const contents = try file_reader.interface.allocRemaining(allocator, .limited(10 * 1024 * 1024));
         break :blk contents;
+    } else if (res.args.image != null) blk: {
+        break :blk try allocator.dupe(u8, "");
     } else blk: {
         const buf = try allocator.dupe(u8, query_or_first_file);
         break :blk buf;
     };
     defer allocator.free(query);
 
-    // IMPROVE: read stdin if files.len = 0
-    const files = if (res.args.@"from-file") |_| blk: {
+    const files = if (query_in_file) blk: {
         const buf = try allocator.alloc([]const u8, res.positionals[1].len + 1);
         buf[0] = query_or_first_file;
         @memcpy(buf[1 .. res.positionals[1].len + 1], res.positionals[1]);
@@ -115,22 +136,43 @@ pub fn main(init: std.process.Init) !u8 {
         break :blk buf;
     };
     defer allocator.free(files);
+    // With nothing to search, take the list from stdin, as in
+    // `git ls-files -z | tql -0 ...`.
+    const files_from: ?[]const u8 = res.args.@"files-from" orelse if (files.len == 0) "-" else null;
+
+    // The keyword prefilter is part of the image; it is chosen when
+    // compiling one.
+    if (res.args.image != null and res.args.@"no-keyword-skip" != 0) {
+        try stderr.print("Error: --no-keyword-skip has no effect with --image; pass it to `tql compile`\n", .{});
+        try printUsage(stderr);
+        return @intFromEnum(ExitCode.invalid_args);
+    }
 
-    const language = res.args.language orelse {
+    // Images know their language.
+    const language = res.args.language;
+    if (language == null and res.args.image == null) {
         try stderr.print("Error: --language is required\n", .{});
         try printUsage(stderr);
         return @intFromEnum(ExitCode.invalid_args);
-    };
+    }
 
     return run(allocator, init.io, stdout, stderr, .{
         .query = query,
+        .image_path = res.args.image,
         .query_target_paths = files,
         .format = .json,
         .language = language,
-        .workers = res.args.workers orelse 1,
+        .workers = @max(1, res.args.workers orelse 1),
         .stats = false,
         .verbose = false,
         .progress = res.args.progress != 0,
+        .node_text = res.args.@"node-text" orelse .full,
+        .largest_first = res.args.@"largest-first" != 0,
+        .split_threshold = res.args.split,
+        .respect_ignore = res.args.@"no-ignore" == 0,
+        .files_from = files_from,
+        .null_separated = res.args.null != 0,
+        .keyword_prefilter = res.args.@"no-keyword-skip" == 0,
     }) catch |err| {
         try stderr.print("Error: {}\n", .{err});
         return @intFromEnum(ExitCode.runtime_error);
@@ -139,20 +181,99 @@ pub fn main(init: std.process.Init) !u8 {
 
 const Config = struct {
     query: []const u8,
+    /// If set, run this compiled image instead of compiling `query`.
+    image_path: ?[]const u8 = null,
     query_target_paths: []const []const u8,
     format: OutputFormat,
-    language: Language,
+    language: ?Language,
     workers: usize = 1,
     stats: bool,
     verbose: bool,
     progress: bool,
+    node_text: tql.NodeText = .full,
+    /// Stat files during the walk and run the largest first.
+    largest_first: bool = false,
+    /// See `SharedContext.split_threshold`.
+    split_threshold: ?usize = null,
+    /// Skip what `.gitignore` and `.ignore` files exclude.
+    respect_ignore: bool = true,
+    /// See `SharedContext.files_from`.
+    files_from: ?[]const u8 = null,
+    null_separated: bool = false,
+    /// See `Engine.Config.keyword_prefilter`.
+    keyword_prefilter: bool = true,
 };
 
+fn parseNodeText(in: []const u8) !tql.NodeText {
+    if (std.mem.eql(u8, in, "full")) return .full;
+    if (std.mem.eql(u8, in, "none")) return .omit;
+    return .{ .truncate = try std.fmt.parseInt(u32, in, 10) };
+}
+
 fn printUsage(writer: *std.Io.Writer) !void {
     try writer.print("Usage: tql [OPTIONS] <QUERY> <SOURCE>...\n", .{});
+    try writer.print("       tql compile -l <LANGUAGE> <QUERY FILE> -o <IMAGE>\n", .{});
     try writer.print("Try 'tql --help' for more information.\n", .{});
 }
 
+/// `tql compile`: compile a query once and save it for `--image`.
+fn compileImage(
+    allocator: std.mem.Allocator,
+    io: std.Io,
+    stderr: *std.Io.Writer,
+    x: struct {
+        query_paths: []const []const u8,
+        output_path: ?[]const u8,
+        language: ?Language,
+        keyword_prefilter: bool,
+    },
+) !u8 {
+    if (x.query_paths.len != 1) {
+        try stderr.print("Error: compile takes exactly one query file\n", .{});
+        try printUsage(stderr);
+        return @intFromEnum(ExitCode.invalid_args);
+    }
+    const output_path = x.output_path orelse {
+        try stderr.print("Error: --output is required\n", .{});
+        try printUsage(stderr);
+        return @intFromEnum(ExitCode.invalid_args);
+    };
+    const language = x.language orelse {
+        try stderr.print("Error: --language is required\n", .{});
+        try printUsage(stderr);
+        return @intFromEnum(ExitCode.invalid_args);
+    };
+
+    const query = blk: {
+        const file = try std.Io.Dir.cwd().openFile(io, x.query_paths[0], .{});
+        defer file.close(io);
+        var file_reader = file.reader(io, &.{});
+        break :blk try file_reader.interface.allocRemaining(allocator, .limited(10 * 1024 * 1024));
+    };
+    defer allocator.free(query);
+
+    var engine = try Engine.init(.{
+        .allocator = allocator,
+        .io = io,
+        .keyword_prefilter = x.keyword_prefilter,
+    });
+    defer engine.deinit();
+
+    var compiled = engine.compile(query, language) catch |err| {
+        try stderr.print("Error: {}\n", .{err});
+        return @intFromEnum(ExitCode.compilation_error);
+    };
+    defer compiled.deinit();
+
+    const file = try std.Io.Dir.cwd().createFile(io, output_path, .{});
+    defer file.close(io);
+    var buffer: [4096]u8 = undefined;
+    var file_writer = file.writer(io, &buffer);
+    try compiled.writeImage(&file_writer.interface);
+    try file_writer.interface.flush();
+    return @intFromEnum(ExitCode.success);
+}
+
 fn printVersion(writer: *std.Io.Writer) !void {
     try writer.print("tql version {s}\n", .{VERSION});
 }
@@ -191,21 +312,97 @@ fn progressThread(io: std.Io, p: *Progress, stop: *std.atomic.Value(bool), w: *s
 const PathEntry = struct {
     arena: std.heap.ArenaAllocator,
     path: []const u8,
+    /// Only known when dispatching largest-first.
+    size: u64 = 0,
+
+    fn larger(a: PathEntry, b: PathEntry) bool {
+        return a.size > b.size;
+    }
+
+    fn deinit(self: PathEntry) void {
+        var arena = self.arena;
+        arena.deinit();
+    }
+
+    /// Push `self` to `queue`, freeing it if that fails.
+    fn handOut(self: PathEntry, queue: *PathQueue) !void {
+        queue.push(&.{self}) catch |err| {
+            self.deinit();
+            return err;
+        };
+    }
 };
 
-const PathQueue = tql.ds.BlockingQueue(PathEntry);
+const PathQueue = tql.ds.WorkStealingQueue(PathEntry);
+/// Paths queued before the walker waits for the workers to catch up.
+const path_queue_capacity = 65535;
+
+/// Paths the walker has found but not yet handed out. Entries given to it
+/// are its to free, even when handing them out fails.
+const Dispatch = struct {
+    const chunk_capacity = 64;
+
+    /// Paths go to the workers in chunks, so that the queue is touched once
+    /// per chunk.
+    chunk: [chunk_capacity]PathEntry = undefined,
+    chunk_len: usize = 0,
+    /// When dispatching largest-first, paths wait here and leave largest
+    /// first, one at a time, so that consecutive large files go to
+    /// different workers.
+    by_size: ?*SizeBuffer = null,
+
+    const SizeBuffer = tql.ds.PriorityBuffer(PathEntry, PathEntry.larger);
+    const size_buffer_capacity = 4096;
+
+    fn add(self: *Dispatch, queue: *PathQueue, entry: PathEntry) !void {
+        if (self.by_size) |buffer| {
+            const released = buffer.push(entry) orelse return;
+            return released.handOut(queue);
+        }
+        self.chunk[self.chunk_len] = entry;
+        self.chunk_len += 1;
+        if (self.chunk_len == chunk_capacity) try self.flush(queue);
+    }
+
+    /// Hand out everything still held.
+    fn flush(self: *Dispatch, queue: *PathQueue) !void {
+        if (self.by_size) |buffer| {
+            while (buffer.pop()) |entry| try entry.handOut(queue);
+        }
+        try queue.push(self.chunk[0..self.chunk_len]);
+        self.chunk_len = 0;
+    }
+
+    /// Free everything still held, for a walk that failed.
+    fn discard(self: *Dispatch) void {
+        if (self.by_size) |buffer| {
+            while (buffer.pop()) |entry| entry.deinit();
+        }
+        for (self.chunk[0..self.chunk_len]) |entry| entry.deinit();
+        self.chunk_len = 0;
+    }
+};
 
 const FileStats = struct {
     read_time: std.Io.Duration = .zero,
     parse_time: std.Io.Duration = .zero,
     query_time: std.Io.Duration = .zero,
+    /// From picking the file up to handing in its results.
+    total_time: std.Io.Duration = .zero,
+    /// Files ruled out by the query's prefilter before parsing.
+    skipped: usize = 0,
 };
 
 const FileResult = struct {
     arena: std.heap.ArenaAllocator,
     filename: []const u8,
-    values: std.ArrayList(Value),
+    /// The file's values, already serialized as a JSON array.
+    values_json: []const u8,
+    value_count: usize,
     stats: FileStats,
+    /// Why the file couldn't be read, if it couldn't. Listed paths are not
+    /// checked up front, so they may be missing.
+    read_error: ?anyerror = null,
 
     fn deinit(self: FileResult) void {
         self.arena.deinit();
@@ -227,56 +424,139 @@ const SharedContext = struct {
     result_queue: *ResultQueue,
     path_queue: *PathQueue,
     language: Language,
+    node_text: tql.NodeText,
+    largest_first: bool,
+    /// Files at least this large are split across `workers` threads.
+    split_threshold: ?usize,
+    /// Set while a file is being split. Splits take turns, so that they add
+    /// at most `workers - 1` threads to the pool rather than that many
+    /// each; a large file met during another's split is run whole.
+    splitting: std.atomic.Value(bool) = .init(false),
+    respect_ignore: bool,
+    /// A list of files to search besides `paths`, read as the workers run;
+    /// `-` for stdin. Paths end with a newline, or with NUL if
+    /// `null_separated`.
+    files_from: ?[]const u8,
+    null_separated: bool,
+    workers: usize,
     progress: *Progress,
     io: std.Io,
+    /// Files that couldn't be read. They are reported among the results.
+    unreadable: std.atomic.Value(usize) = .init(0),
+    /// Why the walk, or the reading of `files_from`, stopped early. Files
+    /// queued before that are still searched.
+    walk_error: ?anyerror = null,
 };
 
-fn pushFile(ctx: *SharedContext, path: []const u8) !void {
-    var arena = std.heap.ArenaAllocator.init(ctx.*.allocator);
-    errdefer arena.deinit();
-    const owned = try arena.allocator().dupe(u8, path);
-    try ctx.path_queue.push(.{ .arena = arena, .path = owned });
+fn pushFile(ctx: *SharedContext, dispatch: *Dispatch, dir: std.Io.Dir, sub_path: []const u8, path: []const u8) !void {
+    const entry: PathEntry = blk: {
+        var arena = std.heap.ArenaAllocator.init(ctx.*.allocator);
+        errdefer arena.deinit();
+        const owned = try arena.allocator().dupe(u8, path);
+        // Files that can't be stat'ed are left for the worker to report.
+        const size = if (dispatch.by_size != null)
+            if (dir.statFile(ctx.io, sub_path, .{})) |stat| stat.size else |_| 0
+        else
+            0;
+        break :blk .{ .arena = arena, .path = owned, .size = size };
+    };
+    try dispatch.add(ctx.path_queue, entry);
     _ = ctx.*.progress.total.fetchAdd(1, .monotonic);
 }
 
-fn walkPush(ctx: *SharedContext, path: []const u8) !void {
-    const abs = try std.Io.Dir.realPathFileAbsoluteAlloc(ctx.*.io, path, ctx.allocator);
-    defer ctx.allocator.free(abs);
-    var root_dir = try std.Io.Dir.openDirAbsolute(ctx.*.io, abs, .{
-        .iterate = true,
-    });
+/// Hands the files a walk finds to the dispatch of the thread that found
+/// them.
+const WalkSink = struct {
+    ctx: *SharedContext,
+    dispatches: []Dispatch,
 
-    var walker = try root_dir.walk(ctx.*.allocator);
-    while (try walker.next(ctx.*.io)) |entry| {
-        if (entry.kind == .file and ctx.*.language.matchesFileName(entry.basename)) {
-            const joined = try std.fs.path.join(
-                ctx.*.allocator,
-                &[_][]const u8{ path, entry.path },
-            );
-            defer ctx.*.allocator.free(joined);
-            try pushFile(ctx, joined);
-        }
+    fn file(context: *anyopaque, thread: usize, dir: std.Io.Dir, name: []const u8, path: []const u8) anyerror!void {
+        const self: *WalkSink = @ptrCast(@alignCast(context));
+        try pushFile(self.ctx, &self.dispatches[thread], dir, name, path);
+    }
+};
+
+/// Push the files listed in `ctx.files_from` as they are read. They are
+/// taken as they are, without a walk or a look at their extension.
+fn pushListed(ctx: *SharedContext, dispatch: *Dispatch) !void {
+    const list_path = ctx.files_from orelse return;
+    const from_stdin = std.mem.eql(u8, list_path, "-");
+    const file = if (from_stdin) std.Io.File.stdin() else try std.Io.Dir.cwd().openFile(ctx.io, list_path, .{});
+    defer if (!from_stdin) file.close(ctx.io);
+
+    var buffer: [64 * 1024]u8 = undefined;
+    var file_reader = file.reader(ctx.io, &buffer);
+    const reader = &file_reader.interface;
+    const delimiter: u8 = if (ctx.null_separated) 0 else '\n';
+    while (true) {
+        // Hand out what has been read before waiting on the producer. A
+        // size buffer is left alone, as draining it early would undo its
+        // ordering.
+        if (dispatch.by_size == null and reader.bufferedLen() == 0) try dispatch.flush(ctx.path_queue);
+        const line = (reader.takeDelimiter(delimiter) catch |err| switch (err) {
+            error.StreamTooLong => return error.ListedPathTooLong,
+            else => |e| return e,
+        }) orelse break;
+        const path = if (ctx.null_separated) line else std.mem.trimEnd(u8, line, "\r");
+        if (path.len == 0) continue;
+        try pushFile(ctx, dispatch, std.Io.Dir.cwd(), path, path);
     }
-    walker.deinit();
-    root_dir.close(ctx.io);
-    ctx.*.progress.*.done_walk = true;
 }
 
-fn walkerThread(ctx: *SharedContext) !void {
-    for (ctx.*.paths) |path| {
-        walkPush(ctx, path) catch |err| {
-            if (err == error.NotDir) {
-                try pushFile(ctx, path);
-            } else {
-                return err;
-            }
-        };
+fn walkerThread(ctx: *SharedContext) void {
+    // Workers stop once the queue closes, however the walk ends.
+    defer ctx.path_queue.close() catch {};
+    walkPaths(ctx) catch |err| {
+        ctx.walk_error = err;
+    };
+}
+
+fn walkPaths(ctx: *SharedContext) !void {
+    const threads = ctx.workers;
+    const dispatches = try ctx.allocator.alloc(Dispatch, threads);
+    defer ctx.allocator.free(dispatches);
+    @memset(dispatches, .{});
+
+    // Each walk thread keeps its own share of the window.
+    const size_buffers = try ctx.allocator.alloc(Dispatch.SizeBuffer, if (ctx.largest_first) threads else 0);
+    defer ctx.allocator.free(size_buffers);
+    var initialized: usize = 0;
+    defer for (size_buffers[0..initialized]) |*buffer| buffer.deinit(ctx.allocator);
+    for (size_buffers, dispatches) |*buffer, *dispatch| {
+        buffer.* = try .init(ctx.allocator, @max(256, Dispatch.size_buffer_capacity / threads));
+        initialized += 1;
+        dispatch.by_size = buffer;
     }
-    try ctx.path_queue.close();
+    errdefer for (dispatches) |*dispatch| dispatch.discard();
+
+    var sink: WalkSink = .{ .ctx = ctx, .dispatches = dispatches };
+    try tql.walker.walk(ctx.allocator, ctx.io, ctx.paths, .{
+        .language = ctx.language,
+        .threads = threads,
+        .respect_ignore = ctx.respect_ignore,
+    }, .{ .context = &sink, .file = WalkSink.file });
+    try pushListed(ctx, &dispatches[0]);
+    ctx.progress.done_walk = true;
+
+    // Drain the size buffers together, so the largest files still go first.
+    while (true) {
+        var largest: ?*Dispatch.SizeBuffer = null;
+        for (size_buffers) |*buffer| {
+            const top = buffer.peek() orelse continue;
+            if (largest == null or PathEntry.larger(top, largest.?.peek().?)) largest = buffer;
+        }
+        const buffer = largest orelse break;
+        try buffer.pop().?.handOut(ctx.path_queue);
+    }
+    for (dispatches) |*dispatch| try dispatch.flush(ctx.path_queue);
 }
 
 fn writerThread(ctx: *SharedContext, jws: *std.json.Stringify) !void {
     var totals: FileStats = .{};
+    // The file that took longest. No schedule finishes sooner than it does.
+    var critical_path: FileStats = .{};
+    var critical_path_file: []const u8 = "";
+    defer ctx.allocator.free(critical_path_file);
     try jws.beginObject();
     try jws.objectField("results");
     try jws.beginArray();
@@ -285,14 +565,28 @@ fn writerThread(ctx: *SharedContext, jws: *std.json.Stringify) !void {
         totals.read_time = std.Io.Duration.fromNanoseconds(totals.read_time.nanoseconds + result.stats.read_time.nanoseconds);
         totals.parse_time = std.Io.Duration.fromNanoseconds(totals.parse_time.nanoseconds + result.stats.parse_time.nanoseconds);
         totals.query_time = std.Io.Duration.fromNanoseconds(totals.query_time.nanoseconds + result.stats.query_time.nanoseconds);
-        if (result.values.items.len == 0) continue;
+        totals.skipped += result.stats.skipped;
+        if (result.stats.total_time.nanoseconds > critical_path.total_time.nanoseconds) {
+            const file = try ctx.allocator.dupe(u8, result.filename);
+            ctx.allocator.free(critical_path_file);
+            critical_path_file = file;
+            critical_path = result.stats;
+        }
+        if (result.read_error) |err| {
+            try jws.beginObject();
+            try jws.objectField("file");
+            try jws.write(result.filename);
+            try jws.objectField("error");
+            try jws.write(@errorName(err));
+            try jws.endObject();
+            continue;
+        }
+        if (result.value_count == 0) continue;
         try jws.beginObject();
         try jws.objectField("file");
         try jws.write(result.filename);
         try jws.objectField("values");
-        try jws.beginArray();
-        for (result.values.items) |v| try v.jsonStringify(jws);
-        try jws.endArray();
+        try jws.print("{s}", .{result.values_json});
         try jws.endObject();
     }
     try jws.endArray();
@@ -304,56 +598,213 @@ fn writerThread(ctx: *SharedContext, jws: *std.json.Stringify) !void {
     try jws.write(totals.parse_time.nanoseconds);
     try jws.objectField("query_time_ns");
     try jws.write(totals.query_time.nanoseconds);
+    try jws.objectField("skipped_files");
+    try jws.write(totals.skipped);
+    try jws.objectField("unreadable_files");
+    try jws.write(ctx.unreadable.load(.monotonic));
+    try jws.objectField("critical_path");
+    try jws.beginObject();
+    try jws.objectField("file");
+    try jws.write(critical_path_file);
+    try jws.objectField("time_ns");
+    try jws.write(critical_path.total_time.nanoseconds);
+    try jws.objectField("parse_time_ns");
+    try jws.write(critical_path.parse_time.nanoseconds);
+    try jws.objectField("query_time_ns");
+    try jws.write(critical_path.query_time.nanoseconds);
+    try jws.endObject();
     try jws.endObject();
     try jws.endObject();
 }
 
-fn workerThread(ctx: *SharedContext) !void {
-    var arena = std.heap.ArenaAllocator.init(ctx.*.allocator);
-    defer arena.deinit();
-
-    while (try ctx.path_queue.pop()) |entry| {
+fn workerThread(ctx: *SharedContext, worker: usize) !void {
+    // Runtime objects are freed and reallocated constantly; recycle them
+    // within the file and drop the lot afterwards.
+    var scratch = tql.ds.SlabAllocator.init(ctx.*.allocator);
+    defer scratch.deinit();
+    var run_context: tql.RunContext = .{};
+    defer run_context.deinit();
+    // Each file's values are encoded here and copied out once, whole, so
+    // the buffer's growth is paid once per worker rather than per file.
+    var output: std.Io.Writer.Allocating = .init(ctx.*.allocator);
+    defer output.deinit();
+
+    while (try ctx.path_queue.pop(worker)) |entry| {
         var result_arena = entry.arena;
         errdefer result_arena.deinit();
         const result_alloc = result_arena.allocator();
         const query_target_path = entry.path;
 
         const read_start = std.Io.Timestamp.now(ctx.io, .real);
-        const query_target: []align(std.heap.page_size_min) const u8 = blk: {
-            const file = try std.Io.Dir.cwd().openFile(ctx.io, query_target_path, .{});
-            defer file.close(ctx.io);
-            const stat = try file.stat(ctx.io);
-            if (stat.size == 0) break :blk &[_]u8{};
-            break :blk try std.posix.mmap(
-                null,
-                stat.size,
-                .{ .READ = true },
-                .{ .TYPE = .PRIVATE },
-                file.handle,
-                0,
-            );
+        const query_target = mapFile(ctx.io, query_target_path) catch |err| {
+            _ = ctx.unreadable.fetchAdd(1, .monotonic);
+            try ctx.result_queue.push(.{
+                .arena = result_arena,
+                .filename = query_target_path,
+                .values_json = "",
+                .value_count = 0,
+                .stats = .{ .total_time = read_start.untilNow(ctx.io, .real) },
+                .read_error = err,
+            });
+            _ = ctx.*.progress.done.fetchAdd(1, .monotonic);
+            continue;
         };
         const read_time = read_start.untilNow(ctx.io, .real);
         defer if (query_target.len > 0) std.posix.munmap(query_target);
 
-        const run_result = try ctx.compiled.run(query_target, result_alloc, arena.allocator());
+        // Serialize values as they are found rather than copying them out
+        // of the runtime first.
+        output.clearRetainingCapacity();
+        var value_count: usize = 0;
+        const stats = blk: {
+            if (ctx.split_threshold) |threshold| {
+                if (ctx.workers > 1 and query_target.len >= threshold) {
+                    if (try runSplit(ctx, &run_context, query_target, &output, &value_count)) |stats| break :blk stats;
+                }
+            }
+            var stream = try ctx.compiled.streamIn(&run_context, query_target, scratch.allocator());
+            defer stream.deinit();
+            stream.options.node_text = ctx.node_text;
+            var jws: std.json.Stringify = .{ .writer = &output.writer };
+            try jws.beginArray();
+            while (try stream.next()) |v| : (value_count += 1) try v.jsonStringify(&jws);
+            try jws.endArray();
+            break :blk stream.stats;
+        };
 
         try ctx.result_queue.push(.{
             .arena = result_arena,
             .filename = query_target_path,
-            .values = run_result.values,
+            .values_json = if (value_count == 0) "" else try result_alloc.dupe(u8, output.written()),
+            .value_count = value_count,
             .stats = .{
                 .read_time = read_time,
-                .parse_time = run_result.stats.parse_time,
-                .query_time = run_result.stats.query_time,
+                .parse_time = stats.parse_time,
+                .query_time = stats.query_time,
+                .total_time = read_start.untilNow(ctx.io, .real),
+                .skipped = @intFromBool(stats.skipped),
             },
         });
 
-        _ = arena.reset(.retain_capacity);
+        scratch.reset();
         _ = ctx.*.progress.done.fetchAdd(1, .monotonic);
     }
 }
 
+/// Map `path` for reading. Empty files aren't mapped.
+fn mapFile(io: std.Io, path: []const u8) ![]align(std.heap.page_size_min) const u8 {
+    const file = try std.Io.Dir.cwd().openFile(io, path, .{});
+    defer file.close(io);
+    const stat = try file.stat(io);
+    if (stat.size == 0) return &[_]u8{};
+    return try std.posix.mmap(
+        null,
+        stat.size,
+        .{ .READ = true },
+        .{ .TYPE = .PRIVATE },
+        file.handle,
+        0,
+    );
+}
+
+/// One thread's share of a split file.
+const SlicePart = struct {
+    /// The slice's values as a JSON array.
+    output: std.Io.Writer.Allocating,
+    value_count: usize = 0,
+    result: anyerror!void = {},
+
+    fn run(self: *SlicePart, ctx: *SharedContext, tree: *tql.ts.Tree, source: []const u8, index: usize, count: usize) void {
+        self.result = self.runSlice(ctx, tree, source, index, count);
+    }
+
+    fn runSlice(self: *SlicePart, ctx: *SharedContext, tree: *tql.ts.Tree, source: []const u8, index: usize, count: usize) !void {
+        var scratch = tql.ds.SlabAllocator.init(ctx.allocator);
+        defer scratch.deinit();
+        var stream = (try ctx.compiled.streamTreeSlice(tree, source, scratch.allocator(), index, count)).?;
+        defer stream.deinit();
+        stream.options.node_text = ctx.node_text;
+        var jws: std.json.Stringify = .{ .writer = &self.output.writer };
+        try jws.beginArray();
+        while (try stream.next()) |v| : (self.value_count += 1) try v.jsonStringify(&jws);
+        try jws.endArray();
+    }
+
+    /// The values without the array's brackets.
+    fn elements(self: *SlicePart) []const u8 {
+        const written = self.output.written();
+        return written[1 .. written.len - 1];
+    }
+};
+
+/// Run one large file on `ctx.workers` threads, each taking the branches of
+/// the query's first fan-out that start in its slice of the file, and write
+/// the values to `output` in document order. Returns null, having done
+/// nothing, when the query can't be split like that, would skip the file
+/// anyway, or another file is being split.
+fn runSplit(
+    ctx: *SharedContext,
+    run_context: *tql.RunContext,
+    query_target: []const u8,
+    output: *std.Io.Writer.Allocating,
+    value_count: *usize,
+) !?tql.RunStats {
+    const compiled = ctx.compiled;
+    if (tql.runtime.Partition.find(compiled.code()) == null) return null;
+    if (!compiled.admits(query_target)) return null;
+    if (ctx.splitting.cmpxchgStrong(false, true, .acquire, .monotonic) != null) return null;
+    defer ctx.splitting.store(false, .release);
+
+    const parse_start = std.Io.Timestamp.now(ctx.io, .real);
+    const source_parser = try run_context.parserFor(compiled.language);
+    const tree = source_parser.parseString(query_target, null) orelse return error.SourceParseFailed;
+    defer tree.destroy();
+    const parse_time = parse_start.untilNow(ctx.io, .real);
+
+    const query_start = std.Io.Timestamp.now(ctx.io, .real);
+    const count = ctx.workers;
+    const parts = try ctx.allocator.alloc(SlicePart, count);
+    defer ctx.allocator.free(parts);
+    for (parts) |*part| part.* = .{ .output = .init(ctx.allocator) };
+    defer for (parts) |*part| part.output.deinit();
+
+    // tree-sitter trees are not to be shared between threads, but copies
+    // are cheap and share their nodes.
+    const trees = try ctx.allocator.alloc(*tql.ts.Tree, count);
+    defer ctx.allocator.free(trees);
+    trees[0] = tree;
+    var copied: usize = 1;
+    defer for (trees[1..copied]) |t| t.destroy();
+    while (copied < count) : (copied += 1) trees[copied] = tree.dupe();
+
+    const threads = try ctx.allocator.alloc(std.Thread, count - 1);
+    defer ctx.allocator.free(threads);
+    var spawned: usize = 0;
+    defer for (threads[0..spawned]) |t| t.join();
+    while (spawned < threads.len) : (spawned += 1) {
+        const index = spawned + 1;
+        threads[spawned] = try std.Thread.spawn(.{}, SlicePart.run, .{ &parts[index], ctx, trees[index], query_target, index, count });
+    }
+    parts[0].run(ctx, trees[0], query_target, 0, count);
+    for (threads[0..spawned]) |t| t.join();
+    spawned = 0;
+
+    try output.writer.writeByte('[');
+    for (parts) |*part| {
+        try part.result;
+        if (part.value_count == 0) continue;
+        if (value_count.* > 0) try output.writer.writeByte(',');
+        try output.writer.writeAll(part.elements());
+        value_count.* += part.value_count;
+    }
+    try output.writer.writeByte(']');
+
+    return .{
+        .parse_time = parse_time,
+        .query_time = query_start.untilNow(ctx.io, .real),
+    };
+}
+
 fn run(
     allocator: std.mem.Allocator,
     io: std.Io,
@@ -364,15 +815,26 @@ fn run(
     var engine = try Engine.init(.{
         .allocator = allocator,
         .io = io,
+        .keyword_prefilter = config.keyword_prefilter,
     });
     defer engine.deinit();
 
-    var compiled = try engine.compile(config.query, config.language);
+    var compiled = if (config.image_path) |path|
+        try engine.loadImage(path)
+    else
+        try engine.compile(config.query, config.language.?);
     defer compiled.deinit();
+    if (config.language) |language| {
+        if (language != compiled.language) {
+            try stderr.print("Error: the image was compiled for {s}, not {s}\n", .{ @tagName(compiled.language), @tagName(language) });
+            return @intFromEnum(ExitCode.invalid_args);
+        }
+    }
 
     // real shit
     var jws: std.json.Stringify = .{ .writer = stdout };
-    var path_queue = try PathQueue.init(allocator, io, 65535);
+    // Largest-first dispatch pushes in the order files should be taken.
+    var path_queue = try PathQueue.init(allocator, io, config.workers, if (config.largest_first) .oldest_first else .newest_first, path_queue_capacity);
     var result_queue = try ResultQueue.init(allocator, io, 1024);
     var progress = Progress{};
     var ctx = SharedContext{
@@ -381,7 +843,14 @@ fn run(
         .allocator = allocator,
         .result_queue = &result_queue,
         .path_queue = &path_queue,
-        .language = config.language,
+        .language = compiled.language,
+        .node_text = config.node_text,
+        .largest_first = config.largest_first,
+        .split_threshold = config.split_threshold,
+        .respect_ignore = config.respect_ignore,
+        .files_from = config.files_from,
+        .null_separated = config.null_separated,
+        .workers = config.workers,
         .progress = &progress,
         .io = io,
     };
@@ -393,7 +862,7 @@ fn run(
     var workers = try allocator.alloc(std.Thread, config.workers);
 
     for (0..config.workers) |i| {
-        workers[i] = try std.Thread.spawn(.{}, workerThread, .{&ctx});
+        workers[i] = try std.Thread.spawn(.{}, workerThread, .{ &ctx, i });
     }
 
     for (workers) |*worker| {
@@ -408,8 +877,19 @@ fn run(
     }
     writer_thread.join();
 
-    path_queue.deinit(allocator);
+    path_queue.deinit();
     result_queue.deinit(allocator);
     allocator.free(workers);
+
+    if (ctx.walk_error) |err| {
+        try stderr.print("Error: could not list the files to search: {}\n", .{err});
+        return @intFromEnum(ExitCode.runtime_error);
+    }
+
+    const unreadable = ctx.unreadable.load(.monotonic);
+    if (unreadable > 0) {
+        try stderr.print("Error: {d} file(s) could not be read; see the results\n", .{unreadable});
+        return @intFromEnum(ExitCode.runtime_error);
+    }
     return 0;
 }
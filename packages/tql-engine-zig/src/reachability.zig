@@ -0,0 +1,238 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const ts = @import("tree-sitter");
+
+const NodeKindId = @import("runtime.zig").NodeKindId;
+
+/// Which named node kinds can appear under which others, derived from a
+/// grammar's node-types.json. Answers are conservative: kinds the grammar
+/// doesn't describe (ERROR, kinds missing from node-types) are assumed to
+/// contain, and be contained by, anything.
+pub const Reachability = struct {
+    const Self = @This();
+    const BitSet = std.DynamicBitSetUnmanaged;
+
+    kind_count: u32,
+    /// Kinds with an entry in node-types.
+    known: BitSet,
+    /// `children[a]` has `b` set if a node of kind `a` may have a named child
+    /// of kind `b`.
+    children: []BitSet,
+    /// `descendants[a]` has `b` set if a node of kind `a` may have a named
+    /// strict descendant of kind `b`.
+    descendants: []BitSet,
+    allocator: Allocator,
+
+    const TypeRef = struct {
+        type: []const u8,
+        named: bool,
+    };
+
+    const ChildInfo = struct {
+        types: []const TypeRef = &.{},
+    };
+
+    const NodeTypeInfo = struct {
+        type: []const u8,
+        named: bool,
+        root: bool = false,
+        extra: bool = false,
+        fields: ?std.json.ArrayHashMap(ChildInfo) = null,
+        children: ?ChildInfo = null,
+        subtypes: ?[]const TypeRef = null,
+    };
+
+    const Supertypes = std.StringHashMapUnmanaged([]const TypeRef);
+
+    pub fn init(allocator: Allocator, language: *const ts.Language, node_types_json: []const u8) !Self {
+        const parsed = try std.json.parseFromSlice([]const NodeTypeInfo, allocator, node_types_json, .{
+            .ignore_unknown_fields = true,
+        });
+        defer parsed.deinit();
+        const infos = parsed.value;
+
+        const kind_count = language.nodeKindCount();
+
+        var known = try BitSet.initEmpty(allocator, kind_count);
+        errdefer known.deinit(allocator);
+        const children = try initRows(allocator, kind_count);
+        errdefer deinitRows(allocator, children);
+        const descendants = try initRows(allocator, kind_count);
+        errdefer deinitRows(allocator, descendants);
+
+        var supertypes: Supertypes = .empty;
+        defer supertypes.deinit(allocator);
+        for (infos) |info| {
+            if (info.subtypes) |subtypes| try supertypes.put(allocator, info.type, subtypes);
+        }
+
+        // Every kind that shows up as a child somewhere. Anything else that
+        // isn't the root can only get into a tree as an extra (e.g. comment).
+        var referenced = try BitSet.initEmpty(allocator, kind_count);
+        defer referenced.deinit(allocator);
+
+        for (infos) |info| {
+            if (info.subtypes != null) continue;
+            const kind_id = kindIdFor(language, kind_count, info.type, info.named) orelse continue;
+            known.set(kind_id);
+
+            const row = &children[kind_id];
+            if (info.fields) |fields| {
+                for (fields.map.values()) |field| {
+                    expandTypes(language, kind_count, &supertypes, field.types, row, 0);
+                }
+            }
+            if (info.children) |c| {
+                expandTypes(language, kind_count, &supertypes, c.types, row, 0);
+            }
+            referenced.setUnion(row.*);
+        }
+
+        var extras = try BitSet.initEmpty(allocator, kind_count);
+        defer extras.deinit(allocator);
+        for (infos) |info| {
+            if (info.subtypes != null or !info.named or info.root) continue;
+            const kind_id = kindIdFor(language, kind_count, info.type, info.named) orelse continue;
+            if (info.extra or !referenced.isSet(kind_id)) extras.set(kind_id);
+        }
+
+        var known_iter = known.iterator(.{});
+        while (known_iter.next()) |kind_id| {
+            children[kind_id].setUnion(extras);
+            descendants[kind_id].setUnion(children[kind_id]);
+        }
+
+        // Transitive closure; converges in roughly the grammar's nesting depth.
+        var changed = true;
+        while (changed) {
+            changed = false;
+            known_iter = known.iterator(.{});
+            while (known_iter.next()) |a| {
+                const before = descendants[a].count();
+                var child_iter = children[a].iterator(.{});
+                while (child_iter.next()) |b| {
+                    if (a != b) descendants[a].setUnion(descendants[b]);
+                }
+                if (descendants[a].count() != before) changed = true;
+            }
+        }
+
+        return .{
+            .kind_count = kind_count,
+            .known = known,
+            .children = children,
+            .descendants = descendants,
+            .allocator = allocator,
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.known.deinit(self.allocator);
+        deinitRows(self.allocator, self.children);
+        deinitRows(self.allocator, self.descendants);
+    }
+
+    fn isKnown(self: *const Self, kind_id: NodeKindId) bool {
+        return kind_id < self.kind_count and self.known.isSet(kind_id);
+    }
+
+    /// Whether a node of kind `parent` may have a named child of kind `child`.
+    pub fn mayHaveChild(self: *const Self, parent: NodeKindId, child: NodeKindId) bool {
+        if (!self.isKnown(parent) or !self.isKnown(child)) return true;
+        return self.children[parent].isSet(child);
+    }
+
+    /// Whether a node of kind `ancestor` may have a named strict descendant
+    /// of kind `descendant`.
+    pub fn mayContain(self: *const Self, ancestor: NodeKindId, descendant: NodeKindId) bool {
+        if (!self.isKnown(ancestor) or !self.isKnown(descendant)) return true;
+        return self.descendants[ancestor].isSet(descendant);
+    }
+
+    /// Whether the subtree rooted at `node` may be skipped when searching for
+    /// descendants of kind `target`. Subtrees with syntax errors are never
+    /// skipped, since ERROR nodes can hold anything.
+    pub fn canPrune(self: *const Self, node: ts.Node, target: NodeKindId) bool {
+        if (node.hasError()) return false;
+        return !self.mayContain(node.kindId(), target);
+    }
+
+    fn kindIdFor(language: *const ts.Language, kind_count: u32, name: []const u8, named: bool) ?NodeKindId {
+        if (!named) return null;
+        const kind_id = language.idForNodeKind(name, true);
+        if (kind_id == 0 or kind_id >= kind_count) return null;
+        return kind_id;
+    }
+
+    fn expandTypes(
+        language: *const ts.Language,
+        kind_count: u32,
+        supertypes: *const Supertypes,
+        types: []const TypeRef,
+        row: *BitSet,
+        depth: u8,
+    ) void {
+        // Supertypes nest, but never deeply. Guard against cycles anyway.
+        if (depth > 16) return;
+        for (types) |t| {
+            if (t.named) {
+                if (supertypes.get(t.type)) |subtypes| {
+                    expandTypes(language, kind_count, supertypes, subtypes, row, depth + 1);
+                    continue;
+                }
+            }
+            if (kindIdFor(language, kind_count, t.type, t.named)) |kind_id| row.set(kind_id);
+        }
+    }
+
+    fn initRows(allocator: Allocator, kind_count: u32) ![]BitSet {
+        const rows = try allocator.alloc(BitSet, kind_count);
+        var initialized: usize = 0;
+        errdefer {
+            for (rows[0..initialized]) |*row| row.deinit(allocator);
+            allocator.free(rows);
+        }
+        while (initialized < kind_count) : (initialized += 1) {
+            rows[initialized] = try BitSet.initEmpty(allocator, kind_count);
+        }
+        return rows;
+    }
+
+    fn deinitRows(allocator: Allocator, rows: []BitSet) void {
+        for (rows) |*row| row.deinit(allocator);
+        allocator.free(rows);
+    }
+};
+
+const testing = std.testing;
+
+extern fn tree_sitter_c() callconv(.c) *ts.Language;
+
+test "Reachability: C statements" {
+    const language = tree_sitter_c();
+    defer language.destroy();
+
+    var reachability = try Reachability.init(
+        testing.allocator,
+        language,
+        @import("language.zig").Language.c.nodeTypes(),
+    );
+    defer reachability.deinit();
+
+    const function_definition = language.idForNodeKind("function_definition", true);
+    const compound_statement = language.idForNodeKind("compound_statement", true);
+    const call_expression = language.idForNodeKind("call_expression", true);
+    const goto_statement = language.idForNodeKind("goto_statement", true);
+    const string_literal = language.idForNodeKind("string_literal", true);
+    const comment = language.idForNodeKind("comment", true);
+
+    try testing.expect(reachability.mayHaveChild(function_definition, compound_statement));
+    try testing.expect(!reachability.mayHaveChild(function_definition, goto_statement));
+    try testing.expect(reachability.mayContain(function_definition, goto_statement));
+    try testing.expect(reachability.mayContain(function_definition, call_expression));
+    try testing.expect(!reachability.mayContain(string_literal, call_expression));
+    // Extras may appear anywhere.
+    try testing.expect(reachability.mayHaveChild(function_definition, comment));
+    // ERROR is not described by the grammar.
+    try testing.expect(reachability.mayContain(65535, call_expression));
+}
@@ -2,7 +2,6 @@ const re = @cImport({
     @cDefine("PCRE2_CODE_UNIT_WIDTH", "8");
     @cInclude("pcre2.h");
 });
-const PCRE2_ZERO_TERMINATED = ~@as(re.PCRE2_SIZE, 0);
 const std = @import("std");
 
 const PCRE2Error = error{PCRE2Unknown};
@@ -11,20 +10,26 @@ pub const Regex = struct {
     const Self = @This();
 
     regex: *re.pcre2_code_8,
+    /// Whether the pattern was JIT compiled. pcre2 built without JIT support
+    /// falls back to the interpreter.
+    jit: bool = false,
 
     pub fn eql(self: Self, other: Self) bool {
         return self.regex == other.regex;
     }
 
     pub fn compile(needle: []const u8) !Self {
-        const pattern: re.PCRE2_SPTR8 = &needle[0];
         var errornumber: c_int = undefined;
         var erroroffset: re.PCRE2_SIZE = undefined;
 
-        const maybe_regex: ?*re.pcre2_code_8 = re.pcre2_compile_8(pattern, PCRE2_ZERO_TERMINATED, 0, &errornumber, &erroroffset, null);
+        const maybe_regex: ?*re.pcre2_code_8 = re.pcre2_compile_8(needle.ptr, needle.len, 0, &errornumber, &erroroffset, null);
 
         // IMPROVE: Better error
-        return if (maybe_regex) |regex| Self{ .regex = regex } else error.PCRE2Unknown;
+        const regex = maybe_regex orelse return error.PCRE2Unknown;
+        return .{
+            .regex = regex,
+            .jit = re.pcre2_jit_compile_8(regex, re.PCRE2_JIT_COMPLETE) == 0,
+        };
     }
 
     pub fn deinit(self: *Self) void {
@@ -40,8 +45,19 @@ pub const Regex = struct {
         return matches.rc > 0;
     }
 
+    /// Like `do_test`, but reuses `scratch` instead of allocating match data
+    /// on every call.
+    pub fn isMatch(self: *const Self, scratch: *MatchScratch, haystack: []const u8) bool {
+        const rc = if (self.jit)
+            re.pcre2_jit_match_8(self.regex, haystack.ptr, haystack.len, 0, 0, scratch.match_data, scratch.match_context)
+        else
+            re.pcre2_match_8(self.regex, haystack.ptr, haystack.len, 0, 0, scratch.match_data, scratch.match_context);
+        // 0 means a match whose captures did not fit in the match data.
+        return rc >= 0;
+    }
+
     pub fn match(self: *const Self, haystack: []const u8) !RegexSearch {
-        const subject: re.PCRE2_SPTR8 = &haystack[0];
+        const subject: re.PCRE2_SPTR8 = haystack.ptr;
         const subj_len: re.PCRE2_SIZE = haystack.len;
 
         const match_data = re.pcre2_match_data_create_from_pattern_8(self.regex, null);
@@ -101,6 +117,44 @@ pub const RegexSearch = struct {
     }
 };
 
+/// Match data and JIT stack for `Regex.isMatch`, so that testing a subject
+/// allocates nothing. Only the whole-match offsets are kept. Not thread safe;
+/// use one per runtime.
+pub const MatchScratch = struct {
+    const Self = @This();
+
+    const jit_stack_start = 32 * 1024;
+    const jit_stack_max = 512 * 1024;
+
+    match_data: *re.pcre2_match_data_8,
+    match_context: *re.pcre2_match_context_8,
+    jit_stack: ?*re.pcre2_jit_stack_8,
+
+    pub fn init() !Self {
+        const match_data = re.pcre2_match_data_create_8(1, null) orelse return error.OutOfMemory;
+        errdefer re.pcre2_match_data_free_8(match_data);
+        const match_context = re.pcre2_match_context_create_8(null) orelse return error.OutOfMemory;
+        errdefer re.pcre2_match_context_free_8(match_context);
+
+        // Without JIT support there is no stack to create; the interpreter
+        // ignores it anyway.
+        const jit_stack = re.pcre2_jit_stack_create_8(jit_stack_start, jit_stack_max, null);
+        if (jit_stack) |stack| re.pcre2_jit_stack_assign_8(match_context, null, stack);
+
+        return .{
+            .match_data = match_data,
+            .match_context = match_context,
+            .jit_stack = jit_stack,
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        if (self.jit_stack) |stack| re.pcre2_jit_stack_free_8(stack);
+        re.pcre2_match_context_free_8(self.match_context);
+        re.pcre2_match_data_free_8(self.match_data);
+    }
+};
+
 const expect = std.testing.expect;
 
 test "sanity" {
@@ -117,3 +171,36 @@ test "sanity" {
     match = matches.next() orelse @panic("failed");
     try expect(std.mem.eql(u8, match, "codebase are belong to"));
 }
+
+test "isMatch reuses scratch" {
+    var scratch = try MatchScratch.init();
+    defer scratch.deinit();
+
+    var regex = try Regex.compile("^ma(in)?$");
+    defer regex.deinit();
+    try expect(regex.isMatch(&scratch, "main"));
+    try expect(regex.isMatch(&scratch, "ma"));
+    try expect(!regex.isMatch(&scratch, "mains"));
+    try expect(!regex.isMatch(&scratch, ""));
+}
+
+test "empty pattern and subject" {
+    var scratch = try MatchScratch.init();
+    defer scratch.deinit();
+
+    var regex = try Regex.compile("");
+    defer regex.deinit();
+    try expect(regex.isMatch(&scratch, ""));
+    try expect(regex.isMatch(&scratch, "anything"));
+}
+
+test "patterns are not NUL terminated" {
+    var scratch = try MatchScratch.init();
+    defer scratch.deinit();
+
+    const source = "abc";
+    var regex = try Regex.compile(source[0..2]);
+    defer regex.deinit();
+    try expect(regex.isMatch(&scratch, "xaby"));
+    try expect(!regex.isMatch(&scratch, "xacy"));
+}
@@ -12,19 +12,30 @@ const parser = @import("parser.zig");
 const compiler = @import("compiler.zig");
 const language = @import("language.zig");
 const engine = @import("engine.zig");
+const session = @import("session.zig");
+const reachability = @import("reachability.zig");
+const image = @import("image.zig");
+pub const walker = @import("walker.zig");
 
 // IMPROVE: don't export this
 pub const ds = @import("ds.zig");
 pub const AST = ast;
 pub const Parser = parser.Parser;
 pub const Value = engine.Value;
+pub const NodeText = engine.NodeText;
+pub const ResultOptions = engine.ResultOptions;
 pub const Compiler = compiler.Compiler;
 pub const Runtime = runtime;
 pub const Language = language.Language;
 pub const Engine = engine.Engine;
 pub const Query = engine.Query;
+pub const RunContext = engine.RunContext;
 pub const RunResult = engine.RunResult;
 pub const RunStats = engine.RunStats;
+pub const Stream = engine.Stream;
+pub const BorrowedValue = engine.BorrowedValue;
+pub const Session = session.Session;
+pub const Reachability = reachability.Reachability;
 
 test {
     const refAllDecls = std.testing.refAllDecls;
@@ -36,5 +47,9 @@ test {
     refAllDecls(compiler);
     refAllDecls(language);
     refAllDecls(engine);
+    refAllDecls(session);
+    refAllDecls(image);
+    refAllDecls(reachability);
+    refAllDecls(walker);
     refAllDecls(@import("tests.zig"));
 }
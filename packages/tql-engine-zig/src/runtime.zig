@@ -6,9 +6,13 @@ pub const Address = types.Address;
 pub const Symbol = types.Symbol;
 pub const VariableId = types.VariableId;
 pub const NodeKindId = types.NodeKindId;
+pub const NodeRef = types.NodeRef;
+pub const StringId = types.StringId;
+pub const RegexId = types.RegexId;
 
 pub const Point = types.Point;
 pub const Range = types.Range;
+pub const Span = types.Span;
 pub const Value = types.Value;
 pub const Record = types.Record;
 pub const List = types.List;
@@ -32,11 +36,26 @@ pub const Relation = types.Relation;
 pub const Condition = types.Condition;
 pub const Instruction = types.Instruction;
 
+pub const bytecode = @import("runtime/bytecode.zig");
+pub const Op = bytecode.Op;
+pub const Operand = bytecode.Operand;
+pub const Code = bytecode.Code;
+pub const Disassembler = bytecode.Disassembler;
+
+pub const PreorderWalker = @import("runtime/preorder_walker.zig").PreorderWalker;
+pub const KindIndex = @import("runtime/kind_index.zig").KindIndex;
 pub const ProgramImage = @import("runtime/program_image.zig").ProgramImage;
+pub const Prefilter = @import("runtime/prefilter.zig").Prefilter;
+pub const RegexSets = @import("runtime/regex_set.zig").RegexSets;
+pub const Partition = @import("runtime/partition.zig").Partition;
 
 pub const Runtime = core.Runtime;
 
 test {
     const refAllDecls = @import("std").testing.refAllDecls;
     refAllDecls(@import("runtime/tests.zig"));
+    refAllDecls(bytecode);
+    refAllDecls(@import("runtime/prefilter.zig"));
+    refAllDecls(@import("runtime/regex_set.zig"));
+    refAllDecls(@import("runtime/partition.zig"));
 }
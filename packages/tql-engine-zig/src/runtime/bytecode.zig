@@ -0,0 +1,370 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+const types = @import("./types.zig");
+const Address = types.Address;
+const VariableId = types.VariableId;
+const NodeKindId = types.NodeKindId;
+const FieldId = types.FieldId;
+const StringId = types.StringId;
+const Value = types.Value;
+const Condition = types.Condition;
+const Relation = types.Relation;
+const Vector = types.Vector;
+const AggregatingValue = types.AggregatingValue;
+const NodeValueSource = types.NodeValueSource;
+const ValueSource = types.ValueSource;
+const Instruction = types.Instruction;
+
+/// Opcodes of the runtime's bytecode. Each comment lists the operands the
+/// opcode reads; unused ones are zero.
+pub const Op = enum(u8) {
+    noop,
+    /// mode: `Condition`
+    halt,
+    trv_child,
+    trv_descendant,
+    /// a: field id
+    trv_field,
+    /// a: kind id
+    trv_child_of_kind,
+    /// a: kind id
+    trv_descendant_of_kind,
+    /// a: field id, b: kind id
+    trv_field_of_kind,
+    /// a: variable id
+    trv_variable,
+    /// a: variable id, b: `Operand`
+    asn,
+    /// mode: `Relation`, a: `Operand`, b: `Operand`
+    rel,
+    /// a: `Operand`
+    yield,
+    /// a: resume address
+    probe_exists,
+    /// a: resume address
+    probe_nexists,
+    /// mode: `AggregatingValue`, a: resume address, b: variable id
+    probe_aggregate,
+    /// a: address
+    call,
+    ret,
+    /// mode: `Condition`, a: address
+    jmp,
+    /// mode: `Vector`
+    begin_build,
+    /// a: `Operand`
+    push_build,
+    /// a: `Operand`, b: string id of the record key
+    push_build_named,
+    /// a: variable id
+    end_build,
+    panic,
+};
+
+/// A value operand: a constant from the program's pool, a property of the
+/// current node, or a variable.
+pub const Operand = packed struct(u32) {
+    pub const Kind = enum(u2) { constant, node, variable };
+
+    index: u30,
+    kind: Kind,
+
+    pub fn decode(raw: u32) Operand {
+        return @bitCast(raw);
+    }
+
+    pub fn encode(self: Operand) u32 {
+        return @bitCast(self);
+    }
+};
+
+/// One fixed-width instruction. Everything variable-sized lives in the
+/// program's pools and is referenced by index, so the dispatch loop walks a
+/// dense array.
+pub const Code = extern struct {
+    op: Op,
+    mode: u8 = 0,
+    a: u32 = 0,
+    b: u32 = 0,
+
+    comptime {
+        std.debug.assert(@sizeOf(Code) == 12);
+    }
+
+    pub fn condition(self: Code) Condition {
+        return @enumFromInt(self.mode);
+    }
+
+    pub fn relation(self: Code) Relation {
+        return @enumFromInt(self.mode);
+    }
+
+    pub fn vector(self: Code) Vector {
+        return @enumFromInt(self.mode);
+    }
+
+    pub fn aggregating(self: Code) AggregatingValue {
+        return @enumFromInt(self.mode);
+    }
+
+    /// Variables the instruction reads or writes.
+    pub fn variables(self: Code) [2]?VariableId {
+        return switch (self.op) {
+            .asn => .{ self.a, operandVariable(self.b) },
+            .rel => .{ operandVariable(self.a), operandVariable(self.b) },
+            .yield, .push_build, .push_build_named => .{ operandVariable(self.a), null },
+            .end_build, .trv_variable => .{ self.a, null },
+            .probe_aggregate => .{ self.b, null },
+            else => .{ null, null },
+        };
+    }
+
+    fn operandVariable(raw: u32) ?VariableId {
+        const operand = Operand.decode(raw);
+        return if (operand.kind == .variable) operand.index else null;
+    }
+};
+
+/// Assembled program: instructions plus the literal values they reference.
+pub const Bytecode = struct {
+    code: []Code,
+    constants: []Value,
+
+    pub fn deinit(self: *Bytecode, gpa: Allocator) void {
+        gpa.free(self.code);
+        gpa.free(self.constants);
+    }
+};
+
+/// Lower compiler IR to bytecode. Addresses carry over unchanged, since
+/// every IR instruction becomes exactly one `Code`.
+pub fn assemble(gpa: Allocator, ir: []const Instruction) Allocator.Error!Bytecode {
+    var assembler: Assembler = .{ .gpa = gpa };
+    errdefer assembler.constants.deinit(gpa);
+
+    const code = try gpa.alloc(Code, ir.len);
+    errdefer gpa.free(code);
+    for (ir, code) |inst, *out| {
+        out.* = try assembler.lower(inst);
+    }
+
+    return .{
+        .code = code,
+        .constants = try assembler.constants.toOwnedSlice(gpa),
+    };
+}
+
+const Assembler = struct {
+    gpa: Allocator,
+    constants: std.ArrayList(Value) = .empty,
+
+    fn lower(self: *Assembler, inst: Instruction) Allocator.Error!Code {
+        return switch (inst) {
+            .noop => .{ .op = .noop },
+            .halt => |h| .{ .op = .halt, .mode = @intFromEnum(h.condition) },
+            .trv => |axis| switch (axis) {
+                .child => .{ .op = .trv_child },
+                .descendant => .{ .op = .trv_descendant },
+                .field => |f| .{ .op = .trv_field, .a = f },
+                .child_of_kind => |k| .{ .op = .trv_child_of_kind, .a = k },
+                .descendant_of_kind => |k| .{ .op = .trv_descendant_of_kind, .a = k },
+                .field_of_kind => |f| .{ .op = .trv_field_of_kind, .a = f.field_id, .b = f.kind_id },
+                .variable_id => |v| .{ .op = .trv_variable, .a = v },
+            },
+            .asn => |x| .{ .op = .asn, .a = x.variable_id, .b = try self.operand(x.source) },
+            .rel => |x| .{
+                .op = .rel,
+                .mode = @intFromEnum(x.relation),
+                .a = try self.operand(x.a),
+                .b = try self.operand(x.b),
+            },
+            .yield => |x| .{ .op = .yield, .a = try self.operand(x.source) },
+            .probe => |p| switch (p.data) {
+                .exists => .{ .op = .probe_exists, .a = p.resume_address },
+                .nexists => .{ .op = .probe_nexists, .a = p.resume_address },
+                .aggregate => |spec| .{
+                    .op = .probe_aggregate,
+                    .mode = @intFromEnum(spec.kind),
+                    .a = p.resume_address,
+                    .b = spec.variable,
+                },
+            },
+            .call => |address| .{ .op = .call, .a = address },
+            .ret => .{ .op = .ret },
+            .jmp => |j| .{ .op = .jmp, .mode = @intFromEnum(j.mode), .a = j.address },
+            .begin_build => |v| .{ .op = .begin_build, .mode = @intFromEnum(v) },
+            .push_build => |x| if (x.name) |name|
+                .{ .op = .push_build_named, .a = try self.operand(x.source), .b = name }
+            else
+                .{ .op = .push_build, .a = try self.operand(x.source) },
+            .end_build => |v| .{ .op = .end_build, .a = v },
+            .panic => .{ .op = .panic },
+        };
+    }
+
+    fn operand(self: *Assembler, source: ValueSource) Allocator.Error!u32 {
+        const encoded: Operand = switch (source) {
+            .literal => |value| .{ .kind = .constant, .index = try self.addConstant(value) },
+            .node => |n| .{ .kind = .node, .index = @intFromEnum(n) },
+            .variable_id => |v| .{ .kind = .variable, .index = @intCast(v) },
+        };
+        return encoded.encode();
+    }
+
+    fn addConstant(self: *Assembler, value: Value) Allocator.Error!u30 {
+        // Literals are scalars and programs have few of them, so a linear
+        // scan is enough to share repeated ones.
+        for (self.constants.items, 0..) |existing, i| {
+            if (std.meta.eql(existing, value)) return @intCast(i);
+        }
+        try self.constants.append(self.gpa, value);
+        return @intCast(self.constants.items.len - 1);
+    }
+};
+
+/// Prints bytecode in a readable form, one instruction per line.
+pub const Disassembler = struct {
+    constants: []const Value,
+    strings: []const []const u8,
+
+    /// Print every instruction, prefixed with its address.
+    pub fn printAll(self: Disassembler, writer: *std.Io.Writer, code: []const Code) !void {
+        for (code, 0..) |c, i| {
+            try writer.print("{d:0>4}: ", .{i});
+            try self.print(writer, c);
+            try writer.writeByte('\n');
+        }
+    }
+
+    pub fn print(self: Disassembler, writer: *std.Io.Writer, c: Code) !void {
+        switch (c.op) {
+            .noop => try writer.print("noop", .{}),
+            .halt => try writer.print("halt {s}", .{@tagName(c.condition())}),
+            .trv_child => try writer.print("trv child", .{}),
+            .trv_descendant => try writer.print("trv descendant", .{}),
+            .trv_field => try writer.print("trv field {}", .{c.a}),
+            .trv_child_of_kind => try writer.print("trv child_of_kind {}", .{c.a}),
+            .trv_descendant_of_kind => try writer.print("trv descendant_of_kind {}", .{c.a}),
+            .trv_field_of_kind => try writer.print("trv field_of_kind {} {}", .{ c.a, c.b }),
+            .trv_variable => try writer.print("trv variable_id {}", .{c.a}),
+            .asn => {
+                try writer.print("asn {} (", .{c.a});
+                try self.printOperand(writer, c.b);
+                try writer.print(")", .{});
+            },
+            .rel => {
+                try writer.print("rel {s} (", .{@tagName(c.relation())});
+                try self.printOperand(writer, c.a);
+                try writer.print(") (", .{});
+                try self.printOperand(writer, c.b);
+                try writer.print(")", .{});
+            },
+            .yield => try writer.print("yield", .{}),
+            .probe_exists => try writer.print("probe exists {}", .{c.a}),
+            .probe_nexists => try writer.print("probe nexists {}", .{c.a}),
+            .probe_aggregate => try writer.print("probe aggregate {} {} {s}", .{ c.a, c.b, @tagName(c.aggregating()) }),
+            .call => try writer.print("call {}", .{c.a}),
+            .ret => try writer.print("ret", .{}),
+            .jmp => try writer.print("jmp {s} {}", .{ @tagName(c.condition()), c.a }),
+            .begin_build => try writer.print("begin_build {s}", .{@tagName(c.vector())}),
+            .push_build, .push_build_named => {
+                if (c.op == .push_build_named) {
+                    try writer.print("push_build {s} (", .{self.strings[c.b]});
+                } else {
+                    try writer.print("push_build (", .{});
+                }
+                try self.printOperand(writer, c.a);
+                try writer.print(")", .{});
+            },
+            .end_build => try writer.print("end_build {}", .{c.a}),
+            .panic => try writer.print("panic", .{}),
+        }
+    }
+
+    fn printOperand(self: Disassembler, writer: *std.Io.Writer, raw: u32) !void {
+        const operand = Operand.decode(raw);
+        switch (operand.kind) {
+            .constant => {
+                try writer.print("literal ", .{});
+                try self.printValue(writer, self.constants[operand.index]);
+            },
+            .node => {
+                const n: NodeValueSource = @enumFromInt(operand.index);
+                try writer.print("node {s}", .{@tagName(n)});
+            },
+            .variable => try writer.print("variable_id {}", .{operand.index}),
+        }
+    }
+
+    fn printValue(self: Disassembler, writer: *std.Io.Writer, value: Value) !void {
+        switch (value) {
+            .nothing => try writer.print("nothing", .{}),
+            .uint => |uint| try writer.print("uint {}", .{uint}),
+            .string => |s| try writer.print("string \"{f}\"", .{std.zig.fmtString(self.strings[s])}),
+            .text => |t| try writer.print("text {}..{}", .{ t.start, t.end }),
+            .kind_id => |k| try writer.print("kind_id {}", .{k}),
+            .field_id => |f| try writer.print("field_id {}", .{f}),
+            .range => try writer.print("range ...", .{}),
+            .node => try writer.print("node ...", .{}),
+            .regex => try writer.print("regex ...", .{}),
+            .record => try writer.print("record ...", .{}),
+            .list => try writer.print("list ...", .{}),
+        }
+    }
+};
+
+const testing = std.testing;
+
+test "assemble shares repeated constants" {
+    const ir = [_]Instruction{
+        .{ .asn = .{ .variable_id = 0, .source = .{ .literal = .{ .uint = 7 } } } },
+        .{ .rel = .{
+            .relation = .equals,
+            .a = .{ .variable_id = 0 },
+            .b = .{ .literal = .{ .uint = 7 } },
+        } },
+        .{ .yield = .{ .source = .{ .literal = .{ .string = 0 } } } },
+    };
+
+    var bytecode = try assemble(testing.allocator, &ir);
+    defer bytecode.deinit(testing.allocator);
+
+    try testing.expectEqual(@as(usize, 2), bytecode.constants.len);
+    try testing.expectEqual(bytecode.code[0].b, bytecode.code[1].b);
+    try testing.expectEqual(Operand.Kind.variable, Operand.decode(bytecode.code[1].a).kind);
+}
+
+test "disassembly matches the IR" {
+    const ir = [_]Instruction{
+        .{ .trv = .{ .field_of_kind = .{ .field_id = 3, .kind_id = 9 } } },
+        .{ .probe = .{ .resume_address = 5, .data = .{ .aggregate = .{ .variable = 2, .kind = .list } } } },
+        .{ .begin_build = .record },
+        .{ .push_build = .{ .source = .{ .node = .text }, .name = 0 } },
+        .{ .push_build = .{ .source = .{ .literal = .{ .string = 1 } }, .name = 0 } },
+        .{ .end_build = 4 },
+        .{ .jmp = .{ .address = 1, .mode = .not_relates } },
+    };
+
+    var bytecode = try assemble(testing.allocator, &ir);
+    defer bytecode.deinit(testing.allocator);
+
+    var out: std.Io.Writer.Allocating = .init(testing.allocator);
+    defer out.deinit();
+    const disassembler: Disassembler = .{
+        .constants = bytecode.constants,
+        .strings = &.{ "key", "value" },
+    };
+    try disassembler.printAll(&out.writer, bytecode.code);
+
+    try testing.expectEqualStrings(
+        \\0000: trv field_of_kind 3 9
+        \\0001: probe aggregate 5 2 list
+        \\0002: begin_build record
+        \\0003: push_build key (node text)
+        \\0004: push_build key (literal string "value")
+        \\0005: end_build 4
+        \\0006: jmp not_relates 1
+        \\
+    , out.written());
+}
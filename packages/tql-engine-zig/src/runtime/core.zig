@@ -16,6 +16,8 @@ const NodeKindId = types.NodeKindId;
 const Point = types.Point;
 const Range = types.Range;
 const Value = types.Value;
+const NodeRef = types.NodeRef;
+const RegexId = types.RegexId;
 const Environment = types.Environment;
 const Boundary = types.Boundary;
 const State = types.State;
@@ -27,13 +29,18 @@ const FieldIterator = types.FieldIterator;
 const DescendantIterator = types.DescendantIterator;
 const SplitIterator = types.SplitIterator;
 const SingletonIterator = types.SingletonIterator;
-const Axis = types.Axis;
 const NodeValueSource = types.NodeValueSource;
-const ValueSource = types.ValueSource;
-const Instruction = types.Instruction;
+const bytecode = @import("./bytecode.zig");
+const Code = bytecode.Code;
+const Operand = bytecode.Operand;
 const Vector = types.Vector;
 const Record = types.Record;
 const List = types.List;
+const KindIndex = @import("./kind_index.zig").KindIndex;
+const Reachability = @import("../reachability.zig").Reachability;
+const regex_set = @import("./regex_set.zig");
+const RegexSets = regex_set.RegexSets;
+const Partition = @import("./partition.zig").Partition;
 
 pub const Runtime = struct {
     const Self = @This();
@@ -42,38 +49,83 @@ pub const Runtime = struct {
     source: []const u8,
     allocator: std.mem.Allocator,
 
-    instructions: []const Instruction,
+    code: []const Code,
+    /// Literal values referenced by constant operands.
+    constants: []const Value,
     regexes: []const pcre2.Regex,
+    regex_sets: ?*const RegexSets,
+    strings: []const []const u8,
+    reachability: ?*const Reachability,
+    /// Gate on the branches of the first fan-out, if any.
+    partition: ?Partition,
+    /// Number of environment slots; every variable id is below this.
+    variable_count: u32,
 
     stack: Stack,
+    /// Nodes referenced by values. Values are kept small, so they hold an
+    /// index into this table instead of the node itself. The table grows
+    /// and shrinks with the stack; see `Frame.nodes_mark`.
+    nodes: std.ArrayList(ts.Node),
+    /// Answers descendant_of_kind traversals when present. Null disables it
+    /// in favor of walking the subtree.
+    kind_index: ?KindIndex,
+    /// Match data for `like` relations, created on the first one.
+    match_scratch: ?pcre2.MatchScratch = null,
+    /// What `like` has learned about regex sets on recent node texts.
+    regex_outcomes: regex_set.OutcomeCache = .{},
 
     pub fn init(x: struct {
         tree: *ts.Tree,
         source: []const u8,
-        instructions: []const Instruction,
+        code: []const Code,
+        constants: []const Value = &.{},
         regexes: []const pcre2.Regex,
+        /// Groups of `regexes` matched against the same text. Optional.
+        regex_sets: ?*const RegexSets = null,
+        /// See `Partition`. Optional.
+        partition: ?Partition = null,
+        /// String constants referenced by `Value.string` literals and
+        /// record keys.
+        strings: []const []const u8 = &.{},
         allocator: std.mem.Allocator,
+        index_kinds: bool = true,
+        /// Grammar data used to prune descendant searches. Optional.
+        reachability: ?*const Reachability = null,
+        /// See `ProgramImage.variable_count`. Derived from the code when not
+        /// given.
+        variable_count: ?u32 = null,
     }) Self {
         return Self{
             .tree = x.tree,
             .source = x.source,
-            .instructions = x.instructions,
+            .code = x.code,
+            .constants = x.constants,
             .regexes = x.regexes,
+            .regex_sets = x.regex_sets,
+            .strings = x.strings,
+            .reachability = x.reachability,
+            .partition = x.partition,
+            .variable_count = x.variable_count orelse countVariables(x.code),
             .stack = Stack.empty,
+            .nodes = .empty,
+            .kind_index = if (x.index_kinds) KindIndex.init(x.allocator, x.tree.rootNode(), x.reachability) else null,
             .allocator = x.allocator,
         };
     }
 
     pub fn deinit(self: *Self) void {
         self.stack.deinit(self.allocator);
+        self.nodes.deinit(self.allocator);
+        if (self.kind_index) |*index| index.deinit();
+        if (self.match_scratch) |*scratch| scratch.deinit();
     }
 
     // TODO: This can just be part of init probably
     pub fn exec(self: *Self) !void {
-        const env = try Environment.Cell.create(self.allocator);
+        const env = try Environment.Cell.create(self.allocator, self.variable_count);
         self.stack.clearAndFree(self.allocator);
-        try self.stack.append(
-            self.allocator,
+        self.nodes.clearRetainingCapacity();
+        try self.pushFrame(
             Frame{
                 .state = State{
                     .pc = 0,
@@ -85,6 +137,19 @@ pub const Runtime = struct {
         );
     }
 
+    fn pushFrame(self: *Self, frame: Frame) !void {
+        var pushed = frame;
+        pushed.nodes_mark = @intCast(self.nodes.items.len);
+        try self.stack.append(self.allocator, pushed);
+    }
+
+    /// Keep the node references made so far until the frame below `index`
+    /// pops, for a value that is being handed down to it.
+    fn pinNodes(self: *Self, index: usize) void {
+        const len: u32 = @intCast(self.nodes.items.len);
+        for (self.stack.items[index..]) |*frame| frame.nodes_mark = @max(frame.nodes_mark, len);
+    }
+
     fn deinitFrame(self: *Self) void {
         const frame = &self.stack.items[self.stack.items.len - 1];
 
@@ -111,6 +176,8 @@ pub const Runtime = struct {
             .root, .passthrough, .call => {},
         }
 
+        // Whatever the frame referenced is gone with it.
+        if (frame.nodes_mark < self.nodes.items.len) self.nodes.shrinkRetainingCapacity(frame.nodes_mark);
         self.stack.shrinkRetainingCapacity(self.stack.items.len - 1);
     }
 
@@ -156,11 +223,8 @@ pub const Runtime = struct {
                         };
                         self.deinitFrame();
                         const parent_frame = &self.stack.items[self.stack.items.len - 1];
-                        const old_env = parent_frame.state.environment;
                         const value = Value{ .list = list_ref };
-                        const new_env = try old_env.copyPut(self.allocator, agg.variable, value);
-                        parent_frame.state.environment = new_env;
-                        old_env.dereference(self.allocator);
+                        try parent_frame.state.environment.put(self.allocator, agg.variable, value);
                         parent_frame.state.pc = probe.resume_address;
                         return;
                     },
@@ -205,39 +269,143 @@ pub const Runtime = struct {
                 try self.handleBranchEnd();
             },
             .aggregate => |agg| switch (agg.value) {
-                .list => |list| try list.value.items.append(self.allocator, value.clone()),
+                .list => |list| {
+                    // The list outlives the probe and the frames above it,
+                    // in the environment of the frame below.
+                    self.pinNodes(idx);
+                    try list.value.items.append(self.allocator, value.clone());
+                },
             },
         }
         return true;
     }
 
-    fn getSource(self: *Self, state: State, vs: ValueSource) Value {
-        return switch (vs) {
-            .literal => |v| v,
-            .node => |n| switch (n) {
-                .this => {
-                    return Value{ .node = state.node };
-                },
-                .text => {
-                    const start_byte = state.node.startByte();
-                    const end_byte = state.node.endByte();
-                    const slice = self.source[start_byte..end_byte];
-                    return Value{ .string = slice };
-                },
-                .kind => {
-                    return Value{ .kind_id = state.node.kindId() };
-                },
-                .range => {
-                    const range = state.node.range();
-                    return Value{ .range = .{
-                        .start_point = .{ .row = range.start_point.row, .column = range.start_point.column },
-                        .end_point = .{ .row = range.end_point.row, .column = range.end_point.column },
-                        .start_byte = range.start_byte,
-                        .end_byte = range.end_byte,
-                    } };
-                },
+    fn getSource(self: *Self, state: State, raw: u32) !Value {
+        const operand = Operand.decode(raw);
+        return switch (operand.kind) {
+            .constant => self.constants[operand.index],
+            .node => switch (@as(NodeValueSource, @enumFromInt(operand.index))) {
+                .this => Value{ .node = try self.refNode(state.node) },
+                .text => Value{ .text = .{
+                    .start = state.node.startByte(),
+                    .end = state.node.endByte(),
+                } },
+                .kind => Value{ .kind_id = state.node.kindId() },
+                .range => Value{ .range = try self.refNode(state.node) },
+            },
+            .variable => state.environment.get(operand.index) orelse Value{ .nothing = {} },
+        };
+    }
+
+    fn refNode(self: *Self, node: ts.Node) !NodeRef {
+        // Consecutive references to the same node are common (asn then
+        // yield, repeated rel), so don't add it again.
+        const items = self.nodes.items;
+        if (items.len > 0 and items[items.len - 1].eql(node)) {
+            return @intCast(items.len - 1);
+        }
+        try self.nodes.append(self.allocator, node);
+        return @intCast(items.len);
+    }
+
+    /// The node behind a `.node` or `.range` value.
+    pub fn nodeOf(self: *const Self, ref: NodeRef) ts.Node {
+        return self.nodes.items[ref];
+    }
+
+    pub fn rangeOf(self: *const Self, ref: NodeRef) Range {
+        const range = self.nodeOf(ref).range();
+        return .{
+            .start_point = .{ .row = range.start_point.row, .column = range.start_point.column },
+            .end_point = .{ .row = range.end_point.row, .column = range.end_point.column },
+            .start_byte = range.start_byte,
+            .end_byte = range.end_byte,
+        };
+    }
+
+    /// Contents of a `.string` or `.text` value, or null for other values.
+    pub fn stringOf(self: *const Self, value: Value) ?[]const u8 {
+        return switch (value) {
+            .string => |id| self.strings[id],
+            .text => |span| self.source[span.start..span.end],
+            else => null,
+        };
+    }
+
+    pub fn regexOf(self: *const Self, id: RegexId) *const pcre2.Regex {
+        return &self.regexes[id];
+    }
+
+    fn isMatch(self: *Self, id: RegexId, haystack: []const u8) !bool {
+        if (self.match_scratch == null) self.match_scratch = try pcre2.MatchScratch.init();
+        return self.regexOf(id).isMatch(&self.match_scratch.?, haystack);
+    }
+
+    /// Whether the text or string `value` matches regex `id`. Members of a
+    /// regex set are answered from the set's scan of node text where it
+    /// can, and pcre2 results are remembered for the text's other tests.
+    fn like(self: *Self, id: RegexId, value: Value) !bool {
+        const str = self.stringOf(value) orelse return error.InvalidArguments;
+        const span = switch (value) {
+            .text => |span| span,
+            else => return self.isMatch(id, str),
+        };
+        const sets = self.regex_sets orelse return self.isMatch(id, str);
+        const member = sets.membership(id) orelse return self.isMatch(id, str);
+
+        const cached = self.regex_outcomes.get(member.set, span);
+        const outcome = &cached.entry.outcome;
+        if (!cached.found) outcome.* = sets.sets[member.set].scan(str);
+        if (outcome.known & member.bit == 0) {
+            if (try self.isMatch(id, str)) outcome.matches |= member.bit;
+            outcome.known |= member.bit;
+        }
+        return outcome.matches & member.bit != 0;
+    }
+
+    /// Whether `needle` occurs in `haystack`. Candidates are found with the
+    /// vectorized scalar search for the needle's first byte, which beats a
+    /// general substring search on the short subjects relations see.
+    fn containsLiteral(haystack: []const u8, needle: []const u8) bool {
+        if (needle.len == 0) return true;
+        if (needle.len > haystack.len) return false;
+        const last = haystack.len - needle.len;
+        var i: usize = 0;
+        while (std.mem.indexOfScalarPos(u8, haystack[0 .. last + 1], i, needle[0])) |pos| {
+            if (std.mem.eql(u8, haystack[pos + 1 ..][0 .. needle.len - 1], needle[1..])) return true;
+            i = pos + 1;
+        }
+        return false;
+    }
+
+    fn valueEql(self: *const Self, a: Value, b: Value) bool {
+        // Literal strings and source text compare by contents.
+        if (self.stringOf(a)) |a_str| {
+            const b_str = self.stringOf(b) orelse return false;
+            return std.mem.eql(u8, a_str, b_str);
+        }
+        if (@intFromEnum(a) != @intFromEnum(b)) return false;
+
+        return switch (a) {
+            .nothing => true,
+            .uint => |uint| uint == b.uint,
+            .string, .text => unreachable,
+            .range => |a_ref| {
+                const a_range = self.rangeOf(a_ref);
+                const b_range = self.rangeOf(b.range);
+                return a_range.start_byte == b_range.start_byte and
+                    a_range.end_byte == b_range.end_byte and
+                    a_range.start_point.row == b_range.start_point.row and
+                    a_range.start_point.column == b_range.start_point.column and
+                    a_range.end_point.row == b_range.end_point.row and
+                    a_range.end_point.column == b_range.end_point.column;
             },
-            .variable_id => |v| state.environment.get(v) orelse Value{ .nothing = {} },
+            .kind_id => |a_kind| a_kind == b.kind_id,
+            .field_id => |a_field| a_field == b.field_id,
+            .node => |a_ref| self.nodeOf(a_ref).eql(self.nodeOf(b.node)),
+            .regex => |a_id| a_id == b.regex or self.regexOf(a_id).eql(self.regexOf(b.regex).*),
+            .record => |a_r| a_r == b.record,
+            .list => |a_l| a_l == b.list,
         };
     }
 
@@ -247,7 +415,7 @@ pub const Runtime = struct {
     pub fn next(self: *Self) !?Value {
         while (self.stack.items.len > 0) {
             const frame = &self.stack.items[self.stack.items.len - 1];
-            if (frame.state.pc >= self.instructions.len) {
+            if (frame.state.pc >= self.code.len) {
                 self.deinitFrame();
                 return error.ExecuteOutOfBounds;
             }
@@ -257,17 +425,20 @@ pub const Runtime = struct {
             if (frame.split) |*split| {
                 const has_next = split.iterator.next();
                 if (has_next) {
-                    const old_env = frame.state.environment;
-                    const env_copy_old_frame = try old_env.copy(self.allocator);
-                    const env_copy_new_frame = try old_env.copy(self.allocator);
-                    frame.state.environment = env_copy_old_frame;
-                    old_env.dereference(self.allocator);
+                    if (split.partitioned) {
+                        const partition = self.partition.?;
+                        if (!try partition.admit(partition.context, split.iterator.node())) continue;
+                    }
+                    // Branches share the environment until one of them
+                    // writes to it.
+                    const env = frame.state.environment.reference();
+                    errdefer env.dereference(self.allocator);
 
-                    try self.stack.append(self.allocator, Frame{
+                    try self.pushFrame(Frame{
                         .state = State{
                             .pc = split.resume_pc,
                             .node = split.iterator.node(),
-                            .environment = env_copy_new_frame,
+                            .environment = env,
                         },
                         .boundary = Boundary{ .passthrough = {} },
                     });
@@ -277,9 +448,10 @@ pub const Runtime = struct {
                 continue;
             }
 
+            const c = self.code[frame.state.pc];
             if (frame.state.build != null) {
-                switch (self.instructions[frame.state.pc]) {
-                    .push_build, .end_build => {},
+                switch (c.op) {
+                    .push_build, .push_build_named, .end_build => {},
                     // The only valid syntax is:
                     // begin_build
                     // (zero or more push_build)
@@ -293,13 +465,13 @@ pub const Runtime = struct {
                 }
             }
 
-            switch (self.instructions[frame.state.pc]) {
+            switch (c.op) {
                 .noop => {
                     frame.state.pc += 1;
                 },
-                .halt => |halt_inst| {
+                .halt => {
                     frame.state.pc += 1;
-                    const should_halt = switch (halt_inst.condition) {
+                    const should_halt = switch (c.condition()) {
                         .always => true,
                         .relates => frame.state.negate_flag,
                         .not_relates => !frame.state.negate_flag,
@@ -309,58 +481,67 @@ pub const Runtime = struct {
                         try self.handleBranchEnd();
                     }
                 },
-                .trv => |axis| {
+                .trv_child,
+                .trv_descendant,
+                .trv_field,
+                .trv_child_of_kind,
+                .trv_descendant_of_kind,
+                .trv_field_of_kind,
+                .trv_variable,
+                => {
                     // Convert this frame to being a generator.
+                    const partitioned = if (self.partition) |partition| partition.address == frame.state.pc else false;
                     frame.state.pc += 1;
-                    const iterator: SplitIterator = switch (axis) {
-                        .child => .{ .child = ChildIterator.init(frame.state.node) },
-                        .descendant => .{ .descendant = DescendantIterator.init(frame.state.node) },
-                        .field => |field_id| .{ .field = FieldIterator.init(frame.state.node, field_id) },
-                        .variable_id => |var_id| blk: {
-                            const maybe_value = frame.state.environment.get(var_id);
+                    const node = frame.state.node;
+                    const iterator: SplitIterator = switch (c.op) {
+                        .trv_child => .{ .child = ChildIterator.init(node, null) },
+                        .trv_descendant => .{ .descendant = DescendantIterator.init(node, null, null) },
+                        .trv_field => .{ .field = FieldIterator.init(node, @intCast(c.a), null) },
+                        .trv_child_of_kind => .{ .child = ChildIterator.init(node, @intCast(c.a)) },
+                        .trv_descendant_of_kind => if (self.kind_index) |*index|
+                            .{ .indexed = try index.descendants(node, @intCast(c.a)) }
+                        else
+                            .{ .descendant = DescendantIterator.init(node, @intCast(c.a), self.reachability) },
+                        .trv_field_of_kind => .{ .field = FieldIterator.init(node, @intCast(c.a), @intCast(c.b)) },
+                        .trv_variable => blk: {
+                            const maybe_value = frame.state.environment.get(c.a);
                             const maybe_node = try if (maybe_value) |v| switch (v) {
                                 .node => |n| n,
                                 .nothing => null,
                                 else => error.UnexpectedType,
                             } else null;
-                            break :blk .{ .singleton = SingletonIterator.init(maybe_node) };
+                            break :blk .{ .singleton = SingletonIterator.init(if (maybe_node) |ref| self.nodeOf(ref) else null) };
                         },
+                        else => unreachable,
                     };
 
                     frame.split = .{
                         .iterator = iterator,
                         .resume_pc = frame.state.pc,
+                        .partitioned = partitioned,
                     };
                 },
-                .asn => |x| {
+                .asn => {
                     frame.state.pc += 1;
-                    const value = self.getSource(frame.state, x.source);
+                    const value = try self.getSource(frame.state, c.b);
                     switch (value) {
                         // NOTE: Maybe we should panic here.
                         .nothing => {},
-                        else => {
-                            const old_env = frame.state.environment;
-                            const new_environment = try old_env.copyPut(
-                                self.allocator,
-                                x.variable_id,
-                                value.clone(),
-                            );
-                            frame.state.environment = new_environment;
-                            old_env.dereference(self.allocator);
-                        },
+                        else => try frame.state.environment.put(
+                            self.allocator,
+                            c.a,
+                            value.clone(),
+                        ),
                     }
                 },
-                .rel => |x| {
+                .rel => {
                     frame.state.pc += 1;
-                    const a_value = self.getSource(frame.state, x.a);
-                    const b_value = self.getSource(frame.state, x.b);
-                    const relates = try switch (x.relation) {
-                        .equals => a_value.eql(b_value),
-                        .like => switch (a_value) {
-                            .string => |str| switch (b_value) {
-                                .regex => |*regex| regex.do_test(str),
-                                else => error.InvalidArguments,
-                            },
+                    const a_value = try self.getSource(frame.state, c.a);
+                    const b_value = try self.getSource(frame.state, c.b);
+                    const relates = try switch (c.relation()) {
+                        .equals => self.valueEql(a_value, b_value),
+                        .like => switch (b_value) {
+                            .regex => |id| self.like(id, a_value),
                             else => error.InvalidArguments,
                         },
                         .lt => switch (a_value) {
@@ -377,42 +558,48 @@ pub const Runtime = struct {
                             },
                             else => error.InvalidArguments,
                         },
+                        .starts_with, .ends_with, .contains => |relation| if (self.stringOf(a_value)) |str|
+                            if (self.stringOf(b_value)) |literal| switch (relation) {
+                                .starts_with => std.mem.startsWith(u8, str, literal),
+                                .ends_with => std.mem.endsWith(u8, str, literal),
+                                .contains => containsLiteral(str, literal),
+                                else => unreachable,
+                            } else error.InvalidArguments
+                        else
+                            error.InvalidArguments,
                     };
                     frame.state.negate_flag = relates;
                 },
-                .yield => |source| {
+                .yield => {
                     frame.state.pc += 1;
-                    const value = self.getSource(frame.state, source.source);
+                    const value = try self.getSource(frame.state, c.a);
                     if (try self.handleYield(value)) {
                         continue;
                     } else {
                         return value;
                     }
                 },
-                .probe => |probe_inst| {
+                .probe_exists, .probe_nexists, .probe_aggregate => {
                     frame.state.pc += 1;
 
-                    const old_env = frame.state.environment;
-                    const env_copy_old_frame = try old_env.copy(self.allocator);
-                    const env_copy_new_frame = try old_env.copy(self.allocator);
-                    frame.state.environment = env_copy_old_frame;
-                    old_env.dereference(self.allocator);
+                    const env = frame.state.environment.reference();
+                    errdefer env.dereference(self.allocator);
 
-                    const boundary = switch (probe_inst.data) {
-                        .exists => Boundary{ .probe = .{
-                            .resume_address = probe_inst.resume_address,
+                    const boundary = switch (c.op) {
+                        .probe_exists => Boundary{ .probe = .{
+                            .resume_address = c.a,
                             .data = .exists,
                         } },
-                        .nexists => Boundary{ .probe = .{
-                            .resume_address = probe_inst.resume_address,
+                        .probe_nexists => Boundary{ .probe = .{
+                            .resume_address = c.a,
                             .data = .nexists,
                         } },
-                        .aggregate => |spec| switch (spec.kind) {
+                        .probe_aggregate => switch (c.aggregating()) {
                             .list => Boundary{
                                 .probe = .{
-                                    .resume_address = probe_inst.resume_address,
+                                    .resume_address = c.a,
                                     .data = .{ .aggregate = .{
-                                        .variable = spec.variable,
+                                        .variable = c.b,
                                         .value = .{
                                             .list = try Rc(List).create(self.allocator, List.init()),
                                         },
@@ -420,31 +607,29 @@ pub const Runtime = struct {
                                 },
                             },
                         },
+                        else => unreachable,
                     };
 
-                    try self.stack.append(self.allocator, Frame{
+                    try self.pushFrame(Frame{
                         .state = State{
                             .pc = frame.state.pc,
                             .node = frame.state.node,
-                            .environment = env_copy_new_frame,
+                            .environment = env,
                         },
                         .boundary = boundary,
                     });
                 },
-                .call => |target_address| {
+                .call => {
                     frame.state.pc += 1;
 
-                    const old_env = frame.state.environment;
-                    const env_copy_old_frame = try old_env.copy(self.allocator);
-                    const env_copy_new_frame = try old_env.copy(self.allocator);
-                    frame.state.environment = env_copy_old_frame;
-                    old_env.dereference(self.allocator);
+                    const env = frame.state.environment.reference();
+                    errdefer env.dereference(self.allocator);
 
-                    try self.stack.append(self.allocator, Frame{
+                    try self.pushFrame(Frame{
                         .state = State{
-                            .pc = target_address,
+                            .pc = c.a,
                             .node = frame.state.node,
-                            .environment = env_copy_new_frame,
+                            .environment = env,
                         },
                         .boundary = Boundary{ .call = {} },
                     });
@@ -469,23 +654,23 @@ pub const Runtime = struct {
                         return error.StackCorruption;
                     }
                 },
-                .jmp => |jmp_inst| {
+                .jmp => {
                     frame.state.pc += 1;
-                    const should_jump = switch (jmp_inst.mode) {
+                    const should_jump = switch (c.condition()) {
                         .always => true,
                         .relates => frame.state.negate_flag,
                         .not_relates => !frame.state.negate_flag,
                     };
 
                     if (should_jump) {
-                        frame.state.pc = jmp_inst.address;
+                        frame.state.pc = c.a;
                     }
                 },
-                .begin_build => |vector| {
+                .begin_build => {
                     frame.state.pc += 1;
-                    switch (vector) {
+                    switch (c.vector()) {
                         .record => {
-                            const rc = try Rc(Record).create(self.allocator, Record.init(self.allocator));
+                            const rc = try Rc(Record).create(self.allocator, Record.init());
                             frame.state.build = .{ .record = rc };
                         },
                         .list => {
@@ -494,21 +679,21 @@ pub const Runtime = struct {
                         },
                     }
                 },
-                .push_build => |info| {
+                .push_build, .push_build_named => {
                     frame.state.pc += 1;
                     const build = try if (frame.state.build) |b| b else error.InvalidBuildConstruction;
-                    const value = self.getSource(frame.state, info.source).clone();
+                    const value = (try self.getSource(frame.state, c.a)).clone();
                     switch (build) {
                         .record => |rc| {
-                            const name = try if (info.name) |n| n else error.InvalidBuildConstruction;
-                            try rc.value.map.put(name, value);
+                            if (c.op != .push_build_named) return error.InvalidBuildConstruction;
+                            try rc.value.put(self.allocator, self.strings[c.b], value);
                         },
                         .list => |rc| {
                             try rc.value.items.append(self.allocator, value);
                         },
                     }
                 },
-                .end_build => |variable_id| {
+                .end_build => {
                     frame.state.pc += 1;
                     const build = try if (frame.state.build) |b| b else error.InvalidBuildConstruction;
                     frame.state.build = null;
@@ -516,10 +701,7 @@ pub const Runtime = struct {
                         .record => |rc| .{ .record = rc },
                         .list => |rc| .{ .list = rc },
                     };
-                    const old_env = frame.state.environment;
-                    const new_env = try old_env.copyPut(self.allocator, variable_id, value);
-                    frame.state.environment = new_env;
-                    old_env.dereference(self.allocator);
+                    try frame.state.environment.put(self.allocator, c.a, value);
                 },
                 .panic => {
                     return error.PanicInstruction;
@@ -530,3 +712,15 @@ pub const Runtime = struct {
         return null;
     }
 };
+
+/// One more than the largest variable id the code mentions, for callers
+/// that run code without a `ProgramImage`.
+fn countVariables(code: []const Code) u32 {
+    var count: u32 = 0;
+    for (code) |c| {
+        for (c.variables()) |id| {
+            if (id) |v| count = @max(count, v + 1);
+        }
+    }
+    return count;
+}
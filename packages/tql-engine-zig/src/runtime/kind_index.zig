@@ -0,0 +1,147 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const ts = @import("tree-sitter");
+
+const types = @import("./types.zig");
+const NodeKindId = types.NodeKindId;
+const Reachability = @import("../reachability.zig").Reachability;
+const PreorderWalker = @import("./preorder_walker.zig").PreorderWalker;
+
+/// Lazily built per-tree index from node kind to every named node of that
+/// kind, in document order. A posting list is built with one walk of the
+/// tree the first time its kind is requested. Descendant lookups are then a
+/// binary search over start bytes instead of a walk of the whole subtree.
+pub const KindIndex = struct {
+    const Self = @This();
+
+    pub const Postings = struct {
+        /// Start bytes of `nodes`, kept separately so the binary search stays
+        /// in cache. Non-decreasing, since the nodes are in pre-order.
+        starts: []const u32,
+        nodes: []const ts.Node,
+    };
+
+    root: ts.Node,
+    postings: std.AutoHashMapUnmanaged(NodeKindId, Postings),
+    /// If set, building a posting list skips subtrees that can't contain
+    /// its kind.
+    reachability: ?*const Reachability,
+    allocator: Allocator,
+
+    pub fn init(allocator: Allocator, root: ts.Node, reachability: ?*const Reachability) Self {
+        return .{
+            .root = root,
+            .postings = .empty,
+            .reachability = reachability,
+            .allocator = allocator,
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        var it = self.postings.valueIterator();
+        while (it.next()) |p| {
+            self.allocator.free(p.starts);
+            self.allocator.free(p.nodes);
+        }
+        self.postings.deinit(self.allocator);
+    }
+
+    /// Posting list for `kind_id`, building it on first use. The returned
+    /// slices stay valid until `deinit`.
+    pub fn get(self: *Self, kind_id: NodeKindId) Allocator.Error!Postings {
+        const entry = try self.postings.getOrPut(self.allocator, kind_id);
+        if (entry.found_existing) return entry.value_ptr.*;
+        errdefer self.postings.removeByPtr(entry.key_ptr);
+
+        var starts: std.ArrayList(u32) = .empty;
+        defer starts.deinit(self.allocator);
+        var nodes: std.ArrayList(ts.Node) = .empty;
+        defer nodes.deinit(self.allocator);
+
+        // The root is nobody's strict descendant, so it's never needed.
+        var walker = PreorderWalker.init(self.root);
+        defer walker.deinit();
+        while (walker.nextNamed()) {
+            const n = walker.node();
+            if (n.kindId() == kind_id) {
+                try starts.append(self.allocator, n.startByte());
+                try nodes.append(self.allocator, n);
+            } else if (self.reachability) |r| {
+                if (r.canPrune(n, kind_id)) walker.skipSubtree();
+            }
+        }
+
+        const owned_starts = try starts.toOwnedSlice(self.allocator);
+        errdefer self.allocator.free(owned_starts);
+        const owned_nodes = try nodes.toOwnedSlice(self.allocator);
+        entry.value_ptr.* = .{ .starts = owned_starts, .nodes = owned_nodes };
+        return entry.value_ptr.*;
+    }
+
+    /// Iterate the strict descendants of `parent` that have kind `kind_id`,
+    /// in document order.
+    pub fn descendants(self: *Self, parent: ts.Node, kind_id: NodeKindId) Allocator.Error!Iterator {
+        const postings = try self.get(kind_id);
+        const start_byte = parent.startByte();
+        const index = std.sort.lowerBound(u32, postings.starts, start_byte, orderU32);
+        return .{
+            .postings = postings,
+            .parent = parent,
+            .start_byte = start_byte,
+            .end_byte = parent.endByte(),
+            .index = index,
+        };
+    }
+
+    fn orderU32(context: u32, item: u32) std.math.Order {
+        return std.math.order(context, item);
+    }
+
+    pub const Iterator = struct {
+        postings: Postings,
+        parent: ts.Node,
+        start_byte: u32,
+        end_byte: u32,
+        index: usize,
+        current: ts.Node = undefined,
+
+        pub fn node(self: *const Iterator) ts.Node {
+            return self.current;
+        }
+
+        pub fn next(self: *Iterator) bool {
+            while (self.index < self.postings.nodes.len) {
+                const start = self.postings.starts[self.index];
+                if (start > self.end_byte) return false;
+                const candidate = self.postings.nodes[self.index];
+                self.index += 1;
+
+                if (candidate.endByte() > self.end_byte) continue;
+                if (self.isAmbiguous(start, candidate.endByte()) and
+                    !isStrictDescendant(candidate, self.parent)) continue;
+
+                self.current = candidate;
+                return true;
+            }
+            return false;
+        }
+
+        /// Byte ranges alone can't tell a descendant from the parent itself,
+        /// a same-range ancestor, or a zero-width sibling on either edge.
+        fn isAmbiguous(self: *const Iterator, start: u32, end: u32) bool {
+            if (start == self.start_byte and end == self.end_byte) return true;
+            return start == end and (start == self.start_byte or start == self.end_byte);
+        }
+
+        fn isStrictDescendant(candidate: ts.Node, ancestor: ts.Node) bool {
+            var curr = candidate.parent();
+            while (curr) |c| : (curr = c.parent()) {
+                if (c.eql(ancestor)) return true;
+                if (c.startByte() < ancestor.startByte()) return false;
+            }
+            return false;
+        }
+
+        pub fn deinit(_: *Iterator) void {}
+    };
+};
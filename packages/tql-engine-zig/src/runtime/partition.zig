@@ -0,0 +1,106 @@
+//! Control over the branches of a program's first fan-out.
+//!
+//! Compiled programs bind `@root` and then fan out over its children or
+//! descendants. Traversals only go down, so when nothing after that fan-out
+//! reads a variable bound before it, each branch sees nothing but its own
+//! node's subtree and yields the same values whatever happens elsewhere in
+//! the tree. A `Partition` lets the caller decide branch by branch whether
+//! to run it, e.g. to reuse what an unedited branch yielded last time.
+const std = @import("std");
+const ts = @import("tree-sitter");
+
+const types = @import("types.zig");
+const Address = types.Address;
+const bytecode = @import("bytecode.zig");
+const Code = bytecode.Code;
+
+pub const Partition = struct {
+    /// Address of the fan-out's traversal, from `find`.
+    address: Address,
+    context: *anyopaque,
+    /// Called with each branch's node, in order, before the branch runs.
+    /// Branches it rejects are skipped.
+    admit: *const fn (context: *anyopaque, node: ts.Node) error{OutOfMemory}!bool,
+
+    /// The address of `code`'s first fan-out, if its branches are
+    /// independent of each other.
+    pub fn find(code: []const Code) ?Address {
+        // Variables bound before the fan-out.
+        var prelude: u64 = 0;
+        const fan_out: Address = for (code, 0..) |c, pc| {
+            switch (c.op) {
+                .asn => {
+                    if (c.a >= @bitSizeOf(u64)) return null;
+                    prelude |= @as(u64, 1) << @intCast(c.a);
+                },
+                // Singletons, which don't branch.
+                .trv_variable => {},
+                .trv_child,
+                .trv_descendant,
+                .trv_field,
+                .trv_child_of_kind,
+                .trv_descendant_of_kind,
+                .trv_field_of_kind,
+                => break @intCast(pc),
+                else => return null,
+            }
+        } else return null;
+
+        for (code[fan_out + 1 ..]) |c| {
+            switch (c.op) {
+                .jmp, .call, .probe_exists, .probe_nexists, .probe_aggregate => {
+                    if (c.a <= fan_out) return null;
+                },
+                else => {},
+            }
+            for (c.variables()) |id| {
+                const v = id orelse continue;
+                if (v < @bitSizeOf(u64) and prelude & (@as(u64, 1) << @intCast(v)) != 0) return null;
+            }
+        }
+        return fan_out;
+    }
+};
+
+const testing = std.testing;
+const Instruction = types.Instruction;
+const Axis = types.Axis;
+
+fn findIn(instructions: []const Instruction) !?Address {
+    var program = try bytecode.assemble(testing.allocator, instructions);
+    defer program.deinit(testing.allocator);
+    return Partition.find(program.code);
+}
+
+test "partition: the first traversal past the prelude" {
+    try testing.expectEqual(2, try findIn(&.{
+        .{ .asn = .{ .variable_id = 0, .source = .{ .node = .this } } },
+        .{ .trv = .{ .variable_id = 0 } },
+        .{ .trv = Axis{ .child_of_kind = 1 } },
+        .{ .asn = .{ .variable_id = 1, .source = .{ .node = .this } } },
+        .{ .trv = .{ .variable_id = 1 } },
+        .{ .trv = Axis{ .descendant = {} } },
+        .{ .yield = .{ .source = .{ .variable_id = 1 } } },
+        .{ .halt = .{} },
+    }));
+}
+
+test "partition: branches that read the prelude are not independent" {
+    // A second traversal from the root, as in `@root > a as @x, @root > b as @y`.
+    try testing.expectEqual(null, try findIn(&.{
+        .{ .asn = .{ .variable_id = 0, .source = .{ .node = .this } } },
+        .{ .trv = .{ .variable_id = 0 } },
+        .{ .trv = Axis{ .child = {} } },
+        .{ .asn = .{ .variable_id = 1, .source = .{ .node = .this } } },
+        .{ .trv = .{ .variable_id = 0 } },
+        .{ .trv = Axis{ .child = {} } },
+        .{ .yield = .{ .source = .{ .variable_id = 1 } } },
+        .{ .halt = .{} },
+    }));
+    // Nothing to partition.
+    try testing.expectEqual(null, try findIn(&.{
+        .{ .asn = .{ .variable_id = 0, .source = .{ .node = .this } } },
+        .{ .yield = .{ .source = .{ .variable_id = 0 } } },
+        .{ .halt = .{} },
+    }));
+}
@@ -0,0 +1,143 @@
+//! A test on a file's raw bytes that rules it out before it is parsed.
+//!
+//! The compiler derives strings that must occur in any file the query can
+//! produce output for (see src/compiler/necessary_literals.zig). They form
+//! clauses: a file is admitted when, for every clause, it contains at least
+//! one of the clause's literals. All literals are looked for in a single
+//! pass over the file, a vector block at a time.
+const std = @import("std");
+
+const types = @import("types.zig");
+const StringId = types.StringId;
+
+pub const Prefilter = struct {
+    /// Upper bounds the compiler keeps to, and images are checked against.
+    pub const max_clauses = 16;
+    pub const max_literals = 64;
+
+    /// End of each clause's literals in `literals`.
+    clause_ends: []const u32 = &.{},
+    /// Indices into the string pool. Never empty strings.
+    literals: []const StringId = &.{},
+
+    const block_len = std.simd.suggestVectorLength(u8) orelse 16;
+    const Block = @Vector(block_len, u8);
+    const BlockMask = std.meta.Int(.unsigned, block_len);
+    const ClauseSet = std.meta.Int(.unsigned, max_clauses);
+    const LiteralSet = std.meta.Int(.unsigned, max_literals);
+
+    /// Whether the query needs `bytes` parsed at all. An empty prefilter
+    /// admits everything.
+    pub fn admits(self: Prefilter, strings: []const []const u8, bytes: []const u8) bool {
+        if (self.clause_ends.len == 0) return true;
+        std.debug.assert(self.clause_ends.len <= max_clauses);
+        std.debug.assert(self.literals.len <= max_literals);
+
+        var clause_of: [max_literals]u8 = undefined;
+        var start: u32 = 0;
+        for (self.clause_ends, 0..) |end, clause| {
+            @memset(clause_of[start..end], @intCast(clause));
+            start = end;
+        }
+
+        var unsatisfied: ClauseSet = std.math.maxInt(ClauseSet) >> @intCast(max_clauses - self.clause_ends.len);
+        // Literals still worth looking for in the rest of the file.
+        var pending: LiteralSet = std.math.maxInt(LiteralSet) >> @intCast(max_literals - self.literals.len);
+
+        var i: usize = 0;
+        while (i + block_len <= bytes.len and unsatisfied != 0) : (i += block_len) {
+            const block: Block = bytes[i..][0..block_len].*;
+            var it = pending;
+            while (it != 0) : (it &= it - 1) {
+                const literal: u6 = @intCast(@ctz(it));
+                const clause_bit = @as(ClauseSet, 1) << @intCast(clause_of[literal]);
+                if (unsatisfied & clause_bit == 0) {
+                    pending &= ~(@as(LiteralSet, 1) << literal);
+                    continue;
+                }
+
+                const needle = strings[self.literals[literal]];
+                if (i + needle.len - 1 + block_len > bytes.len) {
+                    // Too close to the end to load a block at the needle's
+                    // last byte; search what is left the plain way.
+                    if (std.mem.indexOfPos(u8, bytes, i, needle) != null) unsatisfied &= ~clause_bit;
+                    pending &= ~(@as(LiteralSet, 1) << literal);
+                    continue;
+                }
+
+                // Candidates are where both the first and the last byte
+                // match; most blocks have none.
+                const last: Block = bytes[i + needle.len - 1 ..][0..block_len].*;
+                const first_matches: BlockMask = @bitCast(block == @as(Block, @splat(needle[0])));
+                const last_matches: BlockMask = @bitCast(last == @as(Block, @splat(needle[needle.len - 1])));
+                var candidates = first_matches & last_matches;
+                while (candidates != 0) : (candidates &= candidates - 1) {
+                    const at = i + @ctz(candidates);
+                    if (std.mem.eql(u8, bytes[at..][0..needle.len], needle)) {
+                        unsatisfied &= ~clause_bit;
+                        pending &= ~(@as(LiteralSet, 1) << literal);
+                        break;
+                    }
+                }
+            }
+        }
+
+        // The tail shorter than a block.
+        var it = pending;
+        while (it != 0 and unsatisfied != 0) : (it &= it - 1) {
+            const literal: u6 = @intCast(@ctz(it));
+            const clause_bit = @as(ClauseSet, 1) << @intCast(clause_of[literal]);
+            if (unsatisfied & clause_bit == 0) continue;
+            if (std.mem.indexOfPos(u8, bytes, i, strings[self.literals[literal]]) != null) unsatisfied &= ~clause_bit;
+        }
+
+        return unsatisfied == 0;
+    }
+};
+
+const testing = std.testing;
+
+test "empty prefilter admits everything" {
+    const prefilter: Prefilter = .{};
+    try testing.expect(prefilter.admits(&.{}, ""));
+    try testing.expect(prefilter.admits(&.{}, "anything"));
+}
+
+test "every clause needs one of its literals" {
+    const strings = [_][]const u8{ "class", "def", "import", "lambda" };
+    // class and (def or import or lambda)
+    const prefilter: Prefilter = .{
+        .clause_ends = &.{ 1, 4 },
+        .literals = &.{ 0, 1, 2, 3 },
+    };
+    try testing.expect(prefilter.admits(&strings, "class A:\n    def f(self): pass\n"));
+    try testing.expect(prefilter.admits(&strings, "import os\nclass A: pass\n"));
+    try testing.expect(!prefilter.admits(&strings, "class A: pass\n"));
+    try testing.expect(!prefilter.admits(&strings, "def f(): pass\n"));
+    try testing.expect(!prefilter.admits(&strings, ""));
+}
+
+test "literals are found at any offset" {
+    const strings = [_][]const u8{ "needle", "n" };
+    const single: Prefilter = .{ .clause_ends = &.{1}, .literals = &.{0} };
+    const byte: Prefilter = .{ .clause_ends = &.{1}, .literals = &.{1} };
+
+    var haystack: [200]u8 = undefined;
+    for (0..haystack.len - "needle".len + 1) |at| {
+        @memset(&haystack, 'x');
+        @memcpy(haystack[at..][0.."needle".len], "needle");
+        try testing.expect(single.admits(&strings, &haystack));
+        try testing.expect(byte.admits(&strings, &haystack));
+        // Cut off just before the needle ends.
+        try testing.expect(!single.admits(&strings, haystack[0 .. at + "needle".len - 1]));
+    }
+}
+
+test "partial matches are not matches" {
+    const strings = [_][]const u8{"needle"};
+    const prefilter: Prefilter = .{ .clause_ends = &.{1}, .literals = &.{0} };
+    // Same first and last byte as the needle, all over.
+    const haystack = "neeeee nxxxxe needl eedle " ** 8;
+    try testing.expect(!prefilter.admits(&strings, haystack));
+    try testing.expect(prefilter.admits(&strings, haystack ++ "needle"));
+}
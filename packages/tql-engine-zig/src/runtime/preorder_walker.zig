@@ -0,0 +1,62 @@
+const ts = @import("tree-sitter");
+
+/// Streaming pre-order walk over the strict descendants of a node. Moves a
+/// single cursor with first-child/next-sibling/parent steps, so each step is
+/// amortized O(1) instead of re-seeking from the root like `gotoDescendant`.
+pub const PreorderWalker = struct {
+    const Self = @This();
+
+    cursor: ts.TreeCursor,
+    /// Depth of the cursor below the root. The walk ends when it would
+    /// climb back to depth 0.
+    depth: u32,
+    /// Don't descend into the current node on the next step.
+    skip_children: bool,
+
+    pub fn init(root: ts.Node) Self {
+        return .{
+            .cursor = root.walk(),
+            .depth = 0,
+            .skip_children = false,
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.cursor.destroy();
+    }
+
+    pub fn node(self: *const Self) ts.Node {
+        return self.cursor.node();
+    }
+
+    /// Don't visit the descendants of the current node.
+    pub fn skipSubtree(self: *Self) void {
+        self.skip_children = true;
+    }
+
+    /// Move to the next node in pre-order, named or not.
+    pub fn next(self: *Self) bool {
+        const descend = !self.skip_children;
+        self.skip_children = false;
+
+        if (descend and self.cursor.gotoFirstChild()) {
+            self.depth += 1;
+            return true;
+        }
+        while (self.depth > 0) {
+            if (self.cursor.gotoNextSibling()) return true;
+            _ = self.cursor.gotoParent();
+            self.depth -= 1;
+        }
+        return false;
+    }
+
+    /// Move to the next named node in pre-order. Anonymous nodes are still
+    /// descended into, since some grammars hang named nodes off them.
+    pub fn nextNamed(self: *Self) bool {
+        while (self.next()) {
+            if (self.cursor.node().isNamed()) return true;
+        }
+        return false;
+    }
+};
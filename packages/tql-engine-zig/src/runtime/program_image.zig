@@ -1,30 +1,72 @@
 const std = @import("std");
+const builtin = @import("builtin");
 const Allocator = std.mem.Allocator;
 
 const runtime = @import("../runtime.zig");
-const Instruction = runtime.Instruction;
+const Code = runtime.Code;
+const Value = runtime.Value;
+const Prefilter = runtime.Prefilter;
+const RegexSets = runtime.RegexSets;
 
 const pcre2 = @import("../regex.zig");
+const Reachability = @import("../reachability.zig").Reachability;
 
 pub const ProgramImage = struct {
-    instructions: []const Instruction,
+    /// Where the code and the contents of `strings` and `regex_sources`
+    /// live when the image was loaded from a file rather than compiled.
+    pub const Backing = union(enum) {
+        /// Each array and string is allocated separately.
+        none,
+        mapped: []align(std.heap.page_size_min) const u8,
+        owned: []align(8) const u8,
+    };
+
+    code: []const Code,
+    /// Literal values referenced by constant operands.
+    constants: []const Value,
     regexes: []pcre2.Regex,
+    /// Pattern of each regex, kept so the image can be serialized.
+    regex_sources: []const []const u8,
     strings: []const []const u8,
     // IMPROVE: array of entry (variable id, string index)
     variable_map: std.hash_map.AutoHashMap(runtime.VariableId, []const u8),
+    /// Number of variable ids the program uses, i.e. environment slots.
+    /// Ids are dense, so every id is below this.
+    variable_count: u32,
+    /// Grammar reachability the program was compiled against, if loaded.
+    /// Passed on to the runtime to prune descendant searches.
+    reachability: ?Reachability = null,
+    /// Literals a file must contain for the program to yield anything.
+    prefilter: Prefilter = .{},
+    /// Regexes matched against the same text, evaluated together.
+    regex_sets: RegexSets = .{},
+    backing: Backing = .none,
 
     allocator: Allocator,
 
     pub fn deinit(self: *ProgramImage) void {
         self.variable_map.deinit();
-        self.allocator.free(self.instructions);
+        if (self.reachability) |*r| r.deinit();
+        self.allocator.free(self.constants);
         for (self.regexes) |*regex| {
             regex.deinit();
         }
         self.allocator.free(self.regexes);
-        for (self.strings) |str| {
-            self.allocator.free(str);
+        self.regex_sets.deinit(self.allocator);
+        switch (self.backing) {
+            .none => {
+                self.allocator.free(self.code);
+                self.allocator.free(self.prefilter.clause_ends);
+                self.allocator.free(self.prefilter.literals);
+                self.allocator.free(self.regex_sets.set_of);
+                for (self.regex_sources) |src| self.allocator.free(src);
+                for (self.strings) |str| self.allocator.free(str);
+            },
+            // `Engine.loadImage` isn't available without mmap.
+            .mapped => |bytes| if (builtin.os.tag == .wasi) unreachable else std.posix.munmap(bytes),
+            .owned => |bytes| self.allocator.free(bytes),
         }
+        self.allocator.free(self.regex_sources);
         self.allocator.free(self.strings);
     }
 };
@@ -0,0 +1,318 @@
+//! Regexes matched against the same text, evaluated together.
+//!
+//! The compiler groups the regexes a query matches against the same
+//! expression into sets. The first `like` of a set's member against a text
+//! scans it once with an Aho-Corasick automaton over the literals of every
+//! member (see compiler/regex_literals.zig). That decides the members that
+//! reduce to literal checks outright and rules out those whose required
+//! literals are missing; the others run pcre2 when first asked about. The
+//! outcome is cached per text span, so the rest of the set's members tested
+//! on the same node cost a lookup.
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+const types = @import("types.zig");
+const Relation = types.Relation;
+const RegexId = types.RegexId;
+const Span = types.Span;
+const AhoCorasick = @import("../ds/aho_corasick.zig").AhoCorasick;
+const regex_literals = @import("../compiler/regex_literals.zig");
+
+/// One bit per member of a set.
+pub const Mask = u64;
+
+pub const RegexSet = struct {
+    pub const max_members = @bitSizeOf(Mask);
+
+    pub const Outcome = struct {
+        /// Members whose result the scan decided.
+        known: Mask = 0,
+        /// Of `known`, those that match.
+        matches: Mask = 0,
+    };
+
+    const Check = struct {
+        member: u8,
+        relation: Relation,
+        len: u32,
+    };
+
+    /// Members that match exactly when one of their checks relates.
+    exact: Mask = 0,
+    /// Members that can only match when one of their checks relates.
+    prefiltered: Mask = 0,
+    /// Members with a check on an empty literal, which the automaton can't
+    /// report: those that relate to any text, and those that only relate to
+    /// empty text.
+    hits_always: Mask = 0,
+    hits_if_empty: Mask = 0,
+    /// The check behind each automaton pattern.
+    checks: []const Check = &.{},
+    /// Null when no member has literals to look for.
+    automaton: ?AhoCorasick = null,
+
+    /// Analyze `patterns`, the set's members in bit order.
+    pub fn init(allocator: Allocator, patterns: []const []const u8) !RegexSet {
+        std.debug.assert(patterns.len <= max_members);
+
+        const reductions = try allocator.alloc(regex_literals.Reduction, patterns.len);
+        defer allocator.free(reductions);
+        var reduced: usize = 0;
+        defer {
+            for (reductions[0..reduced]) |reduction| reduction.deinit(allocator);
+        }
+        for (reductions, patterns) |*reduction, pattern| {
+            reduction.* = try regex_literals.reduce(allocator, pattern);
+            reduced += 1;
+        }
+
+        var self: RegexSet = .{};
+        var checks: std.ArrayList(Check) = .empty;
+        errdefer checks.deinit(allocator);
+        var literals: std.ArrayList([]const u8) = .empty;
+        defer literals.deinit(allocator);
+        for (reductions, 0..) |reduction, member| {
+            const bit = @as(Mask, 1) << @intCast(member);
+            const member_checks = switch (reduction) {
+                .none => continue,
+                .exact => |member_checks| blk: {
+                    self.exact |= bit;
+                    break :blk member_checks;
+                },
+                .prefilter => |member_checks| blk: {
+                    self.prefiltered |= bit;
+                    break :blk member_checks;
+                },
+            };
+            for (member_checks) |check| {
+                if (check.literal.len == 0) {
+                    if (check.relation == .equals) self.hits_if_empty |= bit else self.hits_always |= bit;
+                    continue;
+                }
+                try checks.append(allocator, .{
+                    .member = @intCast(member),
+                    .relation = check.relation,
+                    .len = @intCast(check.literal.len),
+                });
+                try literals.append(allocator, check.literal);
+            }
+        }
+
+        if (literals.items.len > 0) {
+            self.automaton = AhoCorasick.init(allocator, literals.items) catch |err| switch (err) {
+                // Leave every member to pcre2.
+                error.TooManyStates => {
+                    checks.deinit(allocator);
+                    return .{};
+                },
+                else => |e| return e,
+            };
+        }
+        self.checks = try checks.toOwnedSlice(allocator);
+        return self;
+    }
+
+    pub fn deinit(self: *RegexSet, allocator: Allocator) void {
+        allocator.free(self.checks);
+        if (self.automaton) |*automaton| automaton.deinit();
+    }
+
+    /// Decide what one pass over `text` can.
+    pub fn scan(self: *const RegexSet, text: []const u8) Outcome {
+        var hits = self.hits_always;
+        if (text.len == 0) hits |= self.hits_if_empty;
+
+        if (self.automaton) |*automaton| {
+            const literal_members = self.exact | self.prefiltered;
+            var it = automaton.iterator(text);
+            while (it.next()) |match| {
+                const check = self.checks[match.pattern];
+                const bit = @as(Mask, 1) << @intCast(check.member);
+                if (hits & bit != 0) continue;
+                const start = match.end - check.len;
+                const relates = switch (check.relation) {
+                    .contains => true,
+                    .starts_with => start == 0,
+                    .ends_with => match.end == text.len,
+                    .equals => start == 0 and match.end == text.len,
+                    else => unreachable,
+                };
+                if (!relates) continue;
+                hits |= bit;
+                if (hits & literal_members == literal_members) break;
+            }
+        }
+
+        return .{
+            .known = self.exact | (self.prefiltered & ~hits),
+            .matches = self.exact & hits,
+        };
+    }
+};
+
+/// A program's regex sets and which regexes belong to them.
+pub const RegexSets = struct {
+    pub const none = std.math.maxInt(u32);
+
+    /// Set of each regex by id, or `none`. Empty when the program has no
+    /// sets. Not owned; see `ProgramImage.deinit`.
+    set_of: []const u32 = &.{},
+    /// Bit of each regex in its set's masks.
+    bit_of: []const u8 = &.{},
+    sets: []RegexSet = &.{},
+
+    pub const Error = error{InvalidRegexSets} || Allocator.Error;
+
+    /// Build the sets `set_of` describes over the regexes with `patterns`.
+    pub fn init(allocator: Allocator, set_of: []const u32, patterns: []const []const u8) Error!RegexSets {
+        if (set_of.len == 0) return .{};
+        if (set_of.len != patterns.len) return error.InvalidRegexSets;
+
+        var set_count: usize = 0;
+        for (set_of) |set| {
+            if (set == none) continue;
+            // Every set has a member, so there are no more sets than regexes.
+            if (set >= set_of.len) return error.InvalidRegexSets;
+            set_count = @max(set_count, @as(usize, set) + 1);
+        }
+
+        const bit_of = try allocator.alloc(u8, set_of.len);
+        errdefer allocator.free(bit_of);
+        const sizes = try allocator.alloc(usize, set_count);
+        defer allocator.free(sizes);
+        @memset(sizes, 0);
+        @memset(bit_of, 0);
+        for (set_of, bit_of) |set, *bit| {
+            if (set == none) continue;
+            if (sizes[set] == RegexSet.max_members) return error.InvalidRegexSets;
+            bit.* = @intCast(sizes[set]);
+            sizes[set] += 1;
+        }
+
+        const sets = try allocator.alloc(RegexSet, set_count);
+        errdefer allocator.free(sets);
+        var built: usize = 0;
+        errdefer {
+            for (sets[0..built]) |*set| set.deinit(allocator);
+        }
+        var members: std.ArrayList([]const u8) = .empty;
+        defer members.deinit(allocator);
+        for (sets, 0..) |*set, index| {
+            members.clearRetainingCapacity();
+            for (set_of, patterns) |member_set, pattern| {
+                if (member_set == index) try members.append(allocator, pattern);
+            }
+            set.* = try RegexSet.init(allocator, members.items);
+            built += 1;
+        }
+
+        return .{ .set_of = set_of, .bit_of = bit_of, .sets = sets };
+    }
+
+    pub fn deinit(self: *RegexSets, allocator: Allocator) void {
+        for (self.sets) |*set| set.deinit(allocator);
+        allocator.free(self.sets);
+        allocator.free(self.bit_of);
+    }
+
+    pub const Membership = struct {
+        set: u32,
+        bit: Mask,
+    };
+
+    pub fn membership(self: *const RegexSets, id: RegexId) ?Membership {
+        if (id >= self.set_of.len or self.set_of[id] == none) return null;
+        return .{ .set = self.set_of[id], .bit = @as(Mask, 1) << @intCast(self.bit_of[id]) };
+    }
+};
+
+/// What is known about sets on recently tested texts. Direct mapped, since
+/// a set's members are usually tested on one node before moving to the
+/// next.
+pub const OutcomeCache = struct {
+    const len = 64;
+
+    pub const Entry = struct {
+        set: u32 = RegexSets.none,
+        span: Span = .{ .start = 0, .end = 0 },
+        outcome: RegexSet.Outcome = .{},
+    };
+
+    entries: [len]Entry = @splat(.{}),
+
+    /// The entry for `set` on `span`. `found` tells whether it holds an
+    /// earlier outcome; if not, the slot is the caller's to fill.
+    pub fn get(self: *OutcomeCache, set: u32, span: Span) struct { entry: *Entry, found: bool } {
+        const hash = std.hash.int(span.start ^ (span.end *% 0x9e3779b1) ^ (set *% 0x85ebca6b));
+        const entry = &self.entries[hash % len];
+        const found = entry.set == set and entry.span.start == span.start and entry.span.end == span.end;
+        if (!found) entry.* = .{ .set = set, .span = span };
+        return .{ .entry = entry, .found = found };
+    }
+};
+
+const testing = std.testing;
+
+fn expectOutcome(patterns: []const []const u8, text: []const u8, known: Mask, matches: Mask) !void {
+    var set = try RegexSet.init(testing.allocator, patterns);
+    defer set.deinit(testing.allocator);
+    const outcome = set.scan(text);
+    try testing.expectEqual(known, outcome.known);
+    try testing.expectEqual(matches, outcome.matches);
+}
+
+test "regex sets decide literal members in one scan" {
+    const patterns = [_][]const u8{ "^get_", "_t$", "alloc", "^(?:new|init)$" };
+    try expectOutcome(&patterns, "get_size_t", 0b1111, 0b0011);
+    try expectOutcome(&patterns, "kmalloc", 0b1111, 0b0100);
+    try expectOutcome(&patterns, "init", 0b1111, 0b1000);
+    try expectOutcome(&patterns, "init\n", 0b1111, 0b1000);
+    try expectOutcome(&patterns, "reinit", 0b1111, 0b0000);
+    try expectOutcome(&patterns, "", 0b1111, 0b0000);
+}
+
+test "regex sets check a shared literal for each member" {
+    const patterns = [_][]const u8{ "^foo", "foo$", "foo" };
+    try expectOutcome(&patterns, "xfoo", 0b111, 0b110);
+    try expectOutcome(&patterns, "foox", 0b111, 0b101);
+    try expectOutcome(&patterns, "foo", 0b111, 0b111);
+    try expectOutcome(&patterns, "fo", 0b111, 0b000);
+}
+
+test "regex sets leave the rest to pcre2" {
+    const patterns = [_][]const u8{ "[A-Z][a-z]+", "[a-z]+_alloc\\d", "^ma(in)?$" };
+    // Nothing is known about the first; the others are ruled out or left
+    // open by their literals.
+    try expectOutcome(&patterns, "kmalloc", 0b110, 0);
+    try expectOutcome(&patterns, "k_alloc2", 0b100, 0);
+    try expectOutcome(&patterns, "main", 0b010, 0);
+}
+
+test "regex set membership" {
+    const set_of = [_]u32{ 1, RegexSets.none, 0, 1 };
+    const patterns = [_][]const u8{ "a", "b", "c", "d" };
+    var sets = try RegexSets.init(testing.allocator, &set_of, &patterns);
+    defer sets.deinit(testing.allocator);
+
+    try testing.expectEqual(2, sets.sets.len);
+    try testing.expectEqual(RegexSets.Membership{ .set = 1, .bit = 0b01 }, sets.membership(0).?);
+    try testing.expectEqual(null, sets.membership(1));
+    try testing.expectEqual(RegexSets.Membership{ .set = 0, .bit = 0b01 }, sets.membership(2).?);
+    try testing.expectEqual(RegexSets.Membership{ .set = 1, .bit = 0b10 }, sets.membership(3).?);
+    try testing.expectEqual(null, sets.membership(4));
+
+    try testing.expectError(error.InvalidRegexSets, RegexSets.init(testing.allocator, set_of[0..2], &patterns));
+}
+
+test "outcome cache" {
+    var cache: OutcomeCache = .{};
+    const span: Span = .{ .start = 4, .end = 9 };
+    const first = cache.get(3, span);
+    try testing.expect(!first.found);
+    first.entry.outcome = .{ .known = 1, .matches = 1 };
+
+    const second = cache.get(3, span);
+    try testing.expect(second.found);
+    try testing.expectEqual(1, second.entry.outcome.matches);
+    try testing.expect(!cache.get(4, span).found);
+}
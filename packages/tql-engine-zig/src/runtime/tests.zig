@@ -11,4 +11,6 @@ test {
     refAllDecls(@import("tests/call_ret.zig"));
     refAllDecls(@import("tests/probe.zig"));
     refAllDecls(@import("tests/build.zig"));
+    refAllDecls(@import("tests/preorder_walker.zig"));
+    refAllDecls(@import("tests/fan_out.zig"));
 }
@@ -22,19 +22,19 @@ test "asn: literal" {
     const instructions = [_]Instruction{
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = ValueSource{ .literal = Value{ .string = "hi" } },
+            .source = ValueSource{ .literal = Value{ .string = 0 } },
         } },
         Instruction{ .yield = .{ .source = .{ .variable_id = 1 } } },
         Instruction{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{"hi"} });
     defer ctx.deinit();
 
     try ctx.runtime.exec();
 
     var value = try ctx.runtime.next();
-    try std.testing.expect(std.mem.eql(u8, value.?.string, "hi"));
+    try std.testing.expect(std.mem.eql(u8, ctx.stringOf(value.?), "hi"));
 
     value = try ctx.runtime.next();
     try std.testing.expectEqual(value, null);
@@ -75,13 +75,13 @@ test "asn: node" {
     try ctx.runtime.exec();
 
     var value = try ctx.runtime.next();
-    try std.testing.expectEqualStrings(value.?.string, "void foo_bar() {}");
+    try std.testing.expectEqualStrings(ctx.stringOf(value.?), "void foo_bar() {}");
 
     value = try ctx.runtime.next();
     try std.testing.expectEqual(value.?.kind_id, function_definition_kind_id);
 
     value = try ctx.runtime.next();
-    try std.testing.expectEqual(value.?.range, Range{
+    try std.testing.expectEqual(ctx.runtime.rangeOf(value.?.range), Range{
         .start_point = .{ .row = 0, .column = 1 },
         .end_point = .{ .row = 0, .column = 18 },
         .start_byte = 1,
@@ -100,7 +100,7 @@ test "asn: variable" {
     const instructions = [_]Instruction{
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = ValueSource{ .literal = Value{ .string = "hi" } },
+            .source = ValueSource{ .literal = Value{ .string = 0 } },
         } },
         Instruction{ .asn = .{
             .variable_id = 2,
@@ -116,16 +116,16 @@ test "asn: variable" {
         Instruction{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{"hi"} });
     defer ctx.deinit();
 
     try ctx.runtime.exec();
 
     var value = try ctx.runtime.next();
-    try std.testing.expectEqualStrings(value.?.string, "hi");
+    try std.testing.expectEqualStrings(ctx.stringOf(value.?), "hi");
 
     value = try ctx.runtime.next();
-    try std.testing.expectEqualStrings(value.?.string, "hi");
+    try std.testing.expectEqualStrings(ctx.stringOf(value.?), "hi");
 
     value = try ctx.runtime.next();
     try std.testing.expectEqual(value.?.nothing, {});
@@ -14,14 +14,14 @@ test "build: record" {
         .{ .begin_build = .record },
         .{
             .push_build = .{
-                .source = .{ .literal = .{ .string = "alice" } },
-                .name = "name",
+                .source = .{ .literal = .{ .string = 0 } },
+                .name = 1,
             },
         },
         .{
             .push_build = .{
                 .source = .{ .literal = .{ .kind_id = 42 } },
-                .name = "kind",
+                .name = 2,
             },
         },
         .{ .end_build = 1 },
@@ -29,15 +29,15 @@ test "build: record" {
         .{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{ "alice", "name", "kind" } });
     defer ctx.deinit();
     try ctx.runtime.exec();
 
     const rec = (try ctx.runtime.next()).?.record;
     try std.testing.expectEqual(rec.rc, 1);
-    try std.testing.expectEqual(rec.value.map.count(), 2);
-    try std.testing.expectEqualStrings(rec.value.map.get("name").?.string, "alice");
-    try std.testing.expectEqual(rec.value.map.get("kind").?.kind_id, 42);
+    try std.testing.expectEqual(rec.value.entries.items.len, 2);
+    try std.testing.expectEqualStrings(ctx.stringOf(rec.value.get("name").?), "alice");
+    try std.testing.expectEqual(rec.value.get("kind").?.kind_id, 42);
 
     try std.testing.expectEqual(try ctx.runtime.next(), null);
 }
@@ -48,19 +48,19 @@ test "build: list" {
         .{ .begin_build = .list },
         .{
             .push_build = .{
-                .source = .{ .literal = .{ .string = "a" } },
+                .source = .{ .literal = .{ .string = 0 } },
                 .name = null,
             },
         },
         .{
             .push_build = .{
-                .source = .{ .literal = .{ .string = "b" } },
+                .source = .{ .literal = .{ .string = 1 } },
                 .name = null,
             },
         },
         .{
             .push_build = .{
-                .source = .{ .literal = .{ .string = "c" } },
+                .source = .{ .literal = .{ .string = 2 } },
                 .name = null,
             },
         },
@@ -69,15 +69,15 @@ test "build: list" {
         .{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{ "a", "b", "c" } });
     defer ctx.deinit();
     try ctx.runtime.exec();
 
     const lst = (try ctx.runtime.next()).?.list;
     try std.testing.expectEqual(lst.value.items.items.len, 3);
-    try std.testing.expectEqualStrings(lst.value.items.items[0].string, "a");
-    try std.testing.expectEqualStrings(lst.value.items.items[1].string, "b");
-    try std.testing.expectEqualStrings(lst.value.items.items[2].string, "c");
+    try std.testing.expectEqualStrings(ctx.stringOf(lst.value.items.items[0]), "a");
+    try std.testing.expectEqualStrings(ctx.stringOf(lst.value.items.items[1]), "b");
+    try std.testing.expectEqualStrings(ctx.stringOf(lst.value.items.items[2]), "c");
 
     try std.testing.expectEqual(try ctx.runtime.next(), null);
 }
@@ -88,7 +88,7 @@ test "build: nested list of list" {
         .{ .begin_build = .list },
         .{
             .push_build = .{
-                .source = .{ .literal = .{ .string = "inner-elem" } },
+                .source = .{ .literal = .{ .string = 0 } },
                 .name = null,
             },
         },
@@ -112,7 +112,7 @@ test "build: nested list of list" {
         .{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{"inner-elem"} });
     defer ctx.deinit();
     try ctx.runtime.exec();
 
@@ -127,7 +127,7 @@ test "build: nested list of list" {
     // env holds 1 ref on inner under var 1, outer.items hold 2 more
     try std.testing.expectEqual(inner_a.rc, 3);
     try std.testing.expectEqual(inner_a.value.items.items.len, 1);
-    try std.testing.expectEqualStrings(inner_a.value.items.items[0].string, "inner-elem");
+    try std.testing.expectEqualStrings(ctx.stringOf(inner_a.value.items.items[0]), "inner-elem");
 
     try std.testing.expectEqual(try ctx.runtime.next(), null);
 }
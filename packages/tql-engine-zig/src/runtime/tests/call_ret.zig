@@ -112,29 +112,29 @@ test "call/ret: preserves environment correctly" {
     ;
 
     const instructions = [_]Instruction{
-        Instruction{ .asn = .{ .variable_id = 1, .source = .{ .literal = Value{ .string = "original" } } } },
+        Instruction{ .asn = .{ .variable_id = 1, .source = .{ .literal = Value{ .string = 0 } } } },
         Instruction{ .call = 7 },
-        Instruction{ .asn = .{ .variable_id = 2, .source = .{ .literal = Value{ .string = "after" } } } },
+        Instruction{ .asn = .{ .variable_id = 2, .source = .{ .literal = Value{ .string = 1 } } } },
         Instruction{ .yield = .{ .source = .{ .variable_id = 1 } } },
         Instruction{ .yield = .{ .source = .{ .variable_id = 2 } } },
         Instruction{ .yield = .{ .source = .{ .variable_id = 3 } } },
         Instruction{ .halt = .{} },
-        Instruction{ .asn = .{ .variable_id = 1, .source = .{ .literal = Value{ .string = "modified" } } } },
-        Instruction{ .asn = .{ .variable_id = 3, .source = .{ .literal = Value{ .string = "local" } } } },
+        Instruction{ .asn = .{ .variable_id = 1, .source = .{ .literal = Value{ .string = 2 } } } },
+        Instruction{ .asn = .{ .variable_id = 3, .source = .{ .literal = Value{ .string = 3 } } } },
         Instruction{ .ret = {} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{ "original", "after", "modified", "local" } });
     defer ctx.deinit();
 
     try ctx.runtime.exec();
 
     // Should have exactly one match
     var value = try ctx.runtime.next();
-    try std.testing.expectEqualStrings(value.?.string, "original");
+    try std.testing.expectEqualStrings(ctx.stringOf(value.?), "original");
 
     value = try ctx.runtime.next();
-    try std.testing.expectEqualStrings(value.?.string, "after");
+    try std.testing.expectEqualStrings(ctx.stringOf(value.?), "after");
 
     value = try ctx.runtime.next();
     try std.testing.expectEqual(value.?.nothing, {});
@@ -0,0 +1,134 @@
+const std = @import("std");
+
+const types = @import("../types.zig");
+const Instruction = types.Instruction;
+const Axis = types.Axis;
+
+const TestContext = @import("./test_helpers.zig").TestContext;
+
+const branch_count = 64;
+const source = "int a;\n" ** branch_count;
+
+/// Run `instructions` over `source` and return how many allocations the
+/// runtime made, after checking that every branch yielded.
+fn countAllocations(instructions: []const Instruction) !usize {
+    var counting = std.testing.FailingAllocator.init(std.testing.allocator, .{});
+
+    var ctx = try TestContext.init(.{
+        .source = source,
+        .instructions = instructions,
+        .allocator = counting.allocator(),
+        .index_kinds = false,
+    });
+    defer ctx.deinit();
+
+    try ctx.runtime.exec();
+    var yields: usize = 0;
+    while (try ctx.runtime.next()) |_| yields += 1;
+    try std.testing.expectEqual(@as(usize, branch_count), yields);
+
+    return counting.allocations;
+}
+
+test "fan-out: branches share the environment until they write" {
+    const instructions = [_]Instruction{
+        Instruction{ .asn = .{ .variable_id = 0, .source = .{ .node = .this } } },
+        Instruction{ .trv = Axis{ .child = {} } },
+        Instruction{ .yield = .{} },
+        Instruction{ .halt = .{} },
+    };
+
+    // Only the root environment and the stack; nothing per branch.
+    try std.testing.expect(try countAllocations(&instructions) < 8);
+}
+
+test "fan-out: allocations scale with writes, not branches" {
+    const instructions = [_]Instruction{
+        Instruction{ .asn = .{ .variable_id = 0, .source = .{ .node = .this } } },
+        Instruction{ .trv = Axis{ .child = {} } },
+        // The first write copies the shared environment, the second reuses
+        // the copy.
+        Instruction{ .asn = .{ .variable_id = 1, .source = .{ .node = .this } } },
+        Instruction{ .asn = .{ .variable_id = 2, .source = .{ .node = .kind } } },
+        Instruction{ .yield = .{ .source = .{ .variable_id = 1 } } },
+        Instruction{ .halt = .{} },
+    };
+
+    // One copy (slot array and its refcount cell) per writing branch.
+    try std.testing.expect(try countAllocations(&instructions) <= 2 * branch_count + 8);
+}
+
+test "fan-out: probe and call don't copy the environment" {
+    // Program:
+    // 0: asn 0 (node this)
+    // 1: trv child
+    // 2: call 7           // Returns straight back
+    // 3: probe exists 5   // Succeeds on the yield at 4
+    // 4: yield
+    // 5: yield
+    // 6: halt
+    // 7: ret
+    const instructions = [_]Instruction{
+        Instruction{ .asn = .{ .variable_id = 0, .source = .{ .node = .this } } },
+        Instruction{ .trv = Axis{ .child = {} } },
+        Instruction{ .call = 7 },
+        Instruction{ .probe = .{ .resume_address = 5, .data = .exists } },
+        Instruction{ .yield = .{} },
+        Instruction{ .yield = .{} },
+        Instruction{ .halt = .{} },
+        Instruction{ .ret = {} },
+    };
+
+    try std.testing.expect(try countAllocations(&instructions) < 8);
+}
+
+test "fan-out: node references are released with their branch" {
+    const instructions = [_]Instruction{
+        Instruction{ .trv = Axis{ .descendant = {} } },
+        Instruction{ .asn = .{ .variable_id = 0, .source = .{ .node = .this } } },
+        Instruction{ .yield = .{ .source = .{ .variable_id = 0 } } },
+        Instruction{ .halt = .{} },
+    };
+
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    defer ctx.deinit();
+
+    try ctx.runtime.exec();
+    var yields: usize = 0;
+    var most_nodes: usize = 0;
+    while (try ctx.runtime.next()) |_| {
+        yields += 1;
+        most_nodes = @max(most_nodes, ctx.runtime.nodes.items.len);
+    }
+    try std.testing.expect(yields > branch_count);
+    try std.testing.expect(most_nodes <= 2);
+}
+
+test "fan-out: aggregated nodes outlive their branches" {
+    // Program:
+    // 0: probe aggregate 1, resume at 4
+    // 1: trv child
+    // 2: yield
+    // 3: halt
+    // 4: yield 1
+    // 5: halt
+    const instructions = [_]Instruction{
+        Instruction{ .probe = .{ .resume_address = 4, .data = .{ .aggregate = .{ .variable = 1, .kind = .list } } } },
+        Instruction{ .trv = Axis{ .child = {} } },
+        Instruction{ .yield = .{} },
+        Instruction{ .halt = .{} },
+        Instruction{ .yield = .{ .source = .{ .variable_id = 1 } } },
+        Instruction{ .halt = .{} },
+    };
+
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    defer ctx.deinit();
+
+    try ctx.runtime.exec();
+    const list = (try ctx.runtime.next()).?.list;
+    try std.testing.expectEqual(@as(usize, branch_count), list.value.items.items.len);
+    for (list.value.items.items) |item| {
+        try std.testing.expectEqualStrings("declaration", ctx.runtime.nodeOf(item.node).grammarKind());
+    }
+    try std.testing.expectEqual(null, try ctx.runtime.next());
+}
@@ -31,11 +31,11 @@ test "jmp: conditional jump when relation succeeds" {
     const instructions = [_]Instruction{
         Instruction{ .asn = .{
             .variable_id = 0,
-            .source = .{ .literal = Value{ .string = "hello" } },
+            .source = .{ .literal = Value{ .string = 0 } },
         } },
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = .{ .literal = Value{ .string = "hello" } },
+            .source = .{ .literal = Value{ .string = 1 } },
         } },
         Instruction{ .rel = .{
             .relation = Relation.equals,
@@ -51,7 +51,7 @@ test "jmp: conditional jump when relation succeeds" {
         Instruction{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{ "hello", "hello" } });
     defer ctx.deinit();
 
     try ctx.expectMatchKinds(&[_][]const u8{"translation_unit"});
@@ -64,11 +64,11 @@ test "jmp: conditional jump when relation fails" {
     const instructions = [_]Instruction{
         Instruction{ .asn = .{
             .variable_id = 0,
-            .source = .{ .literal = Value{ .string = "hello" } },
+            .source = .{ .literal = Value{ .string = 0 } },
         } },
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = .{ .literal = Value{ .string = "world" } },
+            .source = .{ .literal = Value{ .string = 1 } },
         } },
         Instruction{ .rel = .{
             .relation = Relation.equals,
@@ -84,7 +84,7 @@ test "jmp: conditional jump when relation fails" {
         Instruction{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{ "hello", "world" } });
     defer ctx.deinit();
 
     try ctx.expectMatchKinds(&[_][]const u8{"translation_unit"});
@@ -97,11 +97,11 @@ test "jmp: conditional jump not taken when condition not met" {
     const instructions = [_]Instruction{
         Instruction{ .asn = .{
             .variable_id = 0,
-            .source = .{ .literal = Value{ .string = "hello" } },
+            .source = .{ .literal = Value{ .string = 0 } },
         } },
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = .{ .literal = Value{ .string = "hello" } },
+            .source = .{ .literal = Value{ .string = 1 } },
         } },
         Instruction{ .rel = .{
             .relation = Relation.equals,
@@ -117,7 +117,7 @@ test "jmp: conditional jump not taken when condition not met" {
         Instruction{ .panic = {} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{ "hello", "hello" } });
     defer ctx.deinit();
 
     try ctx.expectMatchKinds(&[_][]const u8{"translation_unit"});
@@ -0,0 +1,86 @@
+const std = @import("std");
+const testing = std.testing;
+const ts = @import("tree-sitter");
+
+const PreorderWalker = @import("../preorder_walker.zig").PreorderWalker;
+
+extern fn tree_sitter_c() callconv(.c) *ts.Language;
+
+fn parseC(source: []const u8) !struct { *ts.Language, *ts.Parser, *ts.Tree } {
+    const language = tree_sitter_c();
+    errdefer language.destroy();
+    const parser = ts.Parser.create();
+    errdefer parser.destroy();
+    try parser.setLanguage(language);
+    const tree = parser.parseString(source, null) orelse return error.ParseFailed;
+    return .{ language, parser, tree };
+}
+
+test "PreorderWalker: matches gotoDescendant order" {
+    const language, const parser, const tree = try parseC(
+        \\ int add(int a, int b) { return a + b; }
+        \\ void foo() { if (x) { bar(1, "s"); } }
+    );
+    defer language.destroy();
+    defer parser.destroy();
+    defer tree.destroy();
+
+    const root = tree.rootNode();
+    var expected = root.walk();
+    defer expected.destroy();
+
+    var walker = PreorderWalker.init(root);
+    defer walker.deinit();
+
+    var index: u32 = 1;
+    while (walker.next()) : (index += 1) {
+        expected.gotoDescendant(index);
+        try testing.expect(walker.node().eql(expected.node()));
+    }
+    try testing.expectEqual(root.descendantCount(), index);
+}
+
+test "PreorderWalker: stays within the starting node" {
+    const language, const parser, const tree = try parseC(
+        \\ void foo() { a(); }
+        \\ void bar() { b(); }
+    );
+    defer language.destroy();
+    defer parser.destroy();
+    defer tree.destroy();
+
+    const foo = tree.rootNode().namedChild(0).?;
+    var walker = PreorderWalker.init(foo);
+    defer walker.deinit();
+
+    var count: u32 = 0;
+    while (walker.next()) count += 1;
+    try testing.expectEqual(foo.descendantCount() - 1, count);
+}
+
+test "PreorderWalker: skipSubtree and nextNamed" {
+    const language, const parser, const tree = try parseC(
+        \\ void foo() { a(); }
+        \\ int x;
+    );
+    defer language.destroy();
+    defer parser.destroy();
+    defer tree.destroy();
+
+    var walker = PreorderWalker.init(tree.rootNode());
+    defer walker.deinit();
+
+    var kinds: std.ArrayList([]const u8) = .empty;
+    defer kinds.deinit(testing.allocator);
+    while (walker.nextNamed()) {
+        const kind = walker.node().kind();
+        try kinds.append(testing.allocator, kind);
+        if (std.mem.eql(u8, kind, "function_definition")) walker.skipSubtree();
+    }
+
+    try testing.expectEqual(@as(usize, 4), kinds.items.len);
+    try testing.expectEqualStrings("function_definition", kinds.items[0]);
+    try testing.expectEqualStrings("declaration", kinds.items[1]);
+    try testing.expectEqualStrings("primitive_type", kinds.items[2]);
+    try testing.expectEqualStrings("identifier", kinds.items[3]);
+}
@@ -22,11 +22,11 @@ test "rel: equals with matching strings" {
     const instructions = [_]Instruction{
         Instruction{ .asn = .{
             .variable_id = 0,
-            .source = .{ .literal = Value{ .string = "hello" } },
+            .source = .{ .literal = Value{ .string = 0 } },
         } },
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = .{ .literal = Value{ .string = "hello" } },
+            .source = .{ .literal = Value{ .string = 1 } },
         } },
         Instruction{ .rel = .{
             .relation = Relation.equals,
@@ -38,7 +38,7 @@ test "rel: equals with matching strings" {
         Instruction{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{ "hello", "hello" } });
     defer ctx.deinit();
 
     try ctx.expectMatchKinds(&[_][]const u8{"translation_unit"});
@@ -52,11 +52,11 @@ test "rel: not equals with matching strings" {
     const instructions = [_]Instruction{
         Instruction{ .asn = .{
             .variable_id = 0,
-            .source = .{ .literal = Value{ .string = "hello" } },
+            .source = .{ .literal = Value{ .string = 0 } },
         } },
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = .{ .literal = Value{ .string = "hello" } },
+            .source = .{ .literal = Value{ .string = 1 } },
         } },
         Instruction{ .rel = .{
             .relation = Relation.equals,
@@ -68,7 +68,7 @@ test "rel: not equals with matching strings" {
         Instruction{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{ "hello", "hello" } });
     defer ctx.deinit();
 
     try ctx.expectMatchKinds(&[_][]const u8{});
@@ -82,11 +82,11 @@ test "rel: not equals with different strings" {
     const instructions = [_]Instruction{
         Instruction{ .asn = .{
             .variable_id = 0,
-            .source = .{ .literal = Value{ .string = "hello" } },
+            .source = .{ .literal = Value{ .string = 0 } },
         } },
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = .{ .literal = Value{ .string = "world" } },
+            .source = .{ .literal = Value{ .string = 1 } },
         } },
         Instruction{ .rel = .{
             .relation = Relation.equals,
@@ -98,7 +98,7 @@ test "rel: not equals with different strings" {
         Instruction{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{ "hello", "world" } });
     defer ctx.deinit();
 
     try ctx.expectMatchKinds(&[_][]const u8{"translation_unit"});
@@ -114,11 +114,11 @@ test "rel: like with regex matching" {
     const instructions = [_]Instruction{
         Instruction{ .asn = .{
             .variable_id = 0,
-            .source = .{ .literal = Value{ .string = "hello world" } },
+            .source = .{ .literal = Value{ .string = 0 } },
         } },
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = .{ .literal = Value{ .regex = regex } },
+            .source = .{ .literal = Value{ .regex = 0 } },
         } },
         Instruction{ .rel = .{
             .relation = Relation.like,
@@ -130,7 +130,7 @@ test "rel: like with regex matching" {
         Instruction{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{"hello world"}, .regexes = &.{regex} });
     defer ctx.deinit();
 
     try ctx.expectMatchKinds(&[_][]const u8{"translation_unit"});
@@ -147,11 +147,11 @@ test "rel: like with regex not matching" {
     const instructions = [_]Instruction{
         Instruction{ .asn = .{
             .variable_id = 0,
-            .source = .{ .literal = Value{ .string = "bar baz" } },
+            .source = .{ .literal = Value{ .string = 0 } },
         } },
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = .{ .literal = Value{ .regex = regex } },
+            .source = .{ .literal = Value{ .regex = 0 } },
         } },
         Instruction{ .rel = .{
             .relation = Relation.like,
@@ -163,7 +163,7 @@ test "rel: like with regex not matching" {
         Instruction{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{"bar baz"}, .regexes = &.{regex} });
     defer ctx.deinit();
 
     try ctx.expectMatchKinds(&[_][]const u8{});
@@ -180,11 +180,11 @@ test "rel: not like with regex matching" {
     const instructions = [_]Instruction{
         Instruction{ .asn = .{
             .variable_id = 0,
-            .source = .{ .literal = Value{ .string = "hello world" } },
+            .source = .{ .literal = Value{ .string = 0 } },
         } },
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = .{ .literal = Value{ .regex = regex } },
+            .source = .{ .literal = Value{ .regex = 0 } },
         } },
         Instruction{ .rel = .{
             .relation = Relation.like,
@@ -196,7 +196,7 @@ test "rel: not like with regex matching" {
         Instruction{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{"hello world"}, .regexes = &.{regex} });
     defer ctx.deinit();
 
     try ctx.expectMatchKinds(&[_][]const u8{});
@@ -213,11 +213,11 @@ test "rel: not like with regex not matching" {
     const instructions = [_]Instruction{
         Instruction{ .asn = .{
             .variable_id = 0,
-            .source = .{ .literal = Value{ .string = "hello world" } },
+            .source = .{ .literal = Value{ .string = 0 } },
         } },
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = .{ .literal = Value{ .regex = regex } },
+            .source = .{ .literal = Value{ .regex = 0 } },
         } },
         Instruction{ .rel = .{
             .relation = Relation.like,
@@ -229,7 +229,7 @@ test "rel: not like with regex not matching" {
         Instruction{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{"hello world"}, .regexes = &.{regex} });
     defer ctx.deinit();
 
     try ctx.expectMatchKinds(&[_][]const u8{"translation_unit"});
@@ -252,12 +252,12 @@ test "rel: relates halt inside nexists probe should succeed" {
         // 1: Inside probe - assign different values
         Instruction{ .asn = .{
             .variable_id = 0,
-            .source = .{ .literal = Value{ .string = "hello" } },
+            .source = .{ .literal = Value{ .string = 0 } },
         } },
         // 2: Assign different value
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = .{ .literal = Value{ .string = "world" } },
+            .source = .{ .literal = Value{ .string = 1 } },
         } },
         // 3: Test equals - this sets flag to false since strings are different
         Instruction{ .rel = .{
@@ -274,7 +274,7 @@ test "rel: relates halt inside nexists probe should succeed" {
         Instruction{ .halt = .{} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{ "hello", "world" } });
     defer ctx.deinit();
 
     try ctx.expectMatchKinds(&[_][]const u8{"translation_unit"});
@@ -297,12 +297,12 @@ test "rel: relates halt inside exists probe should fail" {
         // 1: Inside probe - assign different values
         Instruction{ .asn = .{
             .variable_id = 0,
-            .source = .{ .literal = Value{ .string = "hello" } },
+            .source = .{ .literal = Value{ .string = 0 } },
         } },
         // 2: Assign different value
         Instruction{ .asn = .{
             .variable_id = 1,
-            .source = .{ .literal = Value{ .string = "world" } },
+            .source = .{ .literal = Value{ .string = 1 } },
         } },
         // 3: Test equals - this sets flag to false since strings are different
         Instruction{ .rel = .{
@@ -318,7 +318,7 @@ test "rel: relates halt inside exists probe should fail" {
         Instruction{ .panic = {} },
     };
 
-    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{ "hello", "world" } });
     defer ctx.deinit();
 
     // Exists probe fails when halt happens, so we get no matches
@@ -352,3 +352,36 @@ test "rel: numeric comparisons" {
 
     try ctx.expectMatchKinds(&[_][]const u8{"translation_unit"});
 }
+
+test "rel: literal relations" {
+    const source = "int x;";
+
+    const cases = [_]struct { relation: Relation, literal: []const u8, relates: bool }{
+        .{ .relation = .starts_with, .literal = "kmal", .relates = true },
+        .{ .relation = .starts_with, .literal = "loc", .relates = false },
+        .{ .relation = .ends_with, .literal = "loc", .relates = true },
+        .{ .relation = .ends_with, .literal = "kmal", .relates = false },
+        .{ .relation = .contains, .literal = "mall", .relates = true },
+        .{ .relation = .contains, .literal = "malloc_", .relates = false },
+        .{ .relation = .contains, .literal = "", .relates = true },
+    };
+
+    for (cases) |case| {
+        const instructions = [_]Instruction{
+            Instruction{ .rel = .{
+                .relation = case.relation,
+                .a = .{ .literal = Value{ .string = 0 } },
+                .b = .{ .literal = Value{ .string = 1 } },
+            } },
+            Instruction{ .halt = .{ .condition = .not_relates } },
+            Instruction{ .yield = .{} },
+            Instruction{ .halt = .{} },
+        };
+
+        var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions, .strings = &.{ "kmalloc", case.literal } });
+        defer ctx.deinit();
+
+        const expected: []const []const u8 = if (case.relates) &.{"translation_unit"} else &.{};
+        try ctx.expectMatchKinds(expected);
+    }
+}
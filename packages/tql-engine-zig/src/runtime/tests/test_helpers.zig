@@ -8,7 +8,9 @@ const types = @import("../types.zig");
 const Instruction = types.Instruction;
 const Value = types.Value;
 
+const bytecode = @import("../bytecode.zig");
 const Runtime = @import("../core.zig").Runtime;
+const Reachability = @import("../../reachability.zig").Reachability;
 
 extern fn tree_sitter_c() callconv(.c) *ts.Language;
 extern fn tree_sitter_typescript() callconv(.c) *ts.Language;
@@ -18,13 +20,19 @@ pub const TestContext = struct {
     language: *ts.Language,
     parser: *ts.Parser,
     tree: *ts.Tree,
+    bytecode: bytecode.Bytecode,
     runtime: Runtime,
 
     pub fn init(x: struct {
         source: []const u8,
+        /// Assembled before running.
         instructions: []const Instruction,
+        strings: []const []const u8 = &.{},
+        regexes: []const pcre2.Regex = &.{},
         language: ?*ts.Language = null,
         allocator: ?Allocator = null,
+        index_kinds: bool = true,
+        reachability: ?*const Reachability = null,
     }) !TestContext {
         const allocator = x.allocator orelse std.testing.allocator;
         const language = x.language orelse tree_sitter_c();
@@ -37,12 +45,21 @@ pub const TestContext = struct {
         const tree = parser.parseString(x.source, null) orelse return error.ParseFailed;
         errdefer tree.destroy();
 
+        // Not on `allocator`, so tests that count runtime allocations only
+        // see the runtime's.
+        var program = try bytecode.assemble(std.testing.allocator, x.instructions);
+        errdefer program.deinit(std.testing.allocator);
+
         const runtime = Runtime.init(.{
             .tree = tree,
             .source = x.source,
-            .instructions = x.instructions,
-            .regexes = &[_]pcre2.Regex{},
+            .code = program.code,
+            .constants = program.constants,
+            .regexes = x.regexes,
+            .strings = x.strings,
             .allocator = allocator,
+            .index_kinds = x.index_kinds,
+            .reachability = x.reachability,
         });
 
         return TestContext{
@@ -50,12 +67,14 @@ pub const TestContext = struct {
             .language = language,
             .parser = parser,
             .tree = tree,
+            .bytecode = program,
             .runtime = runtime,
         };
     }
 
     pub fn deinit(self: *TestContext) void {
         self.runtime.deinit();
+        self.bytecode.deinit(std.testing.allocator);
         self.tree.destroy();
         self.parser.destroy();
         self.language.destroy();
@@ -75,21 +94,31 @@ pub const TestContext = struct {
         return values;
     }
 
+    /// Contents of a string or source text value.
+    pub fn stringOf(self: *const TestContext, value: Value) []const u8 {
+        return self.runtime.stringOf(value).?;
+    }
+
     pub fn expectMatchKinds(self: *TestContext, expected_kinds: []const []const u8) !void {
-        var matches = try self.collectMatches();
-        defer matches.deinit(self.allocator);
+        try self.runtime.exec();
+
+        // A node value can only be resolved until the next call to `next`.
+        var kinds: std.ArrayList([]const u8) = .empty;
+        defer kinds.deinit(self.allocator);
+        while (try self.runtime.next()) |value| {
+            try kinds.append(self.allocator, self.runtime.nodeOf(value.node).grammarKind());
+        }
 
-        if (matches.items.len != expected_kinds.len) {
-            std.debug.print("Expected {d} matches, got {d}\n", .{ expected_kinds.len, matches.items.len });
+        if (kinds.items.len != expected_kinds.len) {
+            std.debug.print("Expected {d} matches, got {d}\n", .{ expected_kinds.len, kinds.items.len });
             std.debug.print("Actual matches:\n", .{});
-            for (matches.items, 0..) |match, i| {
-                std.debug.print("  [{d}] {s}\n", .{ i, match.node.grammarKind() });
+            for (kinds.items, 0..) |kind, i| {
+                std.debug.print("  [{d}] {s}\n", .{ i, kind });
             }
             return error.TestUnexpectedResult;
         }
 
-        for (matches.items, expected_kinds) |match, expected_kind| {
-            const actual_kind = match.node.grammarKind();
+        for (kinds.items, expected_kinds) |actual_kind, expected_kind| {
             try std.testing.expectEqualStrings(actual_kind, expected_kind);
         }
     }
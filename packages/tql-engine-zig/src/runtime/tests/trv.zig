@@ -8,6 +8,8 @@ const ValueSource = types.ValueSource;
 const NodeValueSource = types.NodeValueSource;
 
 const TestContext = @import("./test_helpers.zig").TestContext;
+const Reachability = @import("../../reachability.zig").Reachability;
+const Language = @import("../../language.zig").Language;
 
 extern fn tree_sitter_c() callconv(.c) *ts.Language;
 
@@ -253,3 +255,207 @@ test "trv: empty traversal with halt after" {
     // Should have no matches - trv with no results terminates the branch
     try ctx.expectMatchKinds(&[_][]const u8{});
 }
+
+test "trv: child_of_kind" {
+    const source =
+        \\ int a;
+        \\ void foo() {}
+        \\ void bar() {}
+    ;
+
+    const language = tree_sitter_c();
+    defer language.destroy();
+    const function_definition_kind_id = language.idForNodeKind("function_definition", true);
+
+    const instructions = [_]Instruction{
+        Instruction{ .trv = Axis{ .child_of_kind = function_definition_kind_id } },
+        Instruction{ .yield = .{} },
+        Instruction{ .halt = .{} },
+    };
+
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    defer ctx.deinit();
+
+    try ctx.expectMatchKinds(&[_][]const u8{ "function_definition", "function_definition" });
+}
+
+test "trv: child_of_kind skips non-matching first child" {
+    const source =
+        \\ int a;
+    ;
+
+    const language = tree_sitter_c();
+    defer language.destroy();
+    const identifier_kind_id = language.idForNodeKind("identifier", true);
+
+    const instructions = [_]Instruction{
+        Instruction{ .trv = Axis{ .child = {} } },
+        Instruction{ .trv = Axis{ .child_of_kind = identifier_kind_id } },
+        Instruction{ .yield = .{} },
+        Instruction{ .halt = .{} },
+    };
+
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    defer ctx.deinit();
+
+    try ctx.expectMatchKinds(&[_][]const u8{"identifier"});
+}
+
+test "trv: descendant_of_kind" {
+    const source =
+        \\ void foo() {
+        \\   int a;
+        \\   int b;
+        \\ }
+    ;
+
+    const language = tree_sitter_c();
+    defer language.destroy();
+    const identifier_kind_id = language.idForNodeKind("identifier", true);
+
+    const instructions = [_]Instruction{
+        Instruction{ .trv = Axis{ .descendant_of_kind = identifier_kind_id } },
+        Instruction{ .yield = .{} },
+        Instruction{ .halt = .{} },
+    };
+
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    defer ctx.deinit();
+
+    try ctx.expectMatchKinds(&[_][]const u8{ "identifier", "identifier", "identifier" });
+}
+
+test "trv: descendant_of_kind with no matches" {
+    const source =
+        \\ void foo() {}
+    ;
+
+    const language = tree_sitter_c();
+    defer language.destroy();
+    const call_expression_kind_id = language.idForNodeKind("call_expression", true);
+
+    const instructions = [_]Instruction{
+        Instruction{ .trv = Axis{ .descendant_of_kind = call_expression_kind_id } },
+        Instruction{ .yield = .{} },
+        Instruction{ .halt = .{} },
+    };
+
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    defer ctx.deinit();
+
+    try ctx.expectMatchKinds(&[_][]const u8{});
+}
+
+test "trv: field_of_kind" {
+    const source =
+        \\ int a, *b, c;
+    ;
+
+    const language = tree_sitter_c();
+    defer language.destroy();
+    const declarator_field_id = language.fieldIdForName("declarator");
+    const pointer_declarator_kind_id = language.idForNodeKind("pointer_declarator", true);
+
+    const instructions = [_]Instruction{
+        Instruction{ .trv = Axis{ .child = {} } },
+        Instruction{ .trv = Axis{ .field_of_kind = .{
+            .field_id = declarator_field_id,
+            .kind_id = pointer_declarator_kind_id,
+        } } },
+        Instruction{ .yield = .{} },
+        Instruction{ .halt = .{} },
+    };
+
+    var ctx = try TestContext.init(.{ .source = source, .instructions = &instructions });
+    defer ctx.deinit();
+
+    try ctx.expectMatchKinds(&[_][]const u8{"pointer_declarator"});
+}
+
+test "trv: descendant_of_kind is scoped to the current node" {
+    const source =
+        \\ void foo() { a(b(c)); }
+        \\ void bar() { d(); }
+    ;
+
+    const language = tree_sitter_c();
+    defer language.destroy();
+    const function_definition_kind_id = language.idForNodeKind("function_definition", true);
+    const call_expression_kind_id = language.idForNodeKind("call_expression", true);
+
+    const instructions = [_]Instruction{
+        Instruction{ .trv = Axis{ .child_of_kind = function_definition_kind_id } },
+        Instruction{ .trv = Axis{ .descendant_of_kind = call_expression_kind_id } },
+        Instruction{ .trv = Axis{ .descendant_of_kind = call_expression_kind_id } },
+        Instruction{ .yield = .{ .source = .{ .node = .text } } },
+        Instruction{ .halt = .{} },
+    };
+
+    for ([_]bool{ true, false }) |index_kinds| {
+        var ctx = try TestContext.init(.{
+            .source = source,
+            .instructions = &instructions,
+            .index_kinds = index_kinds,
+        });
+        defer ctx.deinit();
+
+        var matches = try ctx.collectMatches();
+        defer matches.deinit(ctx.allocator);
+
+        // Only a(b(c)) has a nested call; neither call is its own descendant
+        // and nothing leaks in from bar.
+        try std.testing.expectEqual(@as(usize, 1), matches.items.len);
+        try std.testing.expectEqualStrings("b(c)", ctx.stringOf(matches.items[0]));
+    }
+}
+
+test "trv: descendant_of_kind with reachability matches unpruned search" {
+    // The string and the parameter list can't hold calls and get pruned;
+    // the broken statement can, since it contains an ERROR node.
+    const source =
+        \\ char *s = "f(x)";
+        \\ void foo(int a) { a(b(1 +); }
+        \\ void bar() { d(); }
+    ;
+
+    const language = tree_sitter_c();
+    defer language.destroy();
+    const call_expression_kind_id = language.idForNodeKind("call_expression", true);
+
+    var reachability = try Reachability.init(std.testing.allocator, language, Language.c.nodeTypes());
+    defer reachability.deinit();
+
+    const instructions = [_]Instruction{
+        Instruction{ .trv = Axis{ .descendant_of_kind = call_expression_kind_id } },
+        Instruction{ .yield = .{ .source = .{ .node = .text } } },
+        Instruction{ .halt = .{} },
+    };
+
+    var expected = try TestContext.init(.{
+        .source = source,
+        .instructions = &instructions,
+        .index_kinds = false,
+    });
+    defer expected.deinit();
+    var expected_matches = try expected.collectMatches();
+    defer expected_matches.deinit(expected.allocator);
+    try std.testing.expect(expected_matches.items.len > 0);
+
+    for ([_]bool{ true, false }) |index_kinds| {
+        var ctx = try TestContext.init(.{
+            .source = source,
+            .instructions = &instructions,
+            .index_kinds = index_kinds,
+            .reachability = &reachability,
+        });
+        defer ctx.deinit();
+
+        var matches = try ctx.collectMatches();
+        defer matches.deinit(ctx.allocator);
+
+        try std.testing.expectEqual(expected_matches.items.len, matches.items.len);
+        for (expected_matches.items, matches.items) |e, m| {
+            try std.testing.expectEqualStrings(expected.stringOf(e), ctx.stringOf(m));
+        }
+    }
+}
@@ -1,9 +1,12 @@
 const std = @import("std");
 const ts = @import("tree-sitter");
 const ds = @import("../ds.zig");
-const OverlayMap = ds.OverlayMap;
+const SlotMap = ds.SlotMap;
 const Rc = ds.Rc;
 const pcre2 = @import("../regex.zig");
+const KindIndex = @import("./kind_index.zig").KindIndex;
+const PreorderWalker = @import("./preorder_walker.zig").PreorderWalker;
+const Reachability = @import("../reachability.zig").Reachability;
 
 const Allocator = std.mem.Allocator;
 
@@ -26,20 +29,45 @@ pub const Range = struct {
     end_byte: u32,
 };
 
-pub const Value = union(enum) {
+/// Index of a node in the runtime's node table. See `Runtime.nodeOf`.
+pub const NodeRef = u32;
+/// Index into `ProgramImage.strings`.
+pub const StringId = u32;
+/// Index into `ProgramImage.regexes`.
+pub const RegexId = u32;
+
+/// Byte range of the source text.
+pub const Span = struct {
+    start: u32,
+    end: u32,
+};
+
+/// Runtime values are kept to a small tag and an 8-byte payload so that
+/// environments, lists and instruction literals stay dense. Anything larger
+/// lives elsewhere and is referenced by index: nodes in the runtime's node
+/// table, literal strings and regexes in the program's constant pools, and
+/// node text as a span of the source. Ranges are computed from their node on
+/// demand. Use the `Runtime` to resolve them.
+pub const Value = union(enum(u8)) {
     nothing,
     uint: u64,
-    string: []const u8,
-    range: Range,
+    /// Literal string from the constant pool.
+    string: StringId,
+    /// Slice of the source text.
+    text: Span,
+    /// Range of the referenced node.
+    range: NodeRef,
     kind_id: NodeKindId,
     field_id: FieldId,
-    node: ts.Node,
-    // NOTE: Do we want to reference the value directly or via e.g. a regex
-    // pool in the runtime? Mostly a question of ownership I guess
-    regex: pcre2.Regex,
+    node: NodeRef,
+    regex: RegexId,
     record: *Rc(Record),
     list: *Rc(List),
 
+    comptime {
+        std.debug.assert(@sizeOf(Value) == 16);
+    }
+
     /// Bump refcounts on heap variants; no-op for inline ones. Producers
     /// (asn, push_build, yield) call this before handing a Value to a new
     /// owner.
@@ -58,59 +86,37 @@ pub const Value = union(enum) {
             else => {},
         }
     }
+};
 
-    pub fn eql(a: Value, b: Value) bool {
-        if (@intFromEnum(a) != @intFromEnum(b)) return false;
-
-        return switch (a) {
-            .nothing => true,
-            .uint => |uint| uint == b.uint,
-            .string => |a_str| std.mem.eql(u8, a_str, b.string),
-            .range => |a_range| {
-                const b_range = b.range;
-                return a_range.start_byte == b_range.start_byte and
-                    a_range.end_byte == b_range.end_byte and
-                    a_range.start_point.row == b_range.start_point.row and
-                    a_range.start_point.column == b_range.start_point.column and
-                    a_range.end_point.row == b_range.end_point.row and
-                    a_range.end_point.column == b_range.end_point.column;
-            },
-            .kind_id => |a_kind| a_kind == b.kind_id,
-            .field_id => |a_field| a_field == b.field_id,
-            .node => |a_node| a_node.eql(b.node),
-            .regex => |a_regex| a_regex.eql(b.regex),
-            .record => |a_r| a_r == b.record,
-            .list => |a_l| a_l == b.list,
-        };
+pub const Record = struct {
+    pub const Entry = struct {
+        key: []const u8,
+        value: Value,
+    };
+
+    /// Fields in the order they were pushed. The compiler pushes an object
+    /// literal's fields sorted by key and without duplicates, so consumers
+    /// can serialize them as they are.
+    entries: std.ArrayList(Entry),
+
+    pub fn init() Record {
+        return .{ .entries = .empty };
     }
 
-    pub fn print(self: Value, writer: *std.Io.Writer) !void {
-        switch (self) {
-            .nothing => try writer.print("nothing", .{}),
-            .uint => |uint| try writer.print("uint {}", .{uint}),
-            .string => |s| try writer.print("string \"{s}\"", .{s}),
-            .kind_id => |k| try writer.print("kind_id {}", .{k}),
-            .field_id => |f| try writer.print("field_id {}", .{f}),
-            .range => try writer.print("range ...", .{}),
-            .node => try writer.print("node ...", .{}),
-            .regex => try writer.print("regex ...", .{}),
-            .record => try writer.print("record ...", .{}),
-            .list => try writer.print("list ...", .{}),
-        }
+    pub fn deinit(self: *Record, gpa: Allocator) void {
+        for (self.entries.items) |*e| e.value.deinit(gpa);
+        self.entries.deinit(gpa);
     }
-};
 
-pub const Record = struct {
-    map: std.StringHashMap(Value),
-
-    pub fn init(gpa: Allocator) Record {
-        return .{ .map = std.StringHashMap(Value).init(gpa) };
+    pub fn put(self: *Record, gpa: Allocator, key: []const u8, value: Value) Allocator.Error!void {
+        try self.entries.append(gpa, .{ .key = key, .value = value });
     }
 
-    pub fn deinit(self: *Record, gpa: Allocator) void {
-        var it = self.map.valueIterator();
-        while (it.next()) |v| v.deinit(gpa);
-        self.map.deinit();
+    pub fn get(self: *const Record, key: []const u8) ?Value {
+        for (self.entries.items) |e| {
+            if (std.mem.eql(u8, e.key, key)) return e.value;
+        }
+        return null;
     }
 };
 
@@ -127,9 +133,10 @@ pub const List = struct {
     }
 };
 
-// Use an OverlayMap to map variable ids to values. This is probably only more efficient than a
-// standard hash map if we do more copies than lookups. But we probably do? May need to benchmark.
-pub const Environment = OverlayMap(VariableId, Value);
+// Variable ids are dense and assigned at compile time, so the environment is a
+// fixed array of slots indexed by id. Reads are O(1); writes copy the array
+// only when it is shared with another frame.
+pub const Environment = SlotMap(Value);
 
 pub const AggregatingValue = enum { list };
 
@@ -189,7 +196,13 @@ pub const Frame = struct {
     split: ?struct {
         iterator: SplitIterator,
         resume_pc: u32,
+        /// Whether branches go through `Runtime.partition` first.
+        partitioned: bool = false,
     } = null,
+    /// Length of the runtime's node table when the frame was pushed. Node
+    /// references made while the frame is on the stack are released when it
+    /// pops, unless a value holding them was handed to a frame below.
+    nodes_mark: u32 = 0,
 };
 
 pub const Stack = std.ArrayList(Frame);
@@ -204,27 +217,31 @@ pub const RuntimeError = error{
     UnexpectedType,
 };
 
+/// Whether `n` is a node a traversal should produce: named, and of kind
+/// `kind_id` if one is given.
+fn acceptsNode(n: ts.Node, kind_id: ?NodeKindId) bool {
+    if (!n.isNamed()) return false;
+    return if (kind_id) |k| n.kindId() == k else true;
+}
+
 pub const ChildIterator = struct {
     cursor: ?ts.TreeCursor,
+    /// If set, children of any other kind are skipped.
+    kind_id: ?NodeKindId,
     started: bool,
 
-    pub fn init(parent_node: ts.Node) ChildIterator {
-        var cursor = parent_node.walk();
-        if (!cursor.gotoFirstChild()) {
-            cursor.destroy();
-            return .{ .cursor = null, .started = false };
-        }
-
+    pub fn init(parent_node: ts.Node, kind_id: ?NodeKindId) ChildIterator {
         var iter = ChildIterator{
-            .cursor = cursor,
+            .cursor = parent_node.walk(),
+            .kind_id = kind_id,
             .started = false,
         };
-
-        if (!cursor.node().isNamed()) {
-            if (!iter.advance()) {
-                cursor.destroy();
-                return .{ .cursor = null, .started = false };
-            }
+        const cursor = &iter.cursor.?;
+        if (!cursor.gotoFirstChild() or
+            (!acceptsNode(cursor.node(), kind_id) and !iter.advance()))
+        {
+            cursor.destroy();
+            iter.cursor = null;
         }
 
         return iter;
@@ -246,7 +263,7 @@ pub const ChildIterator = struct {
     fn advance(self: *ChildIterator) bool {
         var cursor = &self.cursor.?;
         while (cursor.gotoNextSibling()) {
-            if (cursor.node().isNamed()) {
+            if (acceptsNode(cursor.node(), self.kind_id)) {
                 return true;
             }
         }
@@ -261,27 +278,24 @@ pub const ChildIterator = struct {
 pub const FieldIterator = struct {
     cursor: ?ts.TreeCursor,
     field_id: FieldId,
+    /// If set, field values of any other kind are skipped.
+    kind_id: ?NodeKindId,
     started: bool,
 
-    pub fn init(parent_node: ts.Node, field_id: FieldId) FieldIterator {
-        var cursor = parent_node.walk();
-        if (!cursor.gotoFirstChild()) {
-            cursor.destroy();
-            return .{ .cursor = null, .field_id = field_id, .started = false };
-        }
-
+    pub fn init(parent_node: ts.Node, field_id: FieldId, kind_id: ?NodeKindId) FieldIterator {
         var iter = FieldIterator{
-            .cursor = cursor,
+            .cursor = parent_node.walk(),
             .field_id = field_id,
+            .kind_id = kind_id,
             .started = false,
         };
-
+        const cursor = &iter.cursor.?;
         // If the first child doesn't match the field, advance to find one that does
-        if (cursor.fieldId() != field_id) {
-            if (!iter.advance()) {
-                cursor.destroy();
-                return .{ .cursor = null, .field_id = field_id, .started = false };
-            }
+        if (!cursor.gotoFirstChild() or
+            (!iter.accepts(cursor) and !iter.advance()))
+        {
+            cursor.destroy();
+            iter.cursor = null;
         }
 
         return iter;
@@ -300,10 +314,15 @@ pub const FieldIterator = struct {
         return self.advance();
     }
 
+    fn accepts(self: *const FieldIterator, cursor: *ts.TreeCursor) bool {
+        if (cursor.fieldId() != self.field_id) return false;
+        return if (self.kind_id) |k| cursor.node().kindId() == k else true;
+    }
+
     fn advance(self: *FieldIterator) bool {
         var cursor = &self.cursor.?;
         while (cursor.gotoNextSibling()) {
-            if (cursor.fieldId() == self.field_id) {
+            if (self.accepts(cursor)) {
                 return true;
             }
         }
@@ -316,58 +335,47 @@ pub const FieldIterator = struct {
 };
 
 pub const DescendantIterator = struct {
-    cursor: ?ts.TreeCursor,
-    current_index: u32,
-    descendant_count: u32,
-
-    pub fn init(parent_node: ts.Node) DescendantIterator {
-        const descendant_count = parent_node.descendantCount();
-        if (descendant_count == 0) {
-            return .{ .cursor = null, .current_index = 0, .descendant_count = 0 };
-        }
-
-        var cursor = parent_node.walk();
-
-        var iter = DescendantIterator{
-            .cursor = cursor,
-            .current_index = 0,
-            .descendant_count = descendant_count,
+    walker: ?PreorderWalker,
+    /// If set, descendants of any other kind are skipped.
+    kind_id: ?NodeKindId,
+    /// If set along with `kind_id`, subtrees that can't contain that kind
+    /// are skipped without being visited.
+    reachability: ?*const Reachability,
+
+    pub fn init(parent_node: ts.Node, kind_id: ?NodeKindId, reachability: ?*const Reachability) DescendantIterator {
+        return .{
+            .walker = if (parent_node.childCount() > 0) PreorderWalker.init(parent_node) else null,
+            .kind_id = kind_id,
+            .reachability = reachability,
         };
-
-        if (!cursor.node().isNamed()) {
-            if (!iter.advance()) {
-                cursor.destroy();
-                return .{ .cursor = null, .current_index = 0, .descendant_count = 0 };
-            }
-        }
-
-        return iter;
     }
 
     pub fn node(self: *const DescendantIterator) ts.Node {
-        return self.cursor.?.node();
+        return self.walker.?.node();
     }
 
     pub fn next(self: *DescendantIterator) bool {
-        if (self.cursor == null) return false;
-        return self.advance();
-    }
-
-    fn advance(self: *DescendantIterator) bool {
-        var cursor = &self.cursor.?;
-        while (self.current_index + 1 < self.descendant_count) {
-            self.current_index += 1;
-            cursor.gotoDescendant(self.current_index);
-
-            if (cursor.node().isNamed()) {
+        const walker = if (self.walker) |*w| w else return false;
+        while (walker.nextNamed()) {
+            const n = walker.node();
+            if (acceptsNode(n, self.kind_id)) {
                 return true;
             }
+            if (self.canPrune(n)) {
+                walker.skipSubtree();
+            }
         }
         return false;
     }
 
+    fn canPrune(self: *const DescendantIterator, n: ts.Node) bool {
+        const kind_id = self.kind_id orelse return false;
+        const reachability = self.reachability orelse return false;
+        return reachability.canPrune(n, kind_id);
+    }
+
     pub fn deinit(self: *DescendantIterator) void {
-        if (self.cursor) |*c| c.destroy();
+        if (self.walker) |*w| w.deinit();
     }
 };
 
@@ -400,6 +408,7 @@ pub const SplitIterator = union(enum) {
     descendant: DescendantIterator,
     field: FieldIterator,
     singleton: SingletonIterator,
+    indexed: KindIndex.Iterator,
 
     pub fn node(self: *const SplitIterator) ts.Node {
         return switch (self.*) {
@@ -407,6 +416,7 @@ pub const SplitIterator = union(enum) {
             .descendant => |*iter| iter.node(),
             .field => |*iter| iter.node(),
             .singleton => |*iter| iter.node(),
+            .indexed => |*iter| iter.node(),
         };
     }
 
@@ -416,6 +426,7 @@ pub const SplitIterator = union(enum) {
             .descendant => |*iter| iter.next(),
             .field => |*iter| iter.next(),
             .singleton => |*iter| iter.next(),
+            .indexed => |*iter| iter.next(),
         };
     }
 
@@ -425,6 +436,7 @@ pub const SplitIterator = union(enum) {
             .descendant => |*iter| iter.deinit(),
             .field => |*iter| iter.deinit(),
             .singleton => |*iter| iter.deinit(),
+            .indexed => |*iter| iter.deinit(),
         }
     }
 };
@@ -435,6 +447,14 @@ pub const Axis = union(enum) {
     // NOTE: Consider removing this since it's accomplishable with cmp on child
     // and likely not much more efficient
     field: FieldId,
+    /// Kind-filtered variants of the axes above. The kind check happens
+    /// inside the iterator, so non-matching nodes never become frames.
+    child_of_kind: NodeKindId,
+    descendant_of_kind: NodeKindId,
+    field_of_kind: struct {
+        field_id: FieldId,
+        kind_id: NodeKindId,
+    },
     variable_id: VariableId,
 };
 
@@ -452,27 +472,6 @@ pub const ValueSource = union(enum) {
     node: NodeValueSource,
     variable_id: VariableId,
 
-    pub fn print(self: ValueSource, writer: *std.Io.Writer) !void {
-        switch (self) {
-            .literal => |l| {
-                try writer.print("literal ", .{});
-                switch (l) {
-                    .nothing => try writer.print("nothing", .{}),
-                    .uint => |uint| try writer.print("uint {}", .{uint}),
-                    .string => |s| try writer.print("string \"{s}\"", .{s}),
-                    .kind_id => |k| try writer.print("kind_id {}", .{k}),
-                    .field_id => |f| try writer.print("field_id {}", .{f}),
-                    .range => try writer.print("range ...", .{}),
-                    .node => try writer.print("node ...", .{}),
-                    .regex => try writer.print("regex ...", .{}),
-                    .record => try writer.print("record ...", .{}),
-                    .list => try writer.print("list ...", .{}),
-                }
-            },
-            .node => |n| try writer.print("node {s}", .{@tagName(n)}),
-            .variable_id => |v| try writer.print("variable_id {}", .{v}),
-        }
-    }
 };
 
 pub const ProbeData = union(enum) {
@@ -486,6 +485,11 @@ pub const Relation = enum {
     like,
     lt,
     gt,
+    /// The remaining relations compare text with a literal string. The
+    /// compiler reduces regexes to them where it can.
+    starts_with,
+    ends_with,
+    contains,
 };
 
 pub const Condition = enum {
@@ -494,6 +498,8 @@ pub const Condition = enum {
     not_relates,
 };
 
+/// Compiler IR. Easy to build and patch, but too wide to interpret
+/// directly; `bytecode.assemble` lowers it to the runtime's `Code`.
 pub const Instruction = union(enum) {
     noop,
     halt: struct { condition: Condition = .always },
@@ -523,58 +529,9 @@ pub const Instruction = union(enum) {
     begin_build: Vector,
     push_build: struct {
         source: ValueSource,
-        // only applicable for records
-        name: ?[]const u8,
+        /// Record key. Only applicable for records.
+        name: ?StringId,
     },
     end_build: VariableId,
     panic, // debug, probably remove
-
-    pub fn print(self: Instruction, writer: *std.Io.Writer) !void {
-        switch (self) {
-            .noop => try writer.print("noop", .{}),
-            .yield => try writer.print("yield", .{}),
-            .halt => |h| try writer.print("halt {s}", .{@tagName(h.condition)}),
-            .trv => |t| {
-                try writer.print("trv ", .{});
-                switch (t) {
-                    .child => try writer.print("child", .{}),
-                    .descendant => try writer.print("descendant", .{}),
-                    .field => |f| try writer.print("field {}", .{f}),
-                    .variable_id => |v| try writer.print("variable_id {}", .{v}),
-                }
-            },
-            .asn => |a| {
-                try writer.print("asn {} (", .{a.variable_id});
-                try a.source.print(writer);
-                try writer.print(")", .{});
-            },
-            .rel => |r| {
-                try writer.print("rel {s} (", .{@tagName(r.relation)});
-                try r.a.print(writer);
-                try writer.print(") (", .{});
-                try r.b.print(writer);
-                try writer.print(")", .{});
-            },
-            .probe => |p| switch (p.data) {
-                .exists => try writer.print("probe exists {}", .{p.resume_address}),
-                .nexists => try writer.print("probe nexists {}", .{p.resume_address}),
-                .aggregate => |a| try writer.print("probe aggregate {} {} {s}", .{ p.resume_address, a.variable, @tagName(a.kind) }),
-            },
-            .call => |c| try writer.print("call {}", .{c}),
-            .ret => try writer.print("ret", .{}),
-            .jmp => |j| try writer.print("jmp {s} {}", .{ @tagName(j.mode), j.address }),
-            .begin_build => |v| try writer.print("begin_build {s}", .{@tagName(v)}),
-            .push_build => |i| {
-                if (i.name) |name| {
-                    try writer.print("push_build {s} (", .{name});
-                } else {
-                    try writer.print("push_build (", .{});
-                }
-                try i.source.print(writer);
-                try writer.print(")", .{});
-            },
-            .end_build => |v| try writer.print("end_build {}", .{v}),
-            .panic => try writer.print("panic", .{}),
-        }
-    }
 };
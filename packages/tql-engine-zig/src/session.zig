@@ -0,0 +1,497 @@
+//! Incremental re-querying of a document as it is edited.
+//!
+//! A `Session` keeps a document's text and its last tree. Edits are applied
+//! to both, so the next run re-parses with the old tree and tree-sitter
+//! reuses what the edits left alone. When the query's branches are
+//! independent (see `runtime.Partition`), the session also keeps what each
+//! branch of the first fan-out yielded. On the next run, a branch whose node
+//! lies outside every edit and every range tree-sitter reports as changed is
+//! not executed again: its old values are shifted to their new positions
+//! instead.
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const ts = @import("tree-sitter");
+
+const runtime = @import("runtime.zig");
+const engine = @import("engine.zig");
+const Query = engine.Query;
+const Value = engine.Value;
+const RunContext = engine.RunContext;
+const RunResult = engine.RunResult;
+
+pub const Session = struct {
+    const Self = @This();
+
+    /// An edit in the byte offsets of the text it applies to.
+    const Edit = struct {
+        start: u32,
+        old_end: u32,
+        new_end: u32,
+    };
+
+    /// What one branch of the fan-out yielded on the last run.
+    const Branch = struct {
+        start_byte: u32,
+        end_byte: u32,
+        start_point: runtime.Point,
+        kind_id: runtime.NodeKindId,
+        /// Range of `values`.
+        values_start: u32,
+        values_end: u32,
+    };
+
+    query: *Query,
+    allocator: Allocator,
+    context: RunContext = .{},
+    source: std.ArrayList(u8) = .empty,
+    tree: ?*ts.Tree = null,
+    /// Edits since the last run, in order.
+    edits: std.ArrayList(Edit) = .empty,
+    /// The last run's branches, in order, and their values. Empty when the
+    /// last run couldn't be partitioned.
+    branches: std.ArrayList(Branch) = .empty,
+    values: std.ArrayList(Value) = .empty,
+
+    /// Start a session on `text`, which is copied. `query` must outlive the
+    /// session.
+    pub fn init(allocator: Allocator, query: *Query, text: []const u8) Allocator.Error!Self {
+        var self: Self = .{ .query = query, .allocator = allocator };
+        try self.source.appendSlice(allocator, text);
+        return self;
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.clearBranches();
+        self.branches.deinit(self.allocator);
+        self.values.deinit(self.allocator);
+        self.edits.deinit(self.allocator);
+        if (self.tree) |tree| tree.destroy();
+        self.source.deinit(self.allocator);
+        self.context.deinit();
+    }
+
+    pub fn text(self: *const Self) []const u8 {
+        return self.source.items;
+    }
+
+    /// Replace the bytes from `start` to `old_end` with `new_text`.
+    pub fn edit(self: *Self, start: u32, old_end: u32, new_text: []const u8) !void {
+        if (start > old_end or old_end > self.source.items.len) return error.InvalidEdit;
+        const new_end = std.math.add(u32, start, std.math.cast(u32, new_text.len) orelse return error.InvalidEdit) catch
+            return error.InvalidEdit;
+
+        const start_point = pointAt(self.source.items, start);
+        const old_end_point = pointAt(self.source.items, old_end);
+        try self.edits.ensureUnusedCapacity(self.allocator, 1);
+        try self.source.replaceRange(self.allocator, start, old_end - start, new_text);
+        self.edits.appendAssumeCapacity(.{ .start = start, .old_end = old_end, .new_end = new_end });
+
+        if (self.tree) |tree| tree.edit(.{
+            .start_byte = start,
+            .old_end_byte = old_end,
+            .new_end_byte = new_end,
+            .start_point = start_point,
+            .old_end_point = old_end_point,
+            .new_end_point = advance(start_point, new_text),
+        });
+    }
+
+    /// Replace the whole text. Nothing from earlier runs is reused.
+    pub fn setText(self: *Self, new_text: []const u8) Allocator.Error!void {
+        self.source.clearRetainingCapacity();
+        try self.source.appendSlice(self.allocator, new_text);
+        if (self.tree) |tree| tree.destroy();
+        self.tree = null;
+        self.edits.clearRetainingCapacity();
+        self.clearBranches();
+    }
+
+    /// Run the query over the current text. Like `Query.run`, the caller
+    /// owns the returned values.
+    pub fn run(self: *Self, result_allocator: Allocator, scratch_allocator: Allocator) !RunResult {
+        const query = self.query;
+        const io = query.io;
+        const source = self.source.items;
+        if (!query.program_image.prefilter.admits(query.program_image.strings, source)) {
+            // The tree has had the edits applied, so it can still serve as
+            // the old tree later on. The branches can't.
+            self.edits.clearRetainingCapacity();
+            self.clearBranches();
+            return .{
+                .values = .empty,
+                .stats = .{ .parse_time = .zero, .query_time = .zero, .skipped = true },
+                .allocator = result_allocator,
+            };
+        }
+
+        const source_parser = try self.context.parserFor(query.language);
+        const parse_start = std.Io.Timestamp.now(io, .real);
+        const tree = source_parser.parseString(source, self.tree) orelse return error.SourceParseFailed;
+        errdefer tree.destroy();
+        const parse_time = parse_start.untilNow(io, .real);
+
+        const changed: []const ts.Range = if (self.tree) |old_tree| old_tree.getChangedRanges(tree) else &.{};
+        defer if (changed.len > 0) std.c.free(@ptrCast(@constCast(changed.ptr)));
+
+        var rerun: Rerun = .{
+            .session = self,
+            .changed = changed,
+            .values = .empty,
+            .result_allocator = result_allocator,
+        };
+        defer rerun.deinit();
+        try rerun.indexOldBranches();
+
+        const query_start = std.Io.Timestamp.now(io, .real);
+        const partition: ?runtime.Partition = if (runtime.Partition.find(query.program_image.code)) |address| .{
+            .address = address,
+            .context = &rerun,
+            .admit = Rerun.admit,
+        } else null;
+        var rt = query.runtimeFor(tree, source, scratch_allocator, partition);
+        defer rt.deinit();
+        try rt.exec();
+        while (try rt.next()) |runtime_value| {
+            const v = try Value.fromRuntimeValue(result_allocator, runtime_value, &rt, .{});
+            errdefer {
+                var owned = v;
+                owned.deinit(result_allocator);
+            }
+            try rerun.values.append(result_allocator, v);
+        }
+        try rerun.closeBranch();
+        const query_time = query_start.untilNow(io, .real);
+
+        if (self.tree) |old_tree| old_tree.destroy();
+        self.tree = tree;
+        self.edits.clearRetainingCapacity();
+        self.clearBranches();
+        if (partition != null) {
+            std.mem.swap(std.ArrayList(Branch), &self.branches, &rerun.branches);
+            std.mem.swap(std.ArrayList(Value), &self.values, &rerun.cached);
+        }
+
+        return .{
+            .values = rerun.takeValues(),
+            .stats = .{ .parse_time = parse_time, .query_time = query_time },
+            .allocator = result_allocator,
+        };
+    }
+
+    fn clearBranches(self: *Self) void {
+        for (self.values.items) |*v| v.deinit(self.allocator);
+        self.values.clearRetainingCapacity();
+        self.branches.clearRetainingCapacity();
+    }
+
+    /// The byte range `start..end` of the current text had before the
+    /// pending edits, or null if an edit touched it.
+    fn oldSpanOf(self: *const Self, start: u32, end: u32) ?[2]u32 {
+        var old = [2]u32{ start, end };
+        var i = self.edits.items.len;
+        while (i > 0) {
+            i -= 1;
+            const e = self.edits.items[i];
+            if (old[1] <= e.start) continue;
+            if (old[0] < e.new_end) return null;
+            old = .{ old[0] - e.new_end + e.old_end, old[1] - e.new_end + e.old_end };
+        }
+        return old;
+    }
+};
+
+/// State of one `Session.run`, which the runtime calls back into at each
+/// branch of the fan-out.
+const Rerun = struct {
+    session: *Session,
+    /// Ranges of the new tree whose structure changed.
+    changed: []const ts.Range,
+    /// Values for the caller, in `result_allocator`.
+    values: std.ArrayList(Value),
+    result_allocator: Allocator,
+    /// Old branch by position, or `ambiguous` when positions repeat.
+    old_branches: std.AutoHashMapUnmanaged(BranchKey, u32) = .empty,
+    /// This run's branches and a copy of their values, in the session's
+    /// allocator, for the next run.
+    branches: std.ArrayList(Session.Branch) = .empty,
+    cached: std.ArrayList(Value) = .empty,
+    /// The branch running now, whose values start at `open_start`.
+    open: ?Session.Branch = null,
+    open_start: u32 = 0,
+
+    const ambiguous = std.math.maxInt(u32);
+
+    const BranchKey = struct {
+        start_byte: u32,
+        end_byte: u32,
+        kind_id: runtime.NodeKindId,
+    };
+
+    fn deinit(self: *Rerun) void {
+        const gpa = self.session.allocator;
+        self.old_branches.deinit(gpa);
+        self.branches.deinit(gpa);
+        for (self.cached.items) |*v| v.deinit(gpa);
+        self.cached.deinit(gpa);
+        for (self.values.items) |*v| v.deinit(self.result_allocator);
+        self.values.deinit(self.result_allocator);
+    }
+
+    fn takeValues(self: *Rerun) std.ArrayList(Value) {
+        const values = self.values;
+        self.values = .empty;
+        return values;
+    }
+
+    fn indexOldBranches(self: *Rerun) Allocator.Error!void {
+        for (self.session.branches.items, 0..) |branch, index| {
+            const entry = try self.old_branches.getOrPut(self.session.allocator, .{
+                .start_byte = branch.start_byte,
+                .end_byte = branch.end_byte,
+                .kind_id = branch.kind_id,
+            });
+            entry.value_ptr.* = if (entry.found_existing) ambiguous else @intCast(index);
+        }
+    }
+
+    fn admit(context: *anyopaque, node: ts.Node) error{OutOfMemory}!bool {
+        const self: *Rerun = @ptrCast(@alignCast(context));
+        try self.closeBranch();
+
+        const start_point = node.startPoint();
+        var branch: Session.Branch = .{
+            .start_byte = node.startByte(),
+            .end_byte = node.endByte(),
+            .start_point = .{ .row = start_point.row, .column = start_point.column },
+            .kind_id = node.kindId(),
+            .values_start = 0,
+            .values_end = 0,
+        };
+
+        if (self.reusable(branch)) |old| {
+            const session = self.session;
+            const shift: Shift = .{
+                .bytes = @as(i64, branch.start_byte) - old.start_byte,
+                .rows = @as(i64, branch.start_point.row) - old.start_point.row,
+                .columns = @as(i64, branch.start_point.column) - old.start_point.column,
+                .row = old.start_point.row,
+            };
+            branch.values_start = @intCast(self.cached.items.len);
+            for (session.values.items[old.values_start..old.values_end]) |v| {
+                try self.values.ensureUnusedCapacity(self.result_allocator, 1);
+                try self.cached.ensureUnusedCapacity(session.allocator, 1);
+                self.values.appendAssumeCapacity(try cloneShifted(self.result_allocator, v, shift));
+                self.cached.appendAssumeCapacity(try cloneShifted(session.allocator, v, shift));
+            }
+            branch.values_end = @intCast(self.cached.items.len);
+            try self.branches.append(session.allocator, branch);
+            return false;
+        }
+
+        self.open = branch;
+        self.open_start = @intCast(self.values.items.len);
+        return true;
+    }
+
+    /// Record what the branch that just ran yielded.
+    fn closeBranch(self: *Rerun) Allocator.Error!void {
+        var branch = self.open orelse return;
+        self.open = null;
+        const gpa = self.session.allocator;
+        branch.values_start = @intCast(self.cached.items.len);
+        for (self.values.items[self.open_start..]) |v| {
+            try self.cached.ensureUnusedCapacity(gpa, 1);
+            self.cached.appendAssumeCapacity(try cloneShifted(gpa, v, .none));
+        }
+        branch.values_end = @intCast(self.cached.items.len);
+        try self.branches.append(gpa, branch);
+    }
+
+    /// The old branch `branch` can take its values from, if no edit or
+    /// structural change reached it.
+    fn reusable(self: *const Rerun, branch: Session.Branch) ?Session.Branch {
+        for (self.changed) |range| {
+            if (range.start_byte < branch.end_byte and branch.start_byte < @max(range.end_byte, range.start_byte + 1)) return null;
+        }
+        const old = self.session.oldSpanOf(branch.start_byte, branch.end_byte) orelse return null;
+        const index = self.old_branches.get(.{
+            .start_byte = old[0],
+            .end_byte = old[1],
+            .kind_id = branch.kind_id,
+        }) orelse return null;
+        if (index == ambiguous) return null;
+        return self.session.branches.items[index];
+    }
+};
+
+/// How positions inside an untouched branch moved.
+const Shift = struct {
+    bytes: i64,
+    rows: i64,
+    /// Applies on `row`, the branch's first row before the move; edits
+    /// before the branch on that row moved its columns.
+    columns: i64,
+    row: u32,
+
+    const none: Shift = .{ .bytes = 0, .rows = 0, .columns = 0, .row = 0 };
+
+    fn byte(self: Shift, b: u32) u32 {
+        return @intCast(@as(i64, b) + self.bytes);
+    }
+
+    fn point(self: Shift, p: runtime.Point) runtime.Point {
+        return .{
+            .row = @intCast(@as(i64, p.row) + self.rows),
+            .column = if (p.row == self.row) @intCast(@as(i64, p.column) + self.columns) else p.column,
+        };
+    }
+};
+
+fn cloneShifted(gpa: Allocator, value: Value, shift: Shift) Allocator.Error!Value {
+    return switch (value) {
+        .nothing => .{ .nothing = {} },
+        .uint => |u| .{ .uint = u },
+        .string => |s| .{ .string = try gpa.dupe(u8, s) },
+        .node => |n| blk: {
+            const text = if (n.text) |t| try gpa.dupe(u8, t) else null;
+            break :blk .{ .node = .{
+                .kind = n.kind,
+                .kind_id = n.kind_id,
+                .text = text,
+                .owns_text = text != null,
+                .start_byte = shift.byte(n.start_byte),
+                .end_byte = shift.byte(n.end_byte),
+                .start_point = shift.point(n.start_point),
+                .end_point = shift.point(n.end_point),
+            } };
+        },
+        .range => |r| .{ .range = .{
+            .start_point = shift.point(r.start_point),
+            .end_point = shift.point(r.end_point),
+            .start_byte = shift.byte(r.start_byte),
+            .end_byte = shift.byte(r.end_byte),
+        } },
+        .record => |r| blk: {
+            const entries = try gpa.alloc(engine.RecordEntry, r.entries.len);
+            var done: usize = 0;
+            errdefer {
+                for (entries[0..done]) |*e| {
+                    gpa.free(e.key);
+                    e.value.deinit(gpa);
+                }
+                gpa.free(entries);
+            }
+            for (entries, r.entries) |*out, e| {
+                const key = try gpa.dupe(u8, e.key);
+                errdefer gpa.free(key);
+                out.* = .{ .key = key, .value = try cloneShifted(gpa, e.value, shift) };
+                done += 1;
+            }
+            break :blk .{ .record = .{ .entries = entries } };
+        },
+        .list => |l| blk: {
+            const items = try gpa.alloc(Value, l.items.len);
+            var done: usize = 0;
+            errdefer {
+                for (items[0..done]) |*v| v.deinit(gpa);
+                gpa.free(items);
+            }
+            for (items, l.items) |*out, v| {
+                out.* = try cloneShifted(gpa, v, shift);
+                done += 1;
+            }
+            break :blk .{ .list = .{ .items = items } };
+        },
+    };
+}
+
+fn pointAt(text: []const u8, byte: u32) ts.Point {
+    const before = text[0..byte];
+    const line_start = if (std.mem.lastIndexOfScalar(u8, before, '\n')) |nl| nl + 1 else 0;
+    return .{
+        .row = @intCast(std.mem.count(u8, before, "\n")),
+        .column = @intCast(byte - line_start),
+    };
+}
+
+/// Where `point` ends up after inserting `inserted` there.
+fn advance(point: ts.Point, inserted: []const u8) ts.Point {
+    const last_nl = std.mem.lastIndexOfScalar(u8, inserted, '\n') orelse
+        return .{ .row = point.row, .column = point.column + @as(u32, @intCast(inserted.len)) };
+    return .{
+        .row = point.row + @as(u32, @intCast(std.mem.count(u8, inserted, "\n"))),
+        .column = @intCast(inserted.len - last_nl - 1),
+    };
+}
+
+const testing = std.testing;
+const Language = @import("language.zig").Language;
+
+fn expectSameValues(expected: []const Value, actual: []const Value) !void {
+    var expected_json: std.Io.Writer.Allocating = .init(testing.allocator);
+    defer expected_json.deinit();
+    var actual_json: std.Io.Writer.Allocating = .init(testing.allocator);
+    defer actual_json.deinit();
+    try std.json.Stringify.value(expected, .{}, &expected_json.writer);
+    try std.json.Stringify.value(actual, .{}, &actual_json.writer);
+    try testing.expectEqualStrings(expected_json.written(), actual_json.written());
+}
+
+test "sessions agree with running from scratch" {
+    var single_threaded = std.Io.Threaded.init_single_threaded;
+    var eng = try engine.Engine.init(.{ .allocator = testing.allocator, .io = single_threaded.io() });
+    defer eng.deinit();
+    var query = try eng.compile(
+        \\with @root > function_definition as @fn,
+        \\     @fn.declarator as @d
+        \\select { name: @d, body: @fn.body }
+    , .c);
+    defer query.deinit();
+
+    var session = try Session.init(testing.allocator, &query,
+        \\int main(void) { return 0; }
+        \\
+        \\static int helper(int x) {
+        \\  return x;
+        \\}
+        \\int last(void) { return 1; }
+        \\
+    );
+    defer session.deinit();
+
+    const edits = [_]struct { start: u32, old_end: u32, text: []const u8 }{
+        // Inside the first function, which moves the others.
+        .{ .start = 24, .old_end = 25, .text = "42" },
+        // A new line between the first two.
+        .{ .start = 30, .old_end = 30, .text = "// note\n" },
+        // Rename the last one.
+        .{ .start = 84, .old_end = 88, .text = "final" },
+        // Break the second one's syntax.
+        .{ .start = 56, .old_end = 57, .text = "" },
+        // Move the first one along its row.
+        .{ .start = 0, .old_end = 0, .text = "int first(void) { return 2; } " },
+    };
+
+    var first = try session.run(testing.allocator, testing.allocator);
+    first.deinit();
+    for (edits) |e| {
+        try session.edit(e.start, e.old_end, e.text);
+
+        var incremental = try session.run(testing.allocator, testing.allocator);
+        defer incremental.deinit();
+        var scratch = try query.run(session.text(), testing.allocator, testing.allocator);
+        defer scratch.deinit();
+        try expectSameValues(scratch.values.items, incremental.values.items);
+    }
+    try testing.expect(session.branches.items.len > 0);
+
+    try testing.expectError(error.InvalidEdit, session.edit(10, 5, ""));
+    try testing.expectError(error.InvalidEdit, session.edit(0, @intCast(session.text().len + 1), ""));
+}
+
+test "edit positions" {
+    try testing.expectEqual(ts.Point{ .row = 1, .column = 2 }, pointAt("ab\ncd", 5));
+    try testing.expectEqual(ts.Point{ .row = 0, .column = 1 }, pointAt("ab\ncd", 1));
+    try testing.expectEqual(ts.Point{ .row = 0, .column = 5 }, advance(.{ .row = 0, .column = 2 }, "xyz"));
+    try testing.expectEqual(ts.Point{ .row = 2, .column = 1 }, advance(.{ .row = 0, .column = 2 }, "x\n\nz"));
+}
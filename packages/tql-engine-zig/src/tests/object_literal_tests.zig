@@ -44,3 +44,13 @@ test "multiple matches" {
         ,
     });
 }
+
+test "keys out of order" {
+    try Snapshotter.snapshotQuery(@src(), .{
+        .query =
+        \\with @root > class_declaration as @class
+        \\select { node: @class, kind: 'class', kind: 'klass' }
+        ,
+        .target = "class Foo {}",
+    });
+}
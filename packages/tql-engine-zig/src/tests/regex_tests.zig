@@ -63,3 +63,20 @@ test "regex match character class" {
         ,
     });
 }
+
+test "regexes on one name as a set" {
+    try Snapshotter.snapshotQuery(@src(), .{
+        .query =
+        \\with @root > class_declaration as @c,
+        \\     @c.name as @n
+        \\where @n ~ /^Service/ or @n ~ /Provider$/
+        \\select @c
+        ,
+        .target =
+        \\class Service {}
+        \\class Controller {}
+        \\class ServiceProvider {}
+        \\class FooProvider {}
+        ,
+    });
+}
@@ -34,6 +34,8 @@ pub fn snapshotQuery(comptime src: std.builtin.SourceLocation, opts: SnapshotQue
 
     var compiler = Compiler.init(allocator, language);
     defer compiler.deinit();
+    try compiler.loadNodeTypes(opts.language.nodeTypes());
+    compiler.loadKeywords(opts.language.keywords());
 
     var program = try compiler.compile(allocator, ast);
     defer program.deinit();
@@ -48,8 +50,13 @@ pub fn snapshotQuery(comptime src: std.builtin.SourceLocation, opts: SnapshotQue
     var rt = Runtime.init(.{
         .tree = tree,
         .source = opts.target,
-        .instructions = program.instructions,
+        .code = program.code,
+        .constants = program.constants,
         .regexes = program.regexes,
+        .regex_sets = &program.regex_sets,
+        .strings = program.strings,
+        .reachability = if (program.reachability) |*r| r else null,
+        .variable_count = program.variable_count,
         .allocator = allocator,
     });
     defer rt.deinit();
@@ -63,14 +70,20 @@ pub fn snapshotQuery(comptime src: std.builtin.SourceLocation, opts: SnapshotQue
     }
 
     while (try rt.next()) |value| {
-        const enriched = try engine.Value.fromRuntimeValue(allocator, value, opts.target);
+        const enriched = try engine.Value.fromRuntimeValue(allocator, value, &rt, .{});
         try values.append(allocator, enriched);
     }
 
+    // `Query.run` would have skipped the target without running anything.
+    if (values.items.len > 0 and !program.prefilter.admits(program.strings, opts.target)) {
+        std.debug.print("prefilter rejects a target the query yields for\n", .{});
+        return error.PrefilterRejectsMatch;
+    }
+
     const actual_ast = try ast.sexprAlloc(allocator);
     defer allocator.free(actual_ast);
 
-    const actual_bytecode = try renderBytecode(allocator, program.instructions);
+    const actual_bytecode = try renderBytecode(allocator, &program);
     defer allocator.free(actual_bytecode);
 
     const actual_values = try renderValues(allocator, values.items);
@@ -113,8 +126,16 @@ pub fn snapshotQuery(comptime src: std.builtin.SourceLocation, opts: SnapshotQue
     if (any_failed) return error.SnapshotMismatch;
 }
 
-fn renderBytecode(gpa: std.mem.Allocator, instructions: []const runtime.Instruction) ![]const u8 {
-    return try formatInstructions(gpa, instructions);
+fn renderBytecode(gpa: std.mem.Allocator, program: *const runtime.ProgramImage) ![]const u8 {
+    var w: std.Io.Writer.Allocating = .init(gpa);
+    errdefer w.deinit();
+
+    const disassembler: runtime.Disassembler = .{
+        .constants = program.constants,
+        .strings = program.strings,
+    };
+    try disassembler.printAll(&w.writer, program.code);
+    return try w.toOwnedSlice();
 }
 
 fn renderValues(gpa: std.mem.Allocator, values: []const engine.Value) ![]const u8 {
@@ -135,19 +156,6 @@ fn renderValues(gpa: std.mem.Allocator, values: []const engine.Value) ![]const u
     return try w.toOwnedSlice();
 }
 
-pub fn formatInstructions(allocator: std.mem.Allocator, instructions: []const runtime.Instruction) ![]const u8 {
-    var allocating = try std.Io.Writer.Allocating.initCapacity(allocator, 10 * 1024 * 1024);
-    defer allocating.deinit();
-
-    for (instructions, 0..) |inst, i| {
-        try allocating.writer.print("{d:0>4}: ", .{i});
-        try inst.print(&allocating.writer);
-        try allocating.writer.writeByte('\n');
-    }
-
-    return try allocating.toOwnedSlice();
-}
-
 /// Load snapshot with file, or return null if file doesn't exist
 pub fn loadSnapshot(allocator: std.mem.Allocator, io: std.Io, path: []const u8) !?[]const u8 {
     const file = std.Io.Dir.cwd().openFile(io, path, .{}) catch |err| {
@@ -0,0 +1,337 @@
+//! Build-time tool: derive from a grammar.json the keywords that every node
+//! of a kind contains, e.g. `goto` for C's `goto_statement`.
+//!
+//! Writes one line per kind that has any, `<kind> <keyword>...`, longest
+//! keyword first. The engine embeds the output (see `Language.keywords`)
+//! and uses it to rule out files that can't contain a kind without parsing
+//! them.
+//!
+//! Usage: `grammar-keywords <grammar.json> <output>`.
+const std = @import("std");
+const clap = @import("clap");
+const Allocator = std.mem.Allocator;
+const json = std.json;
+
+/// Set of token strings. Keys point into the parsed grammar.
+const Set = std.StringArrayHashMapUnmanaged(void);
+
+const Analysis = struct {
+    arena: Allocator,
+    rules: json.ObjectMap,
+    /// Strings that name external tokens. The external scanner may produce
+    /// them without the text, so they are never assumed present.
+    externals: Set,
+    /// Tokens every expansion of each rule contains. Grows monotonically
+    /// from empty, so every intermediate value is safe to use.
+    needed: std.StringHashMapUnmanaged(Set),
+
+    fn init(arena: Allocator, grammar: json.Value) !Analysis {
+        const root = switch (grammar) {
+            .object => |object| object,
+            else => return error.InvalidGrammar,
+        };
+        const rules = switch (root.get("rules") orelse return error.InvalidGrammar) {
+            .object => |object| object,
+            else => return error.InvalidGrammar,
+        };
+
+        var externals: Set = .empty;
+        const external_rules = if (root.get("externals")) |value| arrayItems(value) else &[_]json.Value{};
+        for (external_rules) |external| {
+            if (!isType(external, "STRING")) continue;
+            try externals.put(arena, stringField(external, "value") orelse continue, {});
+        }
+
+        var needed: std.StringHashMapUnmanaged(Set) = .empty;
+        for (rules.keys()) |name| try needed.put(arena, name, .empty);
+
+        return .{ .arena = arena, .rules = rules, .externals = externals, .needed = needed };
+    }
+
+    /// Iterate to a fixpoint. Rules only reference each other through
+    /// SYMBOL, so this converges in about the grammar's nesting depth.
+    fn solve(self: *Analysis) !void {
+        var changed = true;
+        while (changed) {
+            changed = false;
+            var it = self.rules.iterator();
+            while (it.next()) |entry| {
+                const set = try self.tokensOf(entry.value_ptr.*);
+                const old = self.needed.getPtr(entry.key_ptr.*).?;
+                if (set.count() > old.count()) {
+                    old.* = set;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    /// Tokens that every string `rule` matches contains.
+    fn tokensOf(self: *Analysis, rule: json.Value) Allocator.Error!Set {
+        const kind = stringField(rule, "type") orelse return .empty;
+        const Type = enum { STRING, SYMBOL, SEQ, CHOICE, REPEAT1, FIELD, ALIAS, TOKEN, IMMEDIATE_TOKEN, PREC, PREC_LEFT, PREC_RIGHT, PREC_DYNAMIC, RESERVED };
+        // PATTERN, BLANK and REPEAT guarantee nothing.
+        const rule_type = std.meta.stringToEnum(Type, kind) orelse return .empty;
+        switch (rule_type) {
+            .STRING => {
+                const value = stringField(rule, "value") orelse return .empty;
+                var set: Set = .empty;
+                if (value.len > 0 and !self.externals.contains(value)) try set.put(self.arena, value, {});
+                return set;
+            },
+            .SYMBOL => {
+                const name = stringField(rule, "name") orelse return .empty;
+                const set = self.needed.get(name) orelse return .empty;
+                return set.clone(self.arena);
+            },
+            .SEQ => {
+                var set: Set = .empty;
+                for (members(rule)) |member| {
+                    const member_set = try self.tokensOf(member);
+                    for (member_set.keys()) |token| try set.put(self.arena, token, {});
+                }
+                return set;
+            },
+            .CHOICE => {
+                const choices = members(rule);
+                if (choices.len == 0) return .empty;
+                var set = try self.tokensOf(choices[0]);
+                for (choices[1..]) |choice| {
+                    if (set.count() == 0) break;
+                    const choice_set = try self.tokensOf(choice);
+                    var i: usize = 0;
+                    while (i < set.count()) {
+                        if (choice_set.contains(set.keys()[i])) {
+                            i += 1;
+                        } else {
+                            set.swapRemoveAt(i);
+                        }
+                    }
+                }
+                return set;
+            },
+            else => {
+                const content = switch (rule) {
+                    .object => |object| object.get("content") orelse return .empty,
+                    else => return .empty,
+                };
+                return self.tokensOf(content);
+            },
+        }
+    }
+
+    /// Tokens every node of each named kind contains. A kind can be
+    /// produced by its own rule and by any number of aliases, so this is
+    /// the intersection over all of them.
+    fn kinds(self: *Analysis) Allocator.Error!std.StringArrayHashMapUnmanaged(Set) {
+        var result: std.StringArrayHashMapUnmanaged(Set) = .empty;
+        var it = self.rules.iterator();
+        while (it.next()) |entry| {
+            if (!std.mem.startsWith(u8, entry.key_ptr.*, "_")) {
+                try self.produce(&result, entry.key_ptr.*, self.needed.get(entry.key_ptr.*).?);
+            }
+            try self.collectAliases(&result, entry.value_ptr.*);
+        }
+        return result;
+    }
+
+    fn collectAliases(self: *Analysis, result: *std.StringArrayHashMapUnmanaged(Set), rule: json.Value) Allocator.Error!void {
+        const object = switch (rule) {
+            .object => |object| object,
+            else => return,
+        };
+        const content = object.get("content");
+        if (isType(rule, "ALIAS") and content != null) {
+            const named = if (object.get("named")) |value| value == .bool and value.bool else false;
+            const name = stringField(rule, "value");
+            if (named and name != null) try self.produce(result, name.?, try self.tokensOf(content.?));
+        }
+        if (content) |c| try self.collectAliases(result, c);
+        for (members(rule)) |member| try self.collectAliases(result, member);
+    }
+
+    fn produce(self: *Analysis, result: *std.StringArrayHashMapUnmanaged(Set), kind: []const u8, set: Set) Allocator.Error!void {
+        const entry = try result.getOrPut(self.arena, kind);
+        if (!entry.found_existing) {
+            entry.value_ptr.* = try set.clone(self.arena);
+            return;
+        }
+        var i: usize = 0;
+        while (i < entry.value_ptr.count()) {
+            if (set.contains(entry.value_ptr.keys()[i])) {
+                i += 1;
+            } else {
+                entry.value_ptr.swapRemoveAt(i);
+            }
+        }
+    }
+};
+
+fn stringField(value: json.Value, field: []const u8) ?[]const u8 {
+    const object = switch (value) {
+        .object => |object| object,
+        else => return null,
+    };
+    return switch (object.get(field) orelse return null) {
+        .string => |s| s,
+        else => null,
+    };
+}
+
+fn isType(value: json.Value, rule_type: []const u8) bool {
+    const actual = stringField(value, "type") orelse return false;
+    return std.mem.eql(u8, actual, rule_type);
+}
+
+fn arrayItems(value: json.Value) []const json.Value {
+    return switch (value) {
+        .array => |array| array.items,
+        else => &.{},
+    };
+}
+
+fn members(value: json.Value) []const json.Value {
+    const object = switch (value) {
+        .object => |object| object,
+        else => return &.{},
+    };
+    return arrayItems(object.get("members") orelse return &.{});
+}
+
+/// Only word-like tokens are worth searching for; punctuation is in nearly
+/// every file.
+fn isKeyword(token: []const u8) bool {
+    if (token.len < 2) return false;
+    if (!std.ascii.isAlphabetic(token[0]) and token[0] != '_') return false;
+    for (token) |c| {
+        if (!std.ascii.isAlphanumeric(c) and c != '_') return false;
+    }
+    return true;
+}
+
+fn longerFirst(_: void, a: []const u8, b: []const u8) bool {
+    if (a.len != b.len) return a.len > b.len;
+    return std.mem.lessThan(u8, a, b);
+}
+
+/// Write the keyword table for `grammar_json` to `writer`.
+pub fn generate(allocator: Allocator, grammar_json: []const u8, writer: *std.Io.Writer) !void {
+    var arena_state = std.heap.ArenaAllocator.init(allocator);
+    defer arena_state.deinit();
+    const arena = arena_state.allocator();
+
+    const grammar = try json.parseFromSliceLeaky(json.Value, arena, grammar_json, .{});
+    var analysis = try Analysis.init(arena, grammar);
+    try analysis.solve();
+    var kinds = try analysis.kinds();
+
+    const SortContext = struct {
+        keys: []const []const u8,
+        pub fn lessThan(ctx: @This(), a: usize, b: usize) bool {
+            return std.mem.lessThan(u8, ctx.keys[a], ctx.keys[b]);
+        }
+    };
+    kinds.sort(SortContext{ .keys = kinds.keys() });
+
+    var keywords: std.ArrayList([]const u8) = .empty;
+    for (kinds.keys(), kinds.values()) |kind, tokens| {
+        keywords.clearRetainingCapacity();
+        for (tokens.keys()) |token| {
+            if (isKeyword(token)) try keywords.append(arena, token);
+        }
+        if (keywords.items.len == 0) continue;
+        std.mem.sort([]const u8, keywords.items, {}, longerFirst);
+
+        try writer.writeAll(kind);
+        for (keywords.items) |keyword| try writer.print(" {s}", .{keyword});
+        try writer.writeByte('\n');
+    }
+}
+
+pub fn main(init: std.process.Init) !u8 {
+    const allocator = init.gpa;
+    const io = init.io;
+
+    const params = comptime clap.parseParamsComptime(
+        \\<file>...
+    );
+    var res = try clap.parse(clap.Help, &params, .{ .file = clap.parsers.string }, init.minimal.args, .{
+        .allocator = allocator,
+    });
+    defer res.deinit();
+    if (res.positionals[0].len != 2) {
+        std.log.err("usage: grammar-keywords <grammar.json> <output>", .{});
+        return 1;
+    }
+
+    const grammar_json = blk: {
+        const file = try std.Io.Dir.cwd().openFile(io, res.positionals[0][0], .{});
+        defer file.close(io);
+        var file_reader = file.reader(io, &.{});
+        break :blk try file_reader.interface.allocRemaining(allocator, .unlimited);
+    };
+    defer allocator.free(grammar_json);
+
+    const output = try std.Io.Dir.cwd().createFile(io, res.positionals[0][1], .{});
+    defer output.close(io);
+    var buffer: [4096]u8 = undefined;
+    var output_writer = output.writer(io, &buffer);
+    try generate(allocator, grammar_json, &output_writer.interface);
+    try output_writer.interface.flush();
+    return 0;
+}
+
+const testing = std.testing;
+
+fn expectKeywords(grammar_json: []const u8, expected: []const u8) !void {
+    var out: std.Io.Writer.Allocating = .init(testing.allocator);
+    defer out.deinit();
+    try generate(testing.allocator, grammar_json, &out.writer);
+    try testing.expectEqualStrings(expected, out.written());
+}
+
+test "keywords of sequences and choices" {
+    try expectKeywords(
+        \\{"rules": {
+        \\  "goto_statement": {"type": "SEQ", "members": [
+        \\    {"type": "STRING", "value": "goto"},
+        \\    {"type": "FIELD", "name": "label", "content": {"type": "SYMBOL", "name": "identifier"}},
+        \\    {"type": "STRING", "value": ";"}]},
+        \\  "loop": {"type": "CHOICE", "members": [
+        \\    {"type": "SEQ", "members": [{"type": "STRING", "value": "while"}, {"type": "SYMBOL", "name": "_body"}]},
+        \\    {"type": "SEQ", "members": [{"type": "STRING", "value": "for"}, {"type": "SYMBOL", "name": "_body"}]}]},
+        \\  "_body": {"type": "SEQ", "members": [{"type": "STRING", "value": "do"}, {"type": "REPEAT", "content": {"type": "STRING", "value": "stmt"}}]},
+        \\  "identifier": {"type": "PATTERN", "value": "[a-z]+"}
+        \\}}
+    ,
+        \\goto_statement goto
+        \\loop do
+        \\
+    );
+}
+
+test "aliases narrow what a kind guarantees" {
+    try expectKeywords(
+        \\{"rules": {
+        \\  "import": {"type": "SEQ", "members": [{"type": "STRING", "value": "import"}, {"type": "STRING", "value": "from"}]},
+        \\  "other": {"type": "ALIAS", "named": true, "value": "import",
+        \\    "content": {"type": "SEQ", "members": [{"type": "STRING", "value": "import"}, {"type": "STRING", "value": "as"}]}}
+        \\}}
+    ,
+        \\import import
+        \\other import as
+        \\
+    );
+}
+
+test "external tokens are not assumed" {
+    try expectKeywords(
+        \\{"externals": [{"type": "STRING", "value": "end"}],
+        \\ "rules": {
+        \\  "block": {"type": "SEQ", "members": [{"type": "STRING", "value": "begin"}, {"type": "STRING", "value": "end"}]}
+        \\}}
+    ,
+        \\block begin
+        \\
+    );
+}
@@ -0,0 +1,301 @@
+//! Parallel search of directory trees for a language's source files.
+//!
+//! Directories are the unit of work: a pool of threads takes them from a
+//! work-stealing queue, lists them, and queues the subdirectories they find.
+//! `.gitignore` and `.ignore` files are read as directories are entered, so
+//! ignored directories (`node_modules/`, `build/`, ...) are never opened.
+//! `.git` is always skipped.
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+const Language = @import("language.zig").Language;
+const WorkStealingQueue = @import("ds/work_stealing_queue.zig").WorkStealingQueue;
+pub const ignore = @import("walker/ignore.zig");
+const Rules = ignore.Rules;
+
+pub const Options = struct {
+    language: Language,
+    /// Threads listing directories, the calling thread included.
+    threads: usize = 1,
+    /// Honor `.gitignore` and `.ignore` files.
+    respect_ignore: bool = true,
+};
+
+/// Receives the files a walk finds.
+pub const Sink = struct {
+    context: *anyopaque,
+    /// Called from the walk's threads. `thread` is below `Options.threads`,
+    /// and calls for one thread never overlap. `name` is the file's name in
+    /// `dir`, and `path` the root joined with its path below the root; both
+    /// are only valid for the call.
+    file: *const fn (context: *anyopaque, thread: usize, dir: std.Io.Dir, name: []const u8, path: []const u8) anyerror!void,
+};
+
+const ignore_files = [_][]const u8{ ".gitignore", ".ignore" };
+
+/// Find the files below `roots` with one of the language's extensions.
+/// Roots that are files are passed on whatever their name.
+pub fn walk(allocator: Allocator, io: std.Io, roots: []const []const u8, options: Options, sink: Sink) !void {
+    std.debug.assert(options.threads > 0);
+    var self: Walk = .{
+        .allocator = allocator,
+        .io = io,
+        .options = options,
+        .sink = sink,
+        // Unbounded: the threads popping directories are the ones pushing
+        // their subdirectories.
+        .queue = try .init(allocator, io, options.threads, .newest_first, null),
+    };
+    defer self.deinit();
+
+    if (roots.len == 0) return;
+    const jobs = try allocator.alloc(Job, roots.len);
+    defer allocator.free(jobs);
+    for (jobs, roots) |*job, root| job.* = .{ .root = root, .rel = "", .rules = null };
+    self.outstanding.store(roots.len, .monotonic);
+    try self.queue.push(jobs);
+
+    const threads = try allocator.alloc(std.Thread, options.threads - 1);
+    defer allocator.free(threads);
+    var spawned: usize = 0;
+    defer for (threads[0..spawned]) |t| t.join();
+    errdefer self.fail(error.Canceled);
+    while (spawned < threads.len) : (spawned += 1) {
+        threads[spawned] = try std.Thread.spawn(.{}, Walk.run, .{ &self, spawned + 1 });
+    }
+    self.run(0);
+    for (threads[0..spawned]) |t| t.join();
+    spawned = 0;
+
+    if (self.failure) |err| return err;
+}
+
+/// A directory to list.
+const Job = struct {
+    root: []const u8,
+    /// Path below `root`, owned by the job; empty for the root itself.
+    rel: []const u8,
+    /// Rules in force in the directory's parent.
+    rules: ?*const Rules,
+};
+
+/// Rules along with the ignore files they refer to.
+const OwnedRules = struct {
+    rules: Rules,
+    texts: [ignore_files.len]?[]u8,
+};
+
+const Walk = struct {
+    allocator: Allocator,
+    io: std.Io,
+    options: Options,
+    sink: Sink,
+    queue: WorkStealingQueue(Job),
+    /// Directories queued or being listed. The walk is over when it drops
+    /// to zero.
+    outstanding: std.atomic.Value(usize) = .init(0),
+    failed: std.atomic.Value(bool) = .init(false),
+    /// The first error, once `failed` is set.
+    failure: ?anyerror = null,
+    /// Guards `failure` and `rules`.
+    mu: std.Io.Mutex = .init,
+    /// Every rule set made, freed when the walk ends.
+    rules: std.ArrayList(*OwnedRules) = .empty,
+
+    fn deinit(self: *Walk) void {
+        for (self.rules.items) |owned| {
+            owned.rules.deinit(self.allocator);
+            self.allocator.free(owned.rules.base);
+            for (owned.texts) |text| if (text) |t| self.allocator.free(t);
+            self.allocator.destroy(owned);
+        }
+        self.rules.deinit(self.allocator);
+        self.queue.deinit();
+    }
+
+    fn fail(self: *Walk, err: anyerror) void {
+        self.mu.lockUncancelable(self.io);
+        defer self.mu.unlock(self.io);
+        if (self.failure == null) self.failure = err;
+        self.failed.store(true, .release);
+    }
+
+    fn run(self: *Walk, thread: usize) void {
+        // The path being looked at, reused for every entry.
+        var path: std.ArrayList(u8) = .empty;
+        defer path.deinit(self.allocator);
+        while (true) {
+            const job = (self.queue.pop(thread) catch |err| return self.fail(err)) orelse return;
+            defer self.finish(job);
+            if (self.failed.load(.acquire)) continue;
+            self.visit(thread, &path, job) catch |err| self.fail(err);
+        }
+    }
+
+    fn finish(self: *Walk, job: Job) void {
+        self.allocator.free(job.rel);
+        if (self.outstanding.fetchSub(1, .acq_rel) == 1) {
+            self.queue.close() catch |err| self.fail(err);
+        }
+    }
+
+    fn visit(self: *Walk, thread: usize, path: *std.ArrayList(u8), job: Job) !void {
+        const io = self.io;
+        path.clearRetainingCapacity();
+        // Entries are joined with a `/`, so don't double the root's.
+        try path.appendSlice(self.allocator, std.mem.trimEnd(u8, job.root, "/"));
+        const rel_start = path.items.len + 1;
+        if (job.rel.len > 0) {
+            try path.append(self.allocator, '/');
+            try path.appendSlice(self.allocator, job.rel);
+        }
+        const dir_path = if (path.items.len == 0) job.root else path.items;
+
+        var dir = std.Io.Dir.cwd().openDir(io, dir_path, .{ .iterate = true }) catch |err| switch (err) {
+            // A root named explicitly.
+            error.NotDir => if (job.rel.len == 0) {
+                return self.sink.file(self.sink.context, thread, std.Io.Dir.cwd(), job.root, job.root);
+            } else return,
+            // Unreadable, or gone since it was listed.
+            error.AccessDenied, error.FileNotFound => if (job.rel.len == 0) return err else return,
+            else => |e| return e,
+        };
+        defer dir.close(io);
+
+        const rules = if (self.options.respect_ignore) try self.loadRules(dir, job) else null;
+        const dir_len = path.items.len;
+        var subdirs: std.ArrayList(Job) = .empty;
+        defer subdirs.deinit(self.allocator);
+        errdefer for (subdirs.items) |sub| self.allocator.free(sub.rel);
+
+        var it = dir.iterate();
+        while (try it.next(io)) |entry| {
+            const is_dir = switch (entry.kind) {
+                .directory => true,
+                .file => false,
+                else => continue,
+            };
+            if (is_dir and std.mem.eql(u8, entry.name, ".git")) continue;
+            if (!is_dir and !self.options.language.matchesFileName(entry.name)) continue;
+
+            defer path.shrinkRetainingCapacity(dir_len);
+            try path.append(self.allocator, '/');
+            try path.appendSlice(self.allocator, entry.name);
+            const entry_rel = path.items[rel_start..];
+            if (Rules.ignores(rules, entry_rel, is_dir)) continue;
+
+            if (is_dir) {
+                const rel = try self.allocator.dupe(u8, entry_rel);
+                errdefer self.allocator.free(rel);
+                try subdirs.append(self.allocator, .{ .root = job.root, .rel = rel, .rules = rules });
+            } else {
+                try self.sink.file(self.sink.context, thread, dir, entry.name, path.items);
+            }
+        }
+
+        if (subdirs.items.len == 0) return;
+        _ = self.outstanding.fetchAdd(subdirs.items.len, .acq_rel);
+        self.queue.push(subdirs.items) catch |err| {
+            _ = self.outstanding.fetchSub(subdirs.items.len, .acq_rel);
+            return err;
+        };
+        subdirs.clearRetainingCapacity();
+    }
+
+    /// The rules in force in `dir`: its parent's, extended by its own
+    /// ignore files if it has any.
+    fn loadRules(self: *Walk, dir: std.Io.Dir, job: Job) !?*const Rules {
+        var texts: [ignore_files.len]?[]u8 = @splat(null);
+        errdefer for (texts) |text| if (text) |t| self.allocator.free(t);
+        var files: [ignore_files.len][]const u8 = undefined;
+        var file_count: usize = 0;
+        for (ignore_files, &texts) |name, *text| {
+            const file = dir.openFile(self.io, name, .{}) catch |err| switch (err) {
+                error.FileNotFound => continue,
+                else => |e| return e,
+            };
+            defer file.close(self.io);
+            var reader = file.reader(self.io, &.{});
+            text.* = try reader.interface.allocRemaining(self.allocator, .limited(1024 * 1024));
+            files[file_count] = text.*.?;
+            file_count += 1;
+        }
+        if (file_count == 0) return job.rules;
+
+        const owned = try self.allocator.create(OwnedRules);
+        errdefer self.allocator.destroy(owned);
+        const base = if (job.rel.len == 0) try self.allocator.dupe(u8, "") else try std.mem.concat(self.allocator, u8, &.{ job.rel, "/" });
+        errdefer self.allocator.free(base);
+        owned.* = .{
+            .rules = try Rules.init(self.allocator, job.rules, base, files[0..file_count]),
+            .texts = texts,
+        };
+        errdefer owned.rules.deinit(self.allocator);
+
+        try self.mu.lock(self.io);
+        defer self.mu.unlock(self.io);
+        try self.rules.append(self.allocator, owned);
+        return &owned.rules;
+    }
+};
+
+const testing = std.testing;
+
+test {
+    _ = ignore;
+}
+
+test "walk skips ignored directories" {
+    const io = testing.io;
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    for ([_][]const u8{ "src/lib", "node_modules/dep", "build", ".git" }) |dir| {
+        try tmp.dir.createDirPath(io, dir);
+    }
+    for ([_][2][]const u8{
+        .{ ".gitignore", "node_modules/\n/build\n*.gen.c\n" },
+        .{ "src/lib/.ignore", "!*.gen.c\n" },
+        .{ "main.c", "" },
+        .{ "notes.txt", "" },
+        .{ "src/a.c", "" },
+        .{ "src/a.gen.c", "" },
+        .{ "src/lib/b.h", "" },
+        .{ "src/lib/b.gen.c", "" },
+        .{ "node_modules/dep/c.c", "" },
+        .{ "build/d.c", "" },
+        .{ ".git/e.c", "" },
+    }) |file| try tmp.dir.writeFile(io, .{ .sub_path = file[0], .data = file[1] });
+
+    const root = try std.fs.path.join(testing.allocator, &.{ ".zig-cache/tmp", &tmp.sub_path });
+    defer testing.allocator.free(root);
+
+    const Found = struct {
+        mu: std.Io.Mutex = .init,
+        paths: std.ArrayList([]const u8) = .empty,
+        root_len: usize,
+
+        fn file(context: *anyopaque, _: usize, _: std.Io.Dir, _: []const u8, path: []const u8) anyerror!void {
+            const self: *@This() = @ptrCast(@alignCast(context));
+            try self.mu.lock(testing.io);
+            defer self.mu.unlock(testing.io);
+            try self.paths.append(testing.allocator, try testing.allocator.dupe(u8, path[self.root_len + 1 ..]));
+        }
+
+        fn lessThan(_: void, a: []const u8, b: []const u8) bool {
+            return std.mem.lessThan(u8, a, b);
+        }
+    };
+    var found: Found = .{ .root_len = root.len };
+    defer {
+        for (found.paths.items) |path| testing.allocator.free(path);
+        found.paths.deinit(testing.allocator);
+    }
+
+    try walk(testing.allocator, io, &.{root}, .{ .language = .c, .threads = 2 }, .{ .context = &found, .file = Found.file });
+    std.mem.sort([]const u8, found.paths.items, {}, Found.lessThan);
+
+    const expected = [_][]const u8{ "main.c", "src/a.c", "src/lib/b.gen.c", "src/lib/b.h" };
+    try testing.expectEqual(expected.len, found.paths.items.len);
+    for (expected, found.paths.items) |want, got| try testing.expectEqualStrings(want, got);
+}
@@ -0,0 +1,220 @@
+//! `.gitignore`-style rules, for pruning a directory walk.
+//!
+//! Each directory's ignore files make a `Rules` that points at its parent
+//! directory's, so the rules in force anywhere in the walk are a chain. As
+//! in git, the innermost file with a matching pattern decides, and within a
+//! file the last matching pattern does. Supported syntax: comments, `!`
+//! negation, a trailing `/` for directories only, patterns anchored by a
+//! `/`, and the wildcards `*`, `?`, `[...]` and `**`.
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+pub const Pattern = struct {
+    glob: []const u8,
+    negated: bool,
+    dir_only: bool,
+    /// Matched against the path below the rules' directory rather than the
+    /// name alone.
+    anchored: bool,
+
+    /// Parse one line of an ignore file. Null for blank lines and comments.
+    pub fn parse(line: []const u8) ?Pattern {
+        var glob = std.mem.trimEnd(u8, line, "\r");
+        // Trailing spaces are dropped unless escaped.
+        while (glob.len > 0 and glob[glob.len - 1] == ' ' and !(glob.len > 1 and glob[glob.len - 2] == '\\')) {
+            glob = glob[0 .. glob.len - 1];
+        }
+        if (glob.len == 0 or glob[0] == '#') return null;
+
+        var pattern: Pattern = .{ .glob = glob, .negated = false, .dir_only = false, .anchored = false };
+        if (pattern.glob[0] == '!') {
+            pattern.negated = true;
+            pattern.glob = pattern.glob[1..];
+        } else if (pattern.glob.len > 1 and pattern.glob[0] == '\\' and (pattern.glob[1] == '#' or pattern.glob[1] == '!')) {
+            pattern.glob = pattern.glob[1..];
+        }
+        if (pattern.glob.len > 0 and pattern.glob[pattern.glob.len - 1] == '/') {
+            pattern.dir_only = true;
+            pattern.glob = pattern.glob[0 .. pattern.glob.len - 1];
+        }
+        if (pattern.glob.len > 0 and pattern.glob[0] == '/') {
+            pattern.anchored = true;
+            pattern.glob = pattern.glob[1..];
+        } else if (std.mem.indexOfScalar(u8, pattern.glob, '/') != null) {
+            pattern.anchored = true;
+        }
+        if (pattern.glob.len == 0) return null;
+        return pattern;
+    }
+
+    /// `path` is relative to the rules' directory.
+    pub fn matches(self: Pattern, path: []const u8, is_dir: bool) bool {
+        if (self.dir_only and !is_dir) return false;
+        if (self.anchored) return matchGlob(self.glob, path);
+        const base = if (std.mem.lastIndexOfScalar(u8, path, '/')) |slash| path[slash + 1 ..] else path;
+        return matchGlob(self.glob, base);
+    }
+};
+
+pub const Rules = struct {
+    parent: ?*const Rules,
+    /// The directory the rules apply below, relative to the walk's root,
+    /// with a trailing `/`; empty for the root itself.
+    base: []const u8,
+    /// Refer to the ignore files' text, which the caller keeps.
+    patterns: []const Pattern,
+
+    /// Rules from the contents of a directory's ignore files, in order of
+    /// increasing precedence.
+    pub fn init(allocator: Allocator, parent: ?*const Rules, base: []const u8, files: []const []const u8) Allocator.Error!Rules {
+        var patterns: std.ArrayList(Pattern) = .empty;
+        errdefer patterns.deinit(allocator);
+        for (files) |text| {
+            var lines = std.mem.splitScalar(u8, text, '\n');
+            while (lines.next()) |line| {
+                if (Pattern.parse(line)) |pattern| try patterns.append(allocator, pattern);
+            }
+        }
+        return .{ .parent = parent, .base = base, .patterns = try patterns.toOwnedSlice(allocator) };
+    }
+
+    pub fn deinit(self: *Rules, allocator: Allocator) void {
+        allocator.free(self.patterns);
+    }
+
+    /// Whether `path`, relative to the walk's root, is ignored by `rules`
+    /// or the rules of the directories above.
+    pub fn ignores(rules: ?*const Rules, path: []const u8, is_dir: bool) bool {
+        var current = rules;
+        while (current) |r| : (current = r.parent) {
+            if (!std.mem.startsWith(u8, path, r.base)) continue;
+            const below = path[r.base.len..];
+            var i = r.patterns.len;
+            while (i > 0) {
+                i -= 1;
+                const pattern = r.patterns[i];
+                if (pattern.matches(below, is_dir)) return !pattern.negated;
+            }
+        }
+        return false;
+    }
+};
+
+/// Match `text` against a glob in which `*`, `?` and `[...]` don't match
+/// `/`, and `**` as a whole path component matches any number of them.
+pub fn matchGlob(pattern: []const u8, text: []const u8) bool {
+    if (pattern.len == 0) return text.len == 0;
+
+    if (std.mem.startsWith(u8, pattern, "**")) {
+        const rest = pattern[2..];
+        if (rest.len == 0) return true;
+        if (rest[0] == '/') {
+            if (matchGlob(rest[1..], text)) return true;
+            for (text, 0..) |c, i| {
+                if (c == '/' and matchGlob(rest[1..], text[i + 1 ..])) return true;
+            }
+            return false;
+        }
+        // Otherwise it is an ordinary `*`.
+        return matchGlob(pattern[1..], text);
+    }
+
+    switch (pattern[0]) {
+        '*' => {
+            var i: usize = 0;
+            while (true) : (i += 1) {
+                if (matchGlob(pattern[1..], text[i..])) return true;
+                if (i == text.len or text[i] == '/') return false;
+            }
+        },
+        '?' => return text.len > 0 and text[0] != '/' and matchGlob(pattern[1..], text[1..]),
+        '[' => if (matchClass(pattern, text)) |rest| {
+            return text.len > 0 and rest.matched and matchGlob(rest.pattern, text[1..]);
+        },
+        '\\' => if (pattern.len > 1) {
+            return text.len > 0 and text[0] == pattern[1] and matchGlob(pattern[2..], text[1..]);
+        },
+        else => {},
+    }
+    return text.len > 0 and text[0] == pattern[0] and matchGlob(pattern[1..], text[1..]);
+}
+
+/// Match the first byte of `text` against the class `pattern` starts with.
+/// Null when the class isn't closed, in which case `[` is literal.
+fn matchClass(pattern: []const u8, text: []const u8) ?struct { matched: bool, pattern: []const u8 } {
+    var i: usize = 1;
+    const negated = i < pattern.len and (pattern[i] == '!' or pattern[i] == '^');
+    if (negated) i += 1;
+    const c: ?u8 = if (text.len > 0 and text[0] != '/') text[0] else null;
+    var matched = false;
+    var first = true;
+    while (i < pattern.len) : (first = false) {
+        if (pattern[i] == ']' and !first) {
+            return .{ .matched = c != null and matched != negated, .pattern = pattern[i + 1 ..] };
+        }
+        var low = pattern[i];
+        if (low == '\\' and i + 1 < pattern.len) {
+            i += 1;
+            low = pattern[i];
+        }
+        var high = low;
+        if (i + 2 < pattern.len and pattern[i + 1] == '-' and pattern[i + 2] != ']') {
+            high = pattern[i + 2];
+            i += 2;
+        }
+        if (c) |byte| {
+            if (low <= byte and byte <= high) matched = true;
+        }
+        i += 1;
+    }
+    return null;
+}
+
+const testing = std.testing;
+
+test "glob matching" {
+    try testing.expect(matchGlob("*.o", "main.o"));
+    try testing.expect(!matchGlob("*.o", "src/main.o"));
+    try testing.expect(matchGlob("src/*.c", "src/main.c"));
+    try testing.expect(!matchGlob("src/*.c", "src/lib/main.c"));
+    try testing.expect(matchGlob("**/gen", "gen"));
+    try testing.expect(matchGlob("**/gen", "a/b/gen"));
+    try testing.expect(matchGlob("a/**/b", "a/b"));
+    try testing.expect(matchGlob("a/**/b", "a/x/y/b"));
+    try testing.expect(matchGlob("out/**", "out/x/y"));
+    try testing.expect(matchGlob("file?.[ch]", "file1.h"));
+    try testing.expect(!matchGlob("file?.[!ch]", "file1.h"));
+    try testing.expect(matchGlob("[a-c]x", "bx"));
+    try testing.expect(matchGlob("\\*", "*"));
+    try testing.expect(!matchGlob("\\*", "a"));
+    try testing.expect(matchGlob("[x", "[x"));
+}
+
+test "ignore rules" {
+    var root = try Rules.init(testing.allocator, null, "", &.{
+        \\# build output
+        \\node_modules/
+        \\/build
+        \\*.gen.c
+        \\!keep.gen.c
+        \\docs/*.md
+    });
+    defer root.deinit(testing.allocator);
+    var sub = try Rules.init(testing.allocator, &root, "lib/", &.{"!*.gen.c\n"});
+    defer sub.deinit(testing.allocator);
+
+    try testing.expect(Rules.ignores(&root, "node_modules", true));
+    try testing.expect(Rules.ignores(&root, "web/node_modules", true));
+    try testing.expect(!Rules.ignores(&root, "node_modules", false));
+    try testing.expect(Rules.ignores(&root, "build", true));
+    try testing.expect(!Rules.ignores(&root, "src/build", true));
+    try testing.expect(Rules.ignores(&root, "src/parser.gen.c", false));
+    try testing.expect(!Rules.ignores(&root, "src/keep.gen.c", false));
+    try testing.expect(Rules.ignores(&root, "docs/a.md", false));
+    try testing.expect(!Rules.ignores(&root, "docs/sub/a.md", false));
+    try testing.expect(!Rules.ignores(&root, "main.c", false));
+
+    // The nested file overrides its parent.
+    try testing.expect(!Rules.ignores(&sub, "lib/parser.gen.c", false));
+    try testing.expect(Rules.ignores(&sub, "lib/node_modules", true));
+}
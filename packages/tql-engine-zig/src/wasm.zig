@@ -31,7 +31,84 @@ export fn tql_run(
     var buf = std.Io.Writer.Allocating.init(gpa);
     errdefer buf.deinit();
 
-    const language: tql.Language = switch (language_id) {
+    const language = languageOf(language_id) orelse return finishErr(&buf, out, "invalid language id");
+
+    runImpl(.{ .source = .{
+        .language = language,
+        .query = query_ptr[0..query_len],
+    } }, .{ .bytes = target_ptr[0..target_len] }, &buf) catch |err| {
+        return finishErr(&buf, out, @errorName(err));
+    };
+
+    const slice = buf.toOwnedSlice() catch return fail(out);
+    out.* = .{ .status = 0, .ptr = slice.ptr, .len = slice.len };
+}
+
+/// Like `tql_run`, for a query compiled ahead of time with `tql compile`.
+/// The image knows its language.
+export fn tql_run_image(
+    image_ptr: [*]const u8,
+    image_len: usize,
+    target_ptr: [*]const u8,
+    target_len: usize,
+    out: *Result,
+) void {
+    var buf = std.Io.Writer.Allocating.init(gpa);
+    errdefer buf.deinit();
+
+    runImpl(.{ .image = image_ptr[0..image_len] }, .{ .bytes = target_ptr[0..target_len] }, &buf) catch |err| {
+        return finishErr(&buf, out, @errorName(err));
+    };
+
+    const slice = buf.toOwnedSlice() catch return fail(out);
+    out.* = .{ .status = 0, .ptr = slice.ptr, .len = slice.len };
+}
+
+/// Parse `target` for `tql_run_tree`. The tree is the caller's to free with
+/// `tql_tree_free`, and `target` must stay in place for as long as it is
+/// queried. Null on an invalid language id or a failed parse.
+export fn tql_parse(language_id: u32, target_ptr: [*]const u8, target_len: usize) ?*tql.ts.Tree {
+    const language = languageOf(language_id) orelse return null;
+    var context: tql.RunContext = .{};
+    defer context.deinit();
+    const source_parser = context.parserFor(language) catch return null;
+    return source_parser.parseString(target_ptr[0..target_len], null);
+}
+
+export fn tql_tree_free(tree: *tql.ts.Tree) void {
+    tree.destroy();
+}
+
+/// Like `tql_run`, against a tree from `tql_parse`, which is borrowed rather
+/// than consumed so that many queries can share one parse. `target` is the
+/// text the tree was parsed from.
+export fn tql_run_tree(
+    language_id: u32,
+    query_ptr: [*]const u8,
+    query_len: usize,
+    tree: *tql.ts.Tree,
+    target_ptr: [*]const u8,
+    target_len: usize,
+    out: *Result,
+) void {
+    var buf = std.Io.Writer.Allocating.init(gpa);
+    errdefer buf.deinit();
+
+    const language = languageOf(language_id) orelse return finishErr(&buf, out, "invalid language id");
+
+    runImpl(.{ .source = .{
+        .language = language,
+        .query = query_ptr[0..query_len],
+    } }, .{ .tree = .{ .tree = tree, .source = target_ptr[0..target_len] } }, &buf) catch |err| {
+        return finishErr(&buf, out, @errorName(err));
+    };
+
+    const slice = buf.toOwnedSlice() catch return fail(out);
+    out.* = .{ .status = 0, .ptr = slice.ptr, .len = slice.len };
+}
+
+fn languageOf(language_id: u32) ?tql.Language {
+    return switch (language_id) {
         0 => .cpp,
         1 => .c,
         2 => .go,
@@ -41,21 +118,29 @@ export fn tql_run(
         6 => .tsx,
         7 => .typescript,
         8 => .zig,
-        else => return finishErr(&buf, out, "invalid language id"),
+        else => null,
     };
+}
 
-    runImpl(language, query_ptr[0..query_len], target_ptr[0..target_len], &buf) catch |err| {
-        return finishErr(&buf, out, @errorName(err));
-    };
+const QuerySource = union(enum) {
+    source: struct {
+        language: tql.Language,
+        query: []const u8,
+    },
+    image: []const u8,
+};
 
-    const slice = buf.toOwnedSlice() catch return fail(out);
-    out.* = .{ .status = 0, .ptr = slice.ptr, .len = slice.len };
-}
+const QueryTarget = union(enum) {
+    bytes: []const u8,
+    tree: struct {
+        tree: *tql.ts.Tree,
+        source: []const u8,
+    },
+};
 
 fn runImpl(
-    language: tql.Language,
-    query_source: []const u8,
-    query_target: []const u8,
+    query: QuerySource,
+    query_target: QueryTarget,
     buf: *std.Io.Writer.Allocating,
 ) !void {
     var single_threaded = std.Io.Threaded.init_single_threaded;
@@ -66,27 +151,37 @@ fn runImpl(
     });
     defer engine.deinit();
 
-    var compiled = try engine.compile(query_source, language);
+    var compiled = switch (query) {
+        .source => |s| try engine.compile(s.query, s.language),
+        .image => |bytes| try engine.loadImageBytes(bytes),
+    };
     defer compiled.deinit();
 
     var arena = std.heap.ArenaAllocator.init(gpa);
     defer arena.deinit();
 
-    var run_result = try compiled.run(query_target, arena.allocator(), arena.allocator());
-    defer run_result.deinit();
+    var run_context: tql.RunContext = .{};
+    defer run_context.deinit();
+    var stream = switch (query_target) {
+        .bytes => |bytes| try compiled.streamIn(&run_context, bytes, arena.allocator()),
+        .tree => |t| try compiled.streamTree(t.tree, t.source, arena.allocator()),
+    };
+    defer stream.deinit();
 
     var jws: std.json.Stringify = .{ .writer = &buf.writer };
     try jws.beginObject();
     try jws.objectField("values");
     try jws.beginArray();
-    for (run_result.values.items) |v| try v.jsonStringify(&jws);
+    while (try stream.next()) |v| try v.jsonStringify(&jws);
     try jws.endArray();
     try jws.objectField("stats");
     try jws.beginObject();
     try jws.objectField("parse_time_ns");
-    try jws.write(run_result.stats.parse_time.nanoseconds);
+    try jws.write(stream.stats.parse_time.nanoseconds);
     try jws.objectField("query_time_ns");
-    try jws.write(run_result.stats.query_time.nanoseconds);
+    try jws.write(stream.stats.query_time.nanoseconds);
+    try jws.objectField("skipped");
+    try jws.write(stream.stats.skipped);
     try jws.endObject();
     try jws.endObject();
 }
@@ -40,6 +40,7 @@ export interface QueryArgs {
 export interface QueryStats {
   parse_time_ns: number;
   query_time_ns: number;
+  skipped: boolean;
 }
 
 export interface QueryResult {